@@ -10,15 +10,45 @@
 
 #include <nvram/nvram.h>
 
+#if __SSE2__ && !NVRAM_FLASH_BLANK_CHECK
+#include <emmintrin.h>
+#endif
+
 #define MYDBG(...)  DBGCL("nvram", __VA_ARGS__)
 
 namespace nvram
 {
 
-bool Block::CheckEmpty(const uint32_t* from) const
+/*!
+ * Verifies that a range of flash is erased, which is the most common check
+ * performed on a whole block (or page) during initialization and after erasing
+ *
+ * The backend may delegate the check to a hardware blank check unit,
+ * otherwise the words are combined in batches to minimize the number of branches
+ */
+bool Block::IsBlank(const uint32_t* p, const uint32_t* e)
 {
-    const uint32_t* p = from ? from : &magic;
-    const uint32_t* e = &this[1].magic;
+#if NVRAM_FLASH_BLANK_CHECK
+    return Flash::IsBlank(Span(p, (const uint8_t*)e - (const uint8_t*)p));
+#else
+#if __SSE2__
+    auto ones = _mm_set1_epi32(~0);
+    for (; e - p >= 16; p += 16)
+    {
+        auto v = (const __m128i*)p;
+        auto acc = _mm_and_si128(_mm_and_si128(_mm_loadu_si128(v), _mm_loadu_si128(v + 1)),
+            _mm_and_si128(_mm_loadu_si128(v + 2), _mm_loadu_si128(v + 3)));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(acc, ones)) != 0xFFFF)
+            return false;
+    }
+#endif
+
+    for (; e - p >= 8; p += 8)
+    {
+        if ((p[0] & p[1] & p[2] & p[3] & p[4] & p[5] & p[6] & p[7]) != ~0u)
+            return false;
+    }
+
     while (p != e)
     {
         if (*p++ != ~0u)
@@ -26,6 +56,7 @@ bool Block::CheckEmpty(const uint32_t* from) const
     }
 
     return true;
+#endif
 }
 
 Packed<Block::CheckResult> Block::CheckPagesImpl() const
@@ -41,7 +72,7 @@ Packed<Block::CheckResult> Block::CheckPagesImpl() const
         }
         else if (p.IsEmpty())
         {
-            freeCount++;
+            freeCount += PageUnits();
             flags |= PagesFree;
         }
         else
@@ -55,6 +86,7 @@ Packed<Block::CheckResult> Block::CheckPagesImpl() const
 
 bool Block::Format(uint32_t gen) const
 {
+    EraseSuspension suspend(this);
 #if NVRAM_FLASH_DOUBLE_WRITE
     if (Flash::WriteDouble(&magic, Magic, gen))
 #else
@@ -76,4 +108,31 @@ bool Block::Format(uint32_t gen) const
     return false;
 }
 
+#if NVRAM_LARGE_PAGES
+
+/*!
+ * Switches a formatted block with all pages free to holding a single large page,
+ * the format is reset to regular pages when the block is erased
+ *
+ * If the format cannot be written, the block keeps holding regular pages
+ */
+bool Block::FormatLarge() const
+{
+    EraseSuspension suspend(this);
+#if NVRAM_FLASH_DOUBLE_WRITE
+    if (Flash::WriteDouble(&format, LargeFormat, ~0u))
+#else
+    if (Flash::WriteWord(&format, LargeFormat))
+#endif
+    {
+        MYDBG("Formatted sector for a large page @ %08X", this);
+        return true;
+    }
+
+    MYDBG("ERROR - Failed to format sector for a large page @ %08X", this);
+    return false;
+}
+
+#endif
+
 }
@@ -23,13 +23,14 @@ public:
     //! Returns the address of a NVRAM block from any pointer inside it
     //! The @p ptr is not validated in any way and must point inside a NVRAM block
     ALWAYS_INLINE static const Block* FromPtr(const void* ptr) { return (const Block*)((uintptr_t)ptr & BlockMask); }
-    //! Returns a newly formatted NVRAM block, or NULL if no free space found
-    static const Block* New() { return _manager.NewBlock(); }
+    //! Returns a newly formatted NVRAM block of the manager storing the pages with the specified ID
+    //! (the default one if not specified), or NULL if no free space found
+    static const Block* New(ID pageId = ID()) { return Manager::For(pageId).NewBlock(); }
 
     //! C++ iterator support - returns pointer to the first @ref Page in the block
     ALWAYS_INLINE const class Page* begin() const { return (const class Page*)pages; }
     //! C++ iterator support - returns pointer past the last @ref Page in the block
-    ALWAYS_INLINE const class Page* end() const { return (const class Page*)padding; }
+    ALWAYS_INLINE const class Page* end() const { return (const class Page*)pages[IsLarge() ? 1 : PagesPerBlock]; }
 
     //! Gets block generation (erase count)
     constexpr const uint32_t Generation() const { return generation; }
@@ -39,10 +40,28 @@ public:
     constexpr const bool IsErasable() const { return magic == 0; }
     //! Determines if a block is valid
     constexpr const bool IsValid() const { return !IsEmpty() && !IsErasable(); }
+    //! Determines if a block has a complete header, blocks that are valid but not formatted are found only before initialization
+    constexpr const bool IsFormatted() const { return magic == Magic && generation != ~0u; }
+#if NVRAM_LARGE_PAGES
+    //! Determines if the block holds a single large page spanning all of it instead of regular pages
+    constexpr const bool IsLarge() const { return format == LargeFormat; }
+#else
+    //! Blocks always hold regular pages
+    constexpr const bool IsLarge() const { return false; }
+#endif
+    //! Gets the number of regular pages occupied by each page of the block
+    constexpr const unsigned PageUnits() const { return IsLarge() ? PagesPerBlock : 1; }
+
+    //! Checks if the specified word range contains only ones, i.e. is erased
+    static bool IsBlank(const uint32_t* p, const uint32_t* e);
 
 private:
     //! Magic header (first word) of NVRAM pages
     static constexpr uint32_t Magic = ID("NVRM");  // type has to be uint32_t, Clang is unable to process it as constexpr otherwise
+#if NVRAM_LARGE_PAGES
+    //! Format of blocks holding a single large page
+    static constexpr uint32_t LargeFormat = ID("LRGP");
+#endif
 
     //! Types of pages found in block
     enum PageFlags
@@ -54,6 +73,10 @@ private:
 
     uint32_t magic;         //< All valid pages must contain the @ref Magic value at offset 0
     uint32_t generation;    //< Number of times this particular Block has been erased
+#if NVRAM_LARGE_PAGES
+    uint32_t format;        //< @ref LargeFormat if the block holds a single large page, written when the first page is allocated
+    uint32_t reserved;      //< Unused, completes the doubleword with the format
+#endif
     uint8_t pages[PagesPerBlock][PageSize];
     uint8_t padding[BlockPadding];
 
@@ -67,12 +90,18 @@ private:
     };
 
     //! Checks the contents of the block to determine if it is empty
-    bool CheckEmpty(const uint32_t* from = NULL) const;
+    bool CheckEmpty(const uint32_t* from = NULL) const { return IsBlank(from ? from : &magic, &this[1].magic); }
     //! Checks the contents of the block
     CheckResult CheckPages() const { return unpack<CheckResult>(CheckPagesImpl()); }
     Packed<CheckResult> CheckPagesImpl() const;
     //! Writes the block header with the specified generation (erase count) number
     bool Format(uint32_t generation) const;
+#if NVRAM_LARGE_PAGES
+    //! Determines if a large page can be allocated in the block, i.e. it is formatted with all regular pages free
+    bool CanFormatLarge() const { return IsFormatted() && format == ~0u && CheckPages().freeCount == PagesPerBlock; }
+    //! Marks the block as holding a single large page
+    bool FormatLarge() const;
+#endif
 
     friend class Page;
     friend class Manager;
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2026 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * nvram/CompressedStorage.cpp
+ */
+
+#include <nvram/nvram.h>
+
+#define MYDBG(...)  DBGCL("nvram", __VA_ARGS__)
+
+namespace nvram
+{
+
+static bool CountPart(void* arg0, Span part)
+{
+    return true;
+}
+
+static bool AppendPart(RecordWriter* writer, Span part)
+{
+    return writer->Append(part);
+}
+
+static bool ComparePart(const uint8_t** pos, Span part)
+{
+    if (memcmp(*pos, part, part.Length()))
+    {
+        return false;
+    }
+    *pos += part.Length();
+    return true;
+}
+
+Span CompressedUniqueKeyStorage::Find(ID key) const
+{
+    Span rec = Page::FindUnorderedFirst(pageId, key);
+    if (!rec || rec.Length() < 8)
+    {
+        return Span();
+    }
+    return rec.RemoveLeft(4);
+}
+
+size_t CompressedUniqueKeyStorage::Length(ID key) const
+{
+    Span rec = Find(key);
+    return rec ? rec.Element<uint32_t>() & ~Compressed : 0;
+}
+
+Span CompressedUniqueKeyStorage::Get(ID key, void* buffer, size_t size) const
+{
+    Span rec = Find(key);
+    if (!rec)
+    {
+        return Span();
+    }
+
+    uint32_t header = rec.Element<uint32_t>();
+    size_t length = header & ~Compressed;
+    Span data = rec.RemoveLeft(4);
+
+    if (length > size)
+    {
+        return Span();
+    }
+
+    if (!(header & Compressed))
+    {
+        if (data.Length() != length)
+        {
+            return Span();
+        }
+        memcpy(buffer, data, length);
+        return Span(buffer, length);
+    }
+
+    Span res = Lz::Decompress(data, buffer, length);
+    if (res.Length() != length)
+    {
+        MYDBG("Corrupted compressed record @ %08X", data.Pointer());
+        return Span();
+    }
+    return res;
+}
+
+/*!
+ * The data is compressed twice, first only to determine the length of the record
+ * and then directly into the reserved space
+ */
+Span CompressedUniqueKeyStorage::Set(ID key, Span data) const
+{
+    size_t packed = data.Length() > Lz::MinMatch ? Lz::Compress(data, CountPart) : 0;
+    bool compress = packed && packed < data.Length();
+    uint32_t header = data.Length() | (compress ? Compressed : 0);
+    size_t length = compress ? packed : data.Length();
+
+    // the same record is not written again, like when replacing uncompressed records
+    Span prev = Find(key);
+    if (prev && prev.Element<uint32_t>() == header && prev.Length() == 4 + length)
+    {
+        const uint8_t* pos = prev.Pointer() + 4;
+        if (compress ? Lz::Compress(data, GetDelegate(&ComparePart, &pos)) == packed : !memcmp(pos, data, length))
+        {
+            MYDBG("Same compressed record already written @ %08X", prev.Pointer());
+            return prev;
+        }
+    }
+
+    RecordWriter writer(pageId);
+    if (!writer.Begin(key, 4 + length) || !writer.Append(Span(header)))
+    {
+        return Span();
+    }
+
+    if (compress ? Lz::Compress(data, GetDelegate(&AppendPart, &writer)) != packed : !writer.Append(data))
+    {
+        writer.Abort();
+        return Span();
+    }
+
+    Span rec = writer.Commit(true);
+    return rec ? rec.RemoveLeft(4) : rec;
+}
+
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2026 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * nvram/CompressedStorage.h
+ *
+ * Storage for large variable size records, compressed on write
+ */
+
+#pragma once
+
+#include <nvram/Page.h>
+#include <nvram/Lz.h>
+
+namespace nvram
+{
+
+//! Helper for NVRAM storage pages with variable size records identified by unique 32-bit keys,
+//! stored compressed with @ref Lz whenever it makes them shorter
+//!
+//! Every record starts with a header word holding the uncompressed length and the @ref Compressed flag,
+//! so the page type must be accessed only through this helper. The records are compressed directly
+//! into NVRAM using a @ref RecordWriter, without buffering them in RAM, and decompressed into
+//! a caller-provided buffer when read.
+struct CompressedUniqueKeyStorage
+{
+    constexpr CompressedUniqueKeyStorage(ID pageId) : pageId(pageId) {}
+
+    //! Flag in the record header indicating that the data is compressed
+    static constexpr uint32_t Compressed = 0x80000000;
+
+    //! Returns the uncompressed length of the record with the specified key, or zero if record not found
+    size_t Length(ID key) const;
+    //! Reads the record with the specified key into the buffer
+    //! @returns the record data in the buffer, or an invalid @ref Span if record not found or doesn't fit the buffer
+    Span Get(ID key, void* buffer, size_t size) const;
+    //! Stores the record with the specified key, replacing any previous one,
+    //! nothing is written if the stored record already contains the same data
+    //! @returns a @ref Span representing the stored record in NVRAM (possibly compressed, including the header),
+    //! or an invalid @ref Span if the record could not be written
+    Span Set(ID key, Span data) const;
+    //! Deletes all records with the specified key
+    //! @returns a boolean indicating whethere at least one record was deleted
+    bool Delete(ID key) const { return Page::Delete(pageId, key); }
+
+    const uint32_t pageId;
+
+private:
+    //! Returns the stored record with the specified key, starting with the header
+    Span Find(ID key) const;
+};
+
+}
@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2026 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * nvram/KeyIndex.cpp
+ */
+
+#include <nvram/nvram.h>
+#include <nvram/KeyIndex.h>
+
+#define MYDBG(...)  DBGCL("nvram", __VA_ARGS__)
+
+namespace nvram
+{
+
+#if NVRAM_KEY_INDEX
+
+KeyIndex::~KeyIndex()
+{
+    if (!pageId)
+    {
+        // never filled
+        return;
+    }
+
+    auto& manager = Manager::For(pageId);
+    if (mount != manager.mountCount)
+    {
+        // registrations are discarded each time NVRAM is initialized
+        return;
+    }
+
+    for (auto** p = &manager.indices; *p; p = &(*p)->next)
+    {
+        if (*p == this)
+        {
+            *p = next;
+            break;
+        }
+    }
+}
+
+/*!
+ * Returns the newest record with the specified key, filling the index first if needed
+ */
+Span::packed_t KeyIndex::GetImpl(ID pageId, uint32_t key)
+{
+    if (!filled || mount != Manager::For(pageId).mountCount || pageId != this->pageId)
+    {
+        Fill(pageId);
+    }
+
+    if (overflow)
+    {
+        return Page::FindUnorderedFirst(pageId, key);
+    }
+
+    const Entry* e = Probe(key);
+    if (!e || e->key != key || !e->rec)
+    {
+        return Span();
+    }
+
+    return Page::RecordSpan(e->rec);
+}
+
+void KeyIndex::Fill(ID pageId)
+{
+    auto& manager = Manager::For(pageId);
+    if (mount != manager.mountCount)
+    {
+        // register for updates, registrations are discarded each time NVRAM is initialized
+        mount = manager.mountCount;
+        next = manager.indices;
+        manager.indices = this;
+    }
+
+    memset(table, 0, capacity * sizeof(Entry));
+    this->pageId = pageId;
+    count = 0;
+    overflow = false;
+    filled = true;
+
+    for (Span rec = Page::FindUnorderedFirst(pageId); rec && !overflow; rec = Page::FindUnorderedNext(rec))
+    {
+        Insert(rec, true);
+    }
+
+    if (overflow)
+    {
+        MYDBG("WARNING - Too many keys on pages %.4s for an index with %d entries", &pageId, capacity);
+    }
+}
+
+KeyIndex::Entry* KeyIndex::Probe(uint32_t key) const
+{
+    unsigned mask = capacity - 1;
+    unsigned i = Home(key);
+
+    for (unsigned n = 0; n < capacity; n++, i = (i + 1) & mask)
+    {
+        if (table[i].key == key || table[i].key == 0)
+        {
+            return &table[i];
+        }
+    }
+
+    return NULL;
+}
+
+unsigned KeyIndex::LongestProbe() const
+{
+    unsigned mask = capacity - 1;
+    unsigned longest = 0;
+
+    for (unsigned i = 0; i < capacity; i++)
+    {
+        if (table[i].key)
+        {
+            unsigned distance = (i - Home(table[i].key)) & mask;
+            if (distance > longest)
+            {
+                longest = distance;
+            }
+        }
+    }
+
+    return longest;
+}
+
+void KeyIndex::Insert(const uint8_t* rec, bool keepNewer)
+{
+    uint32_t key = Page::FirstWord(rec);
+    Entry* e = Probe(key);
+
+    if (e && !e->key)
+    {
+        // keep the table at most 3/4 full for reasonable probe lengths
+        if ((count + 1) * 4 > capacity * 3u)
+        {
+            e = NULL;
+        }
+        else
+        {
+            e->key = key;
+            count++;
+        }
+    }
+
+    if (!e)
+    {
+        overflow = true;
+        return;
+    }
+
+    if (!keepNewer || !e->rec || Page::CompareAge(e->rec, rec) < 0)
+    {
+        e->rec = rec;
+    }
+}
+
+void KeyIndex::Update(uint32_t key, const uint8_t* rec)
+{
+    if (rec)
+    {
+        Insert(rec, false);
+    }
+    else if (Entry* e = Probe(key))
+    {
+        if (e->key == key)
+        {
+            e->rec = NULL;
+        }
+    }
+}
+
+void KeyIndex::Move(uint32_t key, const uint8_t* from, const uint8_t* to)
+{
+    if (Entry* e = Probe(key))
+    {
+        if (e->key == key && e->rec == from)
+        {
+            e->rec = to;
+        }
+    }
+}
+
+void KeyIndex::Erase(const Page* page)
+{
+    if (overflow)
+    {
+        // maybe there is enough space now
+        filled = false;
+        return;
+    }
+
+    auto* start = (const uint8_t*)page;
+    auto* end = page->PayloadEnd();
+
+    for (unsigned i = 0; i < capacity; i++)
+    {
+        if (table[i].rec >= start && table[i].rec < end)
+        {
+            // the records must be looked up again
+            filled = false;
+            return;
+        }
+    }
+}
+
+void Manager::IndexUpdateImpl(ID id, uint32_t key, const void* rec)
+{
+    for (auto idx = indices; idx; idx = idx->next)
+    {
+        if (idx->pageId == id && idx->filled && !idx->overflow)
+        {
+            idx->Update(key, (const uint8_t*)rec);
+        }
+    }
+}
+
+void Manager::IndexMoveImpl(ID id, uint32_t key, const void* from, const void* to)
+{
+    for (auto idx = indices; idx; idx = idx->next)
+    {
+        if (idx->pageId == id && idx->filled && !idx->overflow)
+        {
+            idx->Move(key, (const uint8_t*)from, (const uint8_t*)to);
+        }
+    }
+}
+
+/*!
+ * Only the indices holding all keys of the page type are searched, the record of a key
+ * missing in such an index could still be found on the pages after it has been erased
+ */
+const uint8_t* Manager::IndexFindImpl(ID id, uint32_t key) const
+{
+    for (auto idx = indices; idx; idx = idx->next)
+    {
+        if (idx->pageId == id && idx->filled && !idx->overflow)
+        {
+            const KeyIndex::Entry* e = idx->Probe(key);
+            return e && e->key == key ? e->rec : NULL;
+        }
+    }
+    return NULL;
+}
+
+void Manager::IndexEraseImpl(const Page* page)
+{
+    for (auto idx = indices; idx; idx = idx->next)
+    {
+        if (idx->pageId == page->id && idx->filled)
+        {
+            idx->Erase(page);
+        }
+    }
+}
+
+#endif
+
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2026 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * nvram/KeyIndex.h
+ *
+ * RAM index of records identified by unique 32-bit keys
+ */
+
+#pragma once
+
+#include <nvram/Page.h>
+
+namespace nvram
+{
+
+#if NVRAM_KEY_INDEX
+
+//! Open-addressing hash table mapping record keys (i.e. first words) to the newest record
+//! with the key on pages of a single type
+//!
+//! The index is filled lazily on the first lookup and kept current by @ref Manager
+//! as records are added, deleted or relocated. If it cannot hold all the keys,
+//! lookups fall back to searching the pages.
+//!
+//! Available only with NVRAM_KEY_INDEX, the writes do not check for any indices to update otherwise.
+class KeyIndex
+{
+public:
+    //! Stops the manager updating the index, which can be destroyed before the manager is initialized again
+    ~KeyIndex();
+
+protected:
+    struct Entry
+    {
+        uint32_t key;           //< record key, zero if the entry is not used
+        const uint8_t* rec;     //< newest record with the key, NULL if there is no such record
+    };
+
+    constexpr KeyIndex(Entry* table, size_t capacity, unsigned shift)
+        : table(table), capacity(capacity), shift(shift) {}
+
+    //! Returns the record with the specified key on pages with the specified ID
+    Span Get(ID pageId, uint32_t key) { return GetImpl(pageId, key); }
+    //! Returns the longest distance of a key from the entry where its probe sequence starts,
+    //! i.e. the number of extra entries compared when looking it up
+    unsigned LongestProbe() const;
+
+private:
+    Entry* table;
+    uint16_t capacity;
+    //! Right shift of the key hash leaving only as many top bits as needed to index the table
+    uint8_t shift;
+    unsigned count = 0;
+    ID pageId = 0;
+    unsigned mount = 0;
+    bool filled = false;
+    bool overflow = false;
+    KeyIndex* next = NULL;
+
+    Span::packed_t GetImpl(ID pageId, uint32_t key);
+    //! Reads all records to build the index
+    void Fill(ID pageId);
+    //! Returns the entry where the probe sequence for the specified key starts,
+    //! the low bits of the product depend only on the low bits of the key, which are the same
+    //! for many keys (e.g. the first character of an ID), so the top bits are used
+    unsigned Home(uint32_t key) const { return uint32_t(key * 0x9E3779B1u) >> shift; }
+    //! Finds the entry with the specified key, or the empty entry where it can be inserted
+    Entry* Probe(uint32_t key) const;
+    //! Stores the record in the index, optionally keeping an existing newer record
+    void Insert(const uint8_t* rec, bool keepNewer);
+
+    //! Updates the index after a record has been written or deleted
+    void Update(uint32_t key, const uint8_t* rec);
+    //! Updates the index after a record has been relocated
+    void Move(uint32_t key, const uint8_t* from, const uint8_t* to);
+    //! Updates the index after a page has been erased
+    void Erase(const Page* page);
+
+    friend class Manager;
+};
+
+//! @ref KeyIndex with storage for the specified number of keys (must be a power of two)
+template<size_t Capacity> class KeyIndexTable : public KeyIndex
+{
+    static_assert(Capacity > 1 && !(Capacity & (Capacity - 1)), "KeyIndex capacity must be a power of two, at least 2");
+
+public:
+    constexpr KeyIndexTable()
+        : KeyIndex(entries, Capacity, 32 - __builtin_ctz(Capacity)), entries{} {}
+
+    using KeyIndex::Get;
+
+private:
+    Entry entries[Capacity];
+};
+
+#endif
+
+}
@@ -23,8 +23,13 @@ constexpr size_t BlockSize = Flash::PageSize;
 //! Block pointer alignment mask
 constexpr size_t BlockMask = ~(BlockSize - 1);
 
+#if NVRAM_LARGE_PAGES
+//! Block header length, including the block format (see @ref Block::IsLarge)
+constexpr size_t BlockHeader = 16;
+#else
 //! Block header length
 constexpr size_t BlockHeader = 8;
+#endif
 
 //! Pages per block, a bit under 1KB unless overriden
 #ifdef NVRAM_PAGES_PER_BLOCK
@@ -34,12 +39,46 @@ constexpr size_t PagesPerBlock = BlockSize / 1024;
 #endif
 
 //! Number of pages that are always kept free for allocation
-#ifdef NVRAM_PAGES_KEEPT_FREE
+#ifdef NVRAM_PAGES_KEPT_FREE
 constexpr size_t PagesKeptFree = NVRAM_PAGES_KEPT_FREE;
 #else
 constexpr size_t PagesKeptFree = 4;
 #endif
 
+//! Number of blocks without any allocated pages that are kept available for allocation,
+//! tracking blocks requires NVRAM_MAX_BLOCKS to be set
+#ifdef NVRAM_BLOCKS_KEPT_FREE
+constexpr size_t BlocksKeptFree = NVRAM_BLOCKS_KEPT_FREE;
+#else
+constexpr size_t BlocksKeptFree = 0;
+#endif
+
+//! Maximum number of sparse pages merged into a new one by @ref Page::MergeRecords
+#ifdef NVRAM_MERGE_MAX_PAGES
+constexpr size_t MergeMaxPages = NVRAM_MERGE_MAX_PAGES;
+#else
+constexpr size_t MergeMaxPages = 4;
+#endif
+
+//! Maximum number of the oldest pages examined by a single run of @ref Page::MergeRecords
+#ifdef NVRAM_MERGE_SCAN_PAGES
+constexpr size_t MergeScanPages = NVRAM_MERGE_SCAN_PAGES;
+#else
+constexpr size_t MergeScanPages = MergeMaxPages * 2;
+#endif
+
+#if NVRAM_WEAR_LEVELING_SPREAD && !NVRAM_WEAR_LEVELING
+#error "NVRAM_WEAR_LEVELING_SPREAD requires NVRAM_WEAR_LEVELING"
+#endif
+
+#if NVRAM_INPLACE_UPDATES && NVRAM_FLASH_DOUBLE_WRITE
+#error "NVRAM_INPLACE_UPDATES cannot be used with NVRAM_FLASH_DOUBLE_WRITE, programmed doublewords cannot be reprogrammed"
+#endif
+
+#if !NVRAM_MAX_BLOCKS
+static_assert(BlocksKeptFree == 0, "NVRAM_BLOCKS_KEPT_FREE requires NVRAM_MAX_BLOCKS");
+#endif
+
 #if NVRAM_FLASH_DOUBLE_WRITE
 //! Write alignment
 constexpr size_t WriteAlignment = 8;
@@ -60,6 +99,12 @@ constexpr size_t PageHeader = 8;
 //! Useful page payload
 constexpr size_t PagePayload = PageSize - PageHeader;
 
+//! Size of pages spanning all the regular pages of a block, used only with NVRAM_LARGE_PAGES
+constexpr size_t LargePageSize = PagesPerBlock * PageSize;
+
+//! Useful payload of large pages
+constexpr size_t LargePagePayload = LargePageSize - PageHeader;
+
 //! Padding at the end of the block
 constexpr size_t BlockPadding = BlockSize - BlockHeader - PagesPerBlock * PageSize;
 
@@ -69,4 +114,21 @@ inline void _ShredWordOrDouble(const void* ptr) { Flash::ShredDouble(ptr); }
 inline void _ShredWordOrDouble(const void* ptr) { Flash::ShredWord(ptr); }
 #endif
 
+#if NVRAM_FLASH_ERASE_BANKS > 1
+//! Keeps the erase running in the bank of the specified location suspended while the location is being programmed
+class EraseSuspension
+{
+public:
+    EraseSuspension(const void* ptr) : ptr(ptr), suspended(Flash::EraseSuspend(ptr)) {}
+    ~EraseSuspension() { if (suspended) Flash::EraseResume(ptr); }
+
+private:
+    const void* ptr;
+    bool suspended;
+};
+#else
+//! There are no erases running in the background that would have to be suspended
+struct EraseSuspension { EraseSuspension(const void*) {} };
+#endif
+
 }
@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2026 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * nvram/Lz.cpp
+ */
+
+#include <nvram/Lz.h>
+
+namespace nvram
+{
+
+/*!
+ * Greedy compression, each position is matched only against the last one with the same hash
+ */
+size_t Lz::Compress(Span data, LzSink sink)
+{
+    const uint8_t* src = data;
+    size_t n = data.Length();
+    ASSERT(n < 0xFFFF);
+
+    // positions of the last occurrence of each hash, ~0 if none
+    uint16_t table[1 << HashBits];
+    memset(table, 0xFF, sizeof(table));
+
+    uint8_t group[1 + 8 * 2];
+    size_t groupLen = 1, total = 0;
+    unsigned item = 0;
+    group[0] = 0;
+
+    for (size_t i = 0; i < n;)
+    {
+        size_t len = 0, dist = 0;
+
+        if (i + MinMatch <= n)
+        {
+            unsigned h = Hash(src + i);
+            size_t cand = table[h];
+            table[h] = i;
+
+            if (cand != 0xFFFF && i - cand <= Window && !memcmp(src + cand, src + i, MinMatch))
+            {
+                size_t max = n - i < MaxMatch ? n - i : MaxMatch;
+                for (len = MinMatch; len < max && src[cand + len] == src[i + len]; len++);
+                dist = i - cand;
+            }
+        }
+
+        if (len)
+        {
+            group[0] |= 1 << item;
+            group[groupLen++] = (dist - 1) & 0xFF;
+            group[groupLen++] = (dist - 1) >> 8 | (len - MinMatch) << 4;
+
+            // remember the positions inside the match as well, so they can be referenced later
+            for (size_t j = i + 1; j < i + len && j + MinMatch <= n; j++)
+            {
+                table[Hash(src + j)] = j;
+            }
+            i += len;
+        }
+        else
+        {
+            group[groupLen++] = src[i++];
+        }
+
+        if (++item == 8 || i == n)
+        {
+            if (!sink(Span(group, groupLen)))
+            {
+                return 0;
+            }
+            total += groupLen;
+            groupLen = 1;
+            item = 0;
+            group[0] = 0;
+        }
+    }
+
+    return total;
+}
+
+Span Lz::Decompress(Span packed, void* buffer, size_t size)
+{
+    const uint8_t* src = packed;
+    const uint8_t* end = packed.end();
+    uint8_t* out = (uint8_t*)buffer;
+    size_t done = 0;
+
+    while (src < end)
+    {
+        unsigned flags = *src++;
+
+        for (unsigned item = 0; item < 8 && src < end; item++, flags >>= 1)
+        {
+            if (flags & 1)
+            {
+                if (end - src < 2)
+                {
+                    return Span();
+                }
+
+                size_t dist = (src[0] | (src[1] & 0xF) << 8) + 1;
+                size_t len = (src[1] >> 4) + MinMatch;
+                src += 2;
+
+                if (dist > done || len > size - done)
+                {
+                    return Span();
+                }
+
+                // the source can overlap the output, so copy byte by byte
+                for (; len; len--, done++)
+                {
+                    out[done] = out[done - dist];
+                }
+            }
+            else
+            {
+                if (done == size)
+                {
+                    return Span();
+                }
+                out[done++] = *src++;
+            }
+        }
+    }
+
+    return Span(buffer, done);
+}
+
+}
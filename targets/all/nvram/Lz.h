@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2026 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * nvram/Lz.h
+ *
+ * Small footprint LZ77 codec for compressed records
+ */
+
+#pragma once
+
+#include <base/base.h>
+
+namespace nvram
+{
+
+//! Receives the compressed data in small parts
+//! @returns false to stop the compression
+using LzSink = Delegate<bool, Span>;
+
+//! LZSS style codec that needs no state besides a small hash table on the stack during compression
+//!
+//! The compressed stream consists of groups of up to eight items, preceded by a byte with a bit for each,
+//! a clear bit is a literal byte, a set bit a two byte reference to up to @ref MaxMatch bytes
+//! of the preceding @ref Window bytes of the output
+class Lz
+{
+public:
+    //! Maximum distance of repeated data
+    static constexpr size_t Window = 4096;
+    //! Shortest repeated data that is referenced instead of stored as literals
+    static constexpr size_t MinMatch = 3;
+    //! Longest repeated data in a single reference
+    static constexpr size_t MaxMatch = MinMatch + 15;
+
+    //! Compresses the data, passing the output to the @p sink in parts of at most 17 bytes
+    //! @returns the length of the compressed data, or zero if the sink failed
+    static size_t Compress(Span data, LzSink sink);
+    //! Decompresses the data into the buffer of the specified size
+    //! @returns the decompressed data, or an invalid @ref Span if it is corrupted or doesn't fit the buffer
+    static Span Decompress(Span packed, void* buffer, size_t size);
+
+private:
+    static constexpr unsigned HashBits = 8;
+
+    static unsigned Hash(const uint8_t* p) { return ((p[0] | p[1] << 8 | p[2] << 16) * 2654435761u) >> (32 - HashBits); }
+};
+
+}
@@ -0,0 +1,260 @@
+/*
+ * Copyright (c) 2026 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * nvram/Manager.Checkpoint.cpp
+ *
+ * Persistent summary of the NVRAM state allowing initialization without a full scan
+ */
+
+#include <nvram/nvram.h>
+
+#define MYDBG(...)  DBGCL("nvram", __VA_ARGS__)
+
+namespace nvram
+{
+
+#if NVRAM_CHECKPOINT
+
+//! ID of the pages holding checkpoint records
+static constexpr uint32_t CheckpointPage = ID("NVCP");
+
+//! Everything that the initialization scan would otherwise determine
+struct Manager::CheckpointRecord
+{
+    uint32_t magic;             //< first word of the record, always CheckpointPage
+    const Block* blkStart;      //< area covered by the checkpoint
+    const Block* blkEnd;
+    const Block* blkFirst;
+    uint32_t pagesAvailable;
+    uint32_t blocksToErase;
+#if NVRAM_MAX_BLOCKS
+    uint32_t blkUnused[(NVRAM_MAX_BLOCKS + 31) / 32];
+    uint32_t blkErasable[(NVRAM_MAX_BLOCKS + 31) / 32];
+#endif
+#if NVRAM_WRITE_CURSORS
+    WriteCursor cursors[NVRAM_WRITE_CURSORS];   //< newest pages of recently written page types
+#endif
+#if NVRAM_PAGE_DIRECTORY
+    uint16_t dir[NVRAM_PAGE_DIRECTORY];         //< page directory, as indices of the pages in the area
+    uint16_t dirCount;
+    bool dirOverflow;
+#endif
+};
+
+#if NVRAM_PAGE_DIRECTORY
+
+//! Converts a page to its index in the area, as stored in the checkpoint
+static uint32_t CheckpointPageIndex(const Block* blkStart, const Page* page)
+{
+    auto* blk = page->Block();
+    return (blk - blkStart) * PagesPerBlock + ((const uint8_t*)page - blk->pages[0]) / PageSize;
+}
+
+//! Converts an index stored in the checkpoint back to the page
+static const Page* CheckpointIndexPage(const Block* blkStart, uint32_t index)
+{
+    return (const Page*)blkStart[index / PagesPerBlock].pages[index % PagesPerBlock];
+}
+
+#endif
+
+/*!
+ * Stores the current state of all blocks, so that the next initialization
+ * can skip scanning the whole NVRAM area
+ *
+ * The checkpoint is valid until any page is allocated or erased, writing
+ * records does not invalidate it. It should be stored before a clean shutdown
+ * or before entering a low power mode, a new record is written only if the
+ * state has changed since the last checkpoint.
+ *
+ * Returns false if the checkpoint cannot be written, e.g. because the collector is running
+ */
+bool Manager::Checkpoint()
+{
+    if (checkpoint)
+    {
+        // nothing has changed
+        return true;
+    }
+
+    if (collecting)
+    {
+        // block erasure may be in progress
+        return false;
+    }
+
+#if NVRAM_MAX_BLOCKS
+    if (blkUntracked)
+    {
+        return false;
+    }
+#endif
+
+#if NVRAM_MULTIPLE_MANAGERS
+    if (&Manager::For(CheckpointPage) != this)
+    {
+        // checkpoint records are written through the manager the page type is routed to
+        return false;
+    }
+#endif
+
+    // make sure the record fits on the page before taking the snapshot,
+    // so that the page allocation is included in the checkpoint
+    const Page* p = Page::NewestFirst(CheckpointPage);
+    if (!p || p->UnusedBytes() < p->VarSkip(sizeof(CheckpointRecord)))
+    {
+        p = NewPage(CheckpointPage, 0);
+        if (!p)
+        {
+            return false;
+        }
+
+        // older checkpoint pages contain only invalidated records
+        while (auto old = Page::OldestFirst(CheckpointPage))
+        {
+            if (old == p)
+                break;
+            ErasePage(old);
+        }
+    }
+
+    CheckpointRecord cp = {};
+    cp.magic = CheckpointPage;
+    cp.blkStart = blkStart;
+    cp.blkEnd = blkEnd;
+    cp.blkFirst = blkFirst;
+    cp.pagesAvailable = pagesAvailable;
+    cp.blocksToErase = blocksToErase;
+#if NVRAM_MAX_BLOCKS
+    memcpy(cp.blkUnused, blkUnused, sizeof(blkUnused));
+    memcpy(cp.blkErasable, blkErasable, sizeof(blkErasable));
+#endif
+#if NVRAM_WRITE_CURSORS
+    memcpy(cp.cursors, cursors, sizeof(cursors));
+#endif
+#if NVRAM_PAGE_DIRECTORY
+    for (unsigned i = 0; i < dirCount; i++)
+    {
+        uint32_t index = CheckpointPageIndex(blkStart, dir[i]);
+        if (index > 0xFFFF)
+        {
+            // the area is too large for the compact directory
+            return false;
+        }
+        cp.dir[i] = index;
+    }
+    cp.dirCount = dirCount;
+    cp.dirOverflow = dirOverflow;
+#endif
+
+    Span rec = Page::AddVar(CheckpointPage, Span(cp));
+    if (!rec)
+    {
+        return false;
+    }
+
+    if (Page::FromPtr(rec.Pointer()) != p)
+    {
+        // the write failed and another page had to be allocated, the snapshot is already outdated
+        Page::ShredRecord(rec.Pointer());
+        return false;
+    }
+
+    MYDBG("Checkpoint stored @ %08X", rec.Pointer());
+    checkpoint = rec.Pointer();
+    return true;
+}
+
+/*!
+ * Invalidates the current checkpoint, must be called before any change to the state captured by it
+ */
+void Manager::CheckpointDrop()
+{
+    if (checkpoint)
+    {
+        MYDBG("Checkpoint invalidated @ %08X", checkpoint);
+        Page::ShredRecord(checkpoint);
+        checkpoint = NULL;
+    }
+}
+
+/*!
+ * Locates a valid checkpoint and restores the state from it
+ *
+ * Only page headers are read while looking for the checkpoint. If the checkpoint
+ * doesn't match the NVRAM area or the initialization flags, it is invalidated
+ * and false is returned, so that a full scan is performed.
+ *
+ * A restored checkpoint also replaces the scans resolving interrupted page copies
+ * and record moves, as both invalidate the checkpoint before changing anything.
+ */
+bool Manager::CheckpointRestore(InitFlags flags)
+{
+    checkpoint = NULL;
+
+    for (auto* blk = blkEnd - 1; blk >= blkStart; blk--)
+    {
+        if (blk->magic != Block::Magic || blk->generation == ~0u)
+        {
+            continue;
+        }
+
+        for (auto& p: *blk)
+        {
+            if (p.GetID() != CheckpointPage)
+            {
+                continue;
+            }
+
+            for (Span rec: p)
+            {
+                CheckpointRecord cp;
+                if (rec.Length() == sizeof(cp))
+                {
+                    // the record may not be aligned for direct access
+                    memcpy(&cp, rec.Pointer(), sizeof(cp));
+                }
+
+                if (flags != InitFlags::None ||
+                    rec.Length() != sizeof(cp) ||
+                    cp.blkStart != blkStart || cp.blkEnd != blkEnd ||
+                    cp.blkFirst > blk || (cp.blkFirst != blkEnd && cp.blkFirst->magic != Block::Magic))
+                {
+                    MYDBG("Discarding checkpoint @ %08X", rec.Pointer());
+                    Page::ShredRecord(rec.Pointer());
+                    continue;
+                }
+
+                blkFirst = cp.blkFirst;
+                pagesAvailable = cp.pagesAvailable;
+                blocksToErase = cp.blocksToErase;
+#if NVRAM_MAX_BLOCKS
+                memcpy(blkUnused, cp.blkUnused, sizeof(blkUnused));
+                memcpy(blkErasable, cp.blkErasable, sizeof(blkErasable));
+#endif
+#if NVRAM_WRITE_CURSORS
+                memcpy(cursors, cp.cursors, sizeof(cursors));
+#endif
+#if NVRAM_PAGE_DIRECTORY
+                for (unsigned i = 0; i < cp.dirCount; i++)
+                {
+                    dir[i] = CheckpointIndexPage(blkStart, cp.dir[i]);
+                }
+                dirCount = cp.dirCount;
+                dirOverflow = cp.dirOverflow;
+#endif
+                MYDBG("Restored checkpoint @ %08X", rec.Pointer());
+                checkpoint = rec.Pointer();
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+#endif
+
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2026 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * nvram/Manager.Cursor.cpp
+ *
+ * Cached locations of free space for appending records without page scans
+ */
+
+#include <nvram/nvram.h>
+
+namespace nvram
+{
+
+#if NVRAM_WRITE_CURSORS
+
+void Manager::CursorReset()
+{
+    memset(cursors, 0, sizeof(cursors));
+    cursorReplace = 0;
+}
+
+bool Manager::CursorGet(ID id, const Page*& page, const uint8_t*& free) const
+{
+    for (auto& c: cursors)
+    {
+        if (c.id == id)
+        {
+            page = c.page;
+            free = c.free;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void Manager::CursorSet(ID id, const Page* page, const uint8_t* free)
+{
+    WriteCursor* target = NULL;
+
+    for (auto& c: cursors)
+    {
+        if (c.id == id)
+        {
+            target = &c;
+            break;
+        }
+    }
+
+    if (!target)
+    {
+        target = &cursors[cursorReplace];
+        cursorReplace = (cursorReplace + 1) % countof(cursors);
+    }
+
+    *target = { id, page, free };
+}
+
+void Manager::CursorAdvance(const Page* page, const uint8_t* free)
+{
+    for (auto& c: cursors)
+    {
+        if (c.page == page)
+        {
+            c.free = free;
+            return;
+        }
+    }
+}
+
+void Manager::CursorDrop(const Page* page)
+{
+    for (auto& c: cursors)
+    {
+        if (c.page == page)
+        {
+            c = {};
+            return;
+        }
+    }
+}
+
+#endif
+
+}
@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2026 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * nvram/Manager.Directory.cpp
+ *
+ * RAM directory of NVRAM pages, replacing page header scans with lookups
+ */
+
+#include <nvram/nvram.h>
+
+#define MYDBG(...)  DBGCL("nvram", __VA_ARGS__)
+
+namespace nvram
+{
+
+#if NVRAM_PAGE_DIRECTORY
+
+/*!
+ * Pages are grouped by ID, pages with the same ID are ordered by sequence
+ * number, pages with duplicate sequence numbers by address
+ *
+ * Comparing the wrapping sequence numbers directly is not a strict weak ordering,
+ * they are compared by their distance from the specified base instead, which keeps
+ * the order of the pages as long as their sequences span less than half of the range,
+ * the same as when the pages are scanned (see @ref Page::Scan)
+ */
+bool Manager::DirectoryOrder(const Page* a, const Page* b, uint16_t base)
+{
+    if (a->id != b->id)
+        return a->id < b->id;
+    uint16_t da = a->sequence - base + 0x8000;
+    uint16_t db = b->sequence - base + 0x8000;
+    if (da != db)
+        return da < db;
+    return a < b;
+}
+
+unsigned Manager::DirectoryFind(ID id) const
+{
+    unsigned lo = 0, hi = dirCount;
+    while (lo < hi)
+    {
+        unsigned mid = (lo + hi) / 2;
+        if (dir[mid]->id < id)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/*!
+ * The sequences are compared relative to the oldest page with the same ID,
+ * or to the page itself if it is the first one
+ */
+unsigned Manager::DirectoryLowerBound(const Page* page) const
+{
+    unsigned lo = DirectoryFind(page->id), hi = dirCount;
+    uint16_t base = lo < dirCount && dir[lo]->id == page->id ? dir[lo]->sequence : page->sequence;
+    while (lo < hi)
+    {
+        unsigned mid = (lo + hi) / 2;
+        if (DirectoryOrder(dir[mid], page, base))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/*!
+ * Collects all valid pages, expected to be called once the blocks are
+ * in a consistent state after initialization
+ */
+void Manager::DirectoryBuild()
+{
+    dirCount = 0;
+    dirOverflow = false;
+
+    for (auto& b: UsedBlocks())
+    {
+        if (!b.IsValid())
+            continue;
+
+        for (auto& p: b)
+        {
+            NVRAM_STATS_ADD(*this, pagesScanned, 1);
+            if (p.IsValid())
+            {
+                DirectoryInsert(&p);
+            }
+        }
+    }
+
+    MYDBG("Page directory contains %d/%d pages", dirCount, NVRAM_PAGE_DIRECTORY);
+}
+
+void Manager::DirectoryInsert(const Page* page)
+{
+    if (dirOverflow)
+        return;
+
+    if (dirCount == countof(dir))
+    {
+        MYDBG("WARNING - Page directory full, falling back to page scans");
+        dirOverflow = true;
+        return;
+    }
+
+    unsigned i = DirectoryLowerBound(page);
+    memmove(&dir[i + 1], &dir[i], (dirCount - i) * sizeof(dir[0]));
+    dir[i] = page;
+    dirCount++;
+}
+
+void Manager::DirectoryRemove(const Page* page)
+{
+    if (dirOverflow)
+        return;
+
+    unsigned i = DirectoryLowerBound(page);
+    if (i < dirCount && dir[i] == page)
+    {
+        dirCount--;
+        memmove(&dir[i], &dir[i + 1], (dirCount - i) * sizeof(dir[0]));
+    }
+}
+
+bool Manager::DirectoryRange(ID id, const Page*& oldest, const Page*& newest) const
+{
+    if (dirOverflow)
+        return false;
+
+    unsigned lo = DirectoryFind(id);
+
+    if (lo == dirCount || dir[lo]->id != id)
+    {
+        oldest = newest = NULL;
+        return true;
+    }
+
+    // find the first entry past the ID
+    unsigned first = lo, hi = dirCount;
+    while (lo < hi)
+    {
+        unsigned mid = (lo + hi) / 2;
+        if (dir[mid]->id == id)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    oldest = dir[first];
+    newest = dir[lo - 1];
+    return true;
+}
+
+bool Manager::DirectoryNeighbors(const Page* page, const Page*& older, const Page*& newer) const
+{
+    if (dirOverflow)
+        return false;
+
+    unsigned i = DirectoryLowerBound(page);
+    if (i == dirCount || dir[i] != page)
+        return false;
+
+    older = i > 0 && dir[i - 1]->id == page->id ? dir[i - 1] : NULL;
+    newer = i + 1 < dirCount && dir[i + 1]->id == page->id ? dir[i + 1] : NULL;
+    return true;
+}
+
+#endif
+
+}
@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2026 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * nvram/Manager.Filter.cpp
+ *
+ * Per-page summaries of record keys allowing searches to skip pages
+ */
+
+#include <nvram/nvram.h>
+
+namespace nvram
+{
+
+#if NVRAM_PAGE_FILTERS
+
+//! Selects the two bits representing the first word in a page filter
+static void FilterBits(uint32_t firstWord, unsigned& a, unsigned& b)
+{
+    // multiplicative hashing spreads sequential keys over all the bits
+    uint32_t hash = firstWord * 0x9E3779B1u;
+    a = hash >> 24;
+    b = (hash >> 16) & 0xFF;
+}
+
+void Manager::FilterReset()
+{
+    memset(filters, 0, sizeof(filters));
+}
+
+Manager::PageFilter& Manager::FilterFor(const Page* page)
+{
+    auto* blk = page->Block();
+    size_t index = (blk - blkStart) * PagesPerBlock + (page - blk->begin());
+    return filters[index % countof(filters)];
+}
+
+void Manager::FilterDrop(const Page* page)
+{
+    auto& f = FilterFor(page);
+    if (f.page == page)
+    {
+        f.page = NULL;
+    }
+}
+
+/*!
+ * Determines if the page may contain a record with the specified first word
+ *
+ * The summary of the page is built on first use and extended with records
+ * appended since then, so no false negatives are possible. Shredded records
+ * are not removed from the summary, they can only cause false positives.
+ */
+bool Manager::FilterMayContain(const Page* page, uint32_t firstWord)
+{
+    auto& f = FilterFor(page);
+    const uint8_t* pe = page->PayloadEnd();
+
+    if (f.page != page)
+    {
+        // replace the summary of another page sharing the same slot
+        f = {};
+        f.page = page;
+        f.end = page->IsFixed() ? page->data : page->data + 4;
+    }
+
+    if (f.end < pe && !page->IsFreeAt(f.end))
+    {
+        // records have been appended since the last update
+        const uint8_t* rec = f.end;
+
+        if (page->IsFixed())
+        {
+            uint32_t recordSize = page->recordSize;
+            for (; rec + recordSize <= pe; rec += recordSize)
+            {
+                uint32_t first = Page::FirstWord(rec);
+                if (first == ~0u)
+                    break;
+                if (first)
+                    FilterAdd(f, first);
+            }
+
+            if (rec + recordSize > pe)
+                rec = pe;
+        }
+        else
+        {
+            uint32_t len;
+            for (; rec < pe; rec += page->VarSkip(len))
+            {
+                len = Page::VarGetLen(rec);
+                if (len == ~0u || !Page::VarFits(rec, len, pe))
+                    break;
+                if (len && Page::FirstWord(rec) == ~0u)
+                {
+                    // the record is not complete yet (or never will be), the summary
+                    // cannot be extended past it and the records after it must be searched
+                    f.end = rec;
+                    return true;
+                }
+                if (len)
+                    FilterAdd(f, Page::FirstWord(rec));
+            }
+        }
+
+        f.end = rec;
+    }
+
+    unsigned a, b;
+    FilterBits(firstWord, a, b);
+    return (f.bits[a / 32] & (1u << (a % 32))) && (f.bits[b / 32] & (1u << (b % 32)));
+}
+
+void Manager::FilterAdd(PageFilter& f, uint32_t firstWord)
+{
+    unsigned a, b;
+    FilterBits(firstWord, a, b);
+    f.bits[a / 32] |= 1u << (a % 32);
+    f.bits[b / 32] |= 1u << (b % 32);
+}
+
+#endif
+
+}
@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2026 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * nvram/Manager.Large.cpp
+ *
+ * Selection of the page geometry for page types storing high volume data
+ */
+
+#include <nvram/nvram.h>
+
+#define MYDBG(...)  DBGCL("nvram", __VA_ARGS__)
+
+namespace nvram
+{
+
+#if NVRAM_LARGE_PAGES
+
+bool Manager::UseLargePages(ID id)
+{
+    for (auto& large: largePages)
+    {
+        if (large == id || !large)
+        {
+            large = id;
+            return true;
+        }
+    }
+
+    MYDBG("ERROR - Cannot use large pages for %.4s, increase NVRAM_LARGE_PAGES", &id);
+    return false;
+}
+
+bool Manager::UsesLargePages(ID id) const
+{
+    for (auto large: largePages)
+    {
+        if (large == id)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*!
+ * The free page of a block holding a large page can be used only by page types using large pages,
+ * while a large page can be allocated in place of the first page of a block with all regular pages free
+ */
+bool Manager::FitsGeometry(const Page* free, bool large) const
+{
+    auto* blk = free->Block();
+    if (blk == evacuating)
+    {
+        // the pages are being moved out of the block
+        return false;
+    }
+
+    if (blk->IsLarge())
+    {
+        return large;
+    }
+
+    return !large || (free == blk->begin() && blk->CanFormatLarge());
+}
+
+/*!
+ * Free pages of a block do not make large pages available unless they are all free,
+ * the collectors must release whole blocks for them
+ */
+bool Manager::LargePageAvailable(unsigned count) const
+{
+    if (!largePages[0])
+    {
+        return true;
+    }
+
+    for (auto* blk = blkStart; blk != blkEnd && count; blk++)
+    {
+        if (blk->IsEmpty() || (blk->IsLarge() ? blk->begin()->IsEmpty() : blk->CanFormatLarge()))
+        {
+            count--;
+        }
+    }
+    return !count;
+}
+
+/*!
+ * Moves the remaining pages out of the regular block with the fewest valid pages
+ * and erases it, so that a large page can be allocated when the free pages are
+ * scattered over partially used blocks and the collectors would have to discard data
+ *
+ * The pages are copied the same way as by wear leveling, keeping their sequence numbers
+ * @returns true if the block has been released
+ */
+bool Manager::Evacuate()
+{
+    const Block* best = NULL;
+    unsigned bestValid = 0, bestFree = 0;
+
+    for (auto& b: Blocks(blkFirst))
+    {
+        if (!b.IsValid() || b.IsLarge())
+            continue;
+
+        unsigned valid = 0, free = 0;
+        for (auto& p: b)
+        {
+            valid += p.IsValid();
+            free += p.IsEmpty();
+        }
+
+        if (valid + free == PagesPerBlock)
+        {
+            // nothing to reclaim, moving the pages would only shuffle free space around
+            continue;
+        }
+
+        // the fewest pages to copy, then the most erasable pages to reclaim
+        if (!best || valid < bestValid || (valid == bestValid && free < bestFree))
+        {
+            best = &b;
+            bestValid = valid;
+            bestFree = free;
+        }
+    }
+
+    if (!best)
+    {
+        return false;
+    }
+
+    if (pagesAvailable <= bestFree + bestValid)
+    {
+        // no room for the copies in other blocks, at least one page must remain free until
+        // the block is erased, so that e.g. the transaction journal can take another page
+        return false;
+    }
+
+    MYDBG("Moving %d pages out of block @ %08X to make room for a large page", bestValid, best);
+
+    evacuating = best;
+    for (auto& p: *best)
+    {
+        if (p.IsValid() && !CopyPage(&p))
+        {
+            evacuating = NULL;
+            return false;
+        }
+    }
+    evacuating = NULL;
+
+    if (best->IsValid())
+    {
+        // not erased by the last copy, the free pages are lost until the block is erased
+        pagesAvailable -= best->CheckPages().freeCount;
+        EraseBlock(best);
+    }
+    return true;
+}
+
+#endif
+
+}
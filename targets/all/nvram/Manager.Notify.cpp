@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2026 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * nvram/Manager.Notify.cpp
+ *
+ * Deferred change notifications, coalesced and delivered by a separate task
+ */
+
+#include <nvram/nvram.h>
+
+#define MYDBG(...)  DBGCL("nvram", __VA_ARGS__)
+
+namespace nvram
+{
+
+#if NVRAM_NOTIFY_DEFERRED
+
+void Manager::NotifyDefer(ID id, uint32_t key)
+{
+    unsigned i;
+    for (i = 0; i < pendingCount; i++)
+    {
+        if (pending[i].id == id)
+        {
+            if (pending[i].key != key)
+            {
+                // different records have changed
+                pending[i].key = 0;
+            }
+            break;
+        }
+    }
+
+    if (i == pendingCount)
+    {
+        if (pendingCount < countof(pending))
+        {
+            pending[pendingCount++] = { id, key };
+        }
+        else if (!pendingOverflow)
+        {
+            MYDBG("Too many pending notifications, notifying about all page types");
+            pendingOverflow = true;
+        }
+    }
+
+    if (!notifying)
+    {
+        notifying = true;
+        kernel::Task::Run(this, &Manager::NotifyDispatch);
+    }
+}
+
+async(Manager::NotifyDispatch)
+async_def(
+    PendingNotification change;
+)
+{
+    // the notifiers can change the contents again, so the pending changes are taken one by one
+    while (pendingCount || pendingOverflow)
+    {
+        if (pendingOverflow)
+        {
+            // some changes were not recorded, everything may have changed
+            pendingOverflow = false;
+            pendingCount = 0;
+            for (auto& notifier : notifiers)
+            {
+                if (!notifier.immediate)
+                {
+                    notifier(notifier.key, 0);
+                }
+            }
+        }
+        else
+        {
+            f.change = pending[0];
+            memmove(pending, pending + 1, --pendingCount * sizeof(*pending));
+            InvokeNotifiers(f.change.id, f.change.key, false, true);
+        }
+
+        async_yield();
+    }
+
+    notifying = false;
+}
+async_end
+
+#endif
+
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2026 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * nvram/Manager.Pool.cpp
+ *
+ * Bitmaps tracking unused and erasable blocks without reading block headers
+ */
+
+#include <nvram/nvram.h>
+
+#define MYDBG(...)  DBGCL("nvram", __VA_ARGS__)
+
+namespace nvram
+{
+
+#if NVRAM_MAX_BLOCKS
+
+void Manager::PoolReset()
+{
+    memset(blkUnused, 0, sizeof(blkUnused));
+    memset(blkErasable, 0, sizeof(blkErasable));
+    blkUntracked = blkEnd - blkStart > NVRAM_MAX_BLOCKS;
+
+    if (blkUntracked)
+    {
+        MYDBG("WARNING - %d blocks cannot be tracked, increase NVRAM_MAX_BLOCKS", blkEnd - blkStart);
+    }
+}
+
+void Manager::PoolMark(uint32_t* bitmap, const Block* block, bool set)
+{
+    if (blkUntracked)
+    {
+        return;
+    }
+
+    unsigned n = block - blkStart;
+    if (set)
+    {
+        bitmap[n / 32] |= 1u << (n % 32);
+    }
+    else
+    {
+        bitmap[n / 32] &= ~(1u << (n % 32));
+    }
+}
+
+bool Manager::PoolTest(const uint32_t* bitmap, const Block* block) const
+{
+    unsigned n = block - blkStart;
+    return bitmap[n / 32] & (1u << (n % 32));
+}
+
+unsigned Manager::PoolUnusedCount() const
+{
+    unsigned count = 0;
+    for (auto bits: blkUnused)
+    {
+        count += __builtin_popcount(bits);
+    }
+    return count;
+}
+
+const Block* Manager::PoolFindEmpty() const
+{
+    if (blkUntracked)
+    {
+        return NULL;
+    }
+
+    // prefer blocks from the end, same as the linear search
+    for (unsigned w = countof(blkUnused); w--;)
+    {
+        for (uint32_t bits = blkUnused[w]; bits;)
+        {
+            unsigned bit = 31 - __builtin_clz(bits);
+            bits &= ~(1u << bit);
+
+            // unused blocks with a header still have free pages that will be found by the page search
+            auto* blk = blkStart + w * 32 + bit;
+            if (blk->IsEmpty())
+            {
+                return blk;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+#endif
+
+}
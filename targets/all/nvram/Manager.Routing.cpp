@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2026 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * nvram/Manager.Routing.cpp
+ *
+ * Multiple manager instances with separate areas, page types are routed to them by ID
+ */
+
+#include <nvram/nvram.h>
+
+#define MYDBG(...)  DBGCL("nvram", __VA_ARGS__)
+
+namespace nvram
+{
+
+#if NVRAM_MULTIPLE_MANAGERS
+
+Manager* Manager::instances;
+
+Manager::~Manager()
+{
+    for (Manager** pm = &instances; *pm; pm = &(*pm)->nextInstance)
+    {
+        if (*pm == this)
+        {
+            *pm = nextInstance;
+            break;
+        }
+    }
+}
+
+void Manager::Attach()
+{
+    if (this == &_manager)
+    {
+        // the default manager is used for anything not found elsewhere
+        return;
+    }
+
+    for (Manager* m = instances; m; m = m->nextInstance)
+    {
+        if (m == this)
+        {
+            return;
+        }
+    }
+
+    MYDBG("Attaching manager for area %08X-%08X", blkStart, blkEnd);
+    nextInstance = instances;
+    instances = this;
+}
+
+Manager& Manager::For(ID id)
+{
+    for (Manager* m = instances; m; m = m->nextInstance)
+    {
+        for (auto& route: m->routes)
+        {
+            if (route == id)
+            {
+                return *m;
+            }
+        }
+    }
+
+    return _manager;
+}
+
+Manager& Manager::Containing(const void* ptr)
+{
+    for (Manager* m = instances; m; m = m->nextInstance)
+    {
+        if (ptr >= m->blkStart && ptr < m->blkEnd)
+        {
+            return *m;
+        }
+    }
+
+    return _manager;
+}
+
+#endif
+
+}
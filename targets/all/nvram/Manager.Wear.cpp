@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2026 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * nvram/Manager.Wear.cpp
+ *
+ * Static wear leveling - moving cold data out of the least worn blocks,
+ * and the page copies also used to release blocks for large pages
+ */
+
+#include <nvram/nvram.h>
+
+#define MYDBG(...)  DBGCL("nvram", __VA_ARGS__)
+
+namespace nvram
+{
+
+#if NVRAM_WEAR_LEVELING_SPREAD
+
+/*!
+ * Looks for the least worn block that is full, i.e. likely holds data that is
+ * not changing, and moves its pages to the most worn unused block if the
+ * difference in generations is larger than NVRAM_WEAR_LEVELING_SPREAD
+ */
+bool Manager::LevelWear()
+{
+    const Block* cold = NULL;
+    uint32_t maxGen = 0;
+
+    for (auto& b: Blocks(blkFirst))
+    {
+        if (!b.IsValid())
+            continue;
+
+        if (b.generation > maxGen)
+        {
+            maxGen = b.generation;
+        }
+
+        // pages are allocated in order, so the block is full if its last page is in use
+        if ((b.end() - 1)->IsEmpty())
+            continue;
+
+        if (!cold || b.generation < cold->generation)
+        {
+            cold = &b;
+        }
+    }
+
+    if (!cold || maxGen - cold->generation <= NVRAM_WEAR_LEVELING_SPREAD)
+    {
+        return false;
+    }
+
+    unsigned valid = 0;
+    for (auto& p: *cold)
+    {
+        valid += p.IsValid() * cold->PageUnits();
+    }
+
+    if (pagesAvailable < valid + PagesKeptFree)
+    {
+        return false;
+    }
+
+    MYDBG("Moving %d pages out of block gen %d @ %08X, max gen %d", valid, cold->generation, cold, maxGen);
+
+    for (auto& p: *cold)
+    {
+        if (p.IsValid() && !CopyPage(&p))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+#endif
+
+#if NVRAM_WEAR_LEVELING_SPREAD || NVRAM_LARGE_PAGES
+
+/*!
+ * Copies the valid records to a new page with the same ID and sequence number
+ * and erases the original, so the order of records is not affected
+ */
+bool Manager::CopyPage(const Page* page)
+{
+    auto* copy = NewPage(page->id, page->recordSize, page);
+    if (!copy)
+    {
+        return false;
+    }
+
+    const uint8_t* free = NULL;
+    for (Span rec = Page::FindForwardNextImpl(page, NULL, 0, NULL); rec; rec = Page::FindForwardNextImpl(page, rec, 0, NULL))
+    {
+        if (!free || free >= copy->PayloadEnd() || !copy->IsFreeAt(free))
+        {
+            free = copy->FindFree();
+        }
+
+        // the copy runs out of space only if writes fail and have to be retried further on the page
+        Span span = free ? Span(Page::WriteImpl(free, Page::FirstWord(rec), rec.Pointer() + 4, rec.Length())) : Span();
+        if (!span)
+        {
+            MYDBG("ERROR - Failed to copy page %.4s-%d @ %08X to %08X", &page->id, page->sequence, page, copy);
+            ErasePage(copy);
+            return false;
+        }
+
+        free = copy->SkipRecord(span, rec.Length());
+    }
+
+    MYDBG("Copied page %.4s-%d @ %08X to %08X", &page->id, page->sequence, page, copy);
+    ErasePage(page);
+    Notify(copy->id);
+    return true;
+}
+
+/*!
+ * Determines if the records of @p copy are the first records of @p page, the last one
+ * possibly cut short, i.e. still erased where @p page holds data
+ */
+bool Manager::IsCopyPrefix(const Page* copy, const Page* page)
+{
+    Span rec = Page::FindForwardNextImpl(page, NULL, 0, NULL);
+    for (Span crec = Page::FindForwardNextImpl(copy, NULL, 0, NULL); crec; crec = Page::FindForwardNextImpl(copy, crec, 0, NULL))
+    {
+        if (!rec || rec.Length() != crec.Length())
+        {
+            return false;
+        }
+
+        if (memcmp(rec.Pointer(), crec.Pointer(), rec.Length()))
+        {
+            // only the last record of the copy can be incomplete
+            if (Page::FindForwardNextImpl(copy, crec, 0, NULL))
+            {
+                return false;
+            }
+
+            auto* pr = rec.Pointer();
+            auto* pc = crec.Pointer();
+            for (size_t i = 0; i < rec.Length(); i++)
+            {
+                if (pc[i] != pr[i] && pc[i] != 0xFF)
+                {
+                    return false;
+                }
+            }
+        }
+
+        rec = Page::FindForwardNextImpl(page, rec, 0, NULL);
+    }
+
+    return true;
+}
+
+/*!
+ * Looks for two pages with the same ID and sequence number, which are left behind
+ * when the power is lost during @ref CopyPage, and erases the copy
+ *
+ * The records are copied in order, so the copy holds the first records of the original
+ * and the two hold the same records if only erasing the original was interrupted.
+ * Pages with the same sequence can also be left behind by other interruptions,
+ * those are kept unless one holds a prefix of the records of the other.
+ *
+ * Such pages are rare, so the pages are first filtered by a hash of their ID and
+ * sequence, and only the pages sharing the hash with another one are compared
+ */
+void Manager::ResolveCopies()
+{
+    constexpr unsigned Bits = 256;
+    uint32_t seen[Bits / 32] = {}, twice[Bits / 32] = {};
+    bool any = false;
+    auto hash = [](const Page& p) { uint32_t id = p.id; return (id ^ (id >> 16) ^ (p.sequence * 0x9E37u)) % Bits; };
+
+    for (auto& b: Blocks(blkFirst))
+    {
+        if (!b.IsValid())
+            continue;
+
+        for (auto& p: b)
+        {
+            NVRAM_STATS_ADD(*this, pagesScanned, 1);
+            if (!p.IsValid())
+                continue;
+
+            unsigned h = hash(p);
+            if (seen[h / 32] & (1u << h % 32))
+            {
+                twice[h / 32] |= (1u << h % 32);
+                any = true;
+            }
+            seen[h / 32] |= (1u << h % 32);
+        }
+    }
+
+    if (!any)
+    {
+        return;
+    }
+
+    for (auto& b: Blocks(blkFirst))
+    {
+        if (!b.IsValid())
+            continue;
+
+        for (auto& p: b)
+        {
+            if (!p.IsValid() || !(twice[hash(p) / 32] & (1u << hash(p) % 32)))
+                continue;
+
+            for (auto* b2 = &b; b2 < blkEnd && p.IsValid(); b2++)
+            {
+                if (!b2->IsValid())
+                    continue;
+
+                for (auto& p2: *b2)
+                {
+                    if (&p2 <= &p || !p.IsValid() || !p2.IsValid() || p2.id != p.id || p2.sequence != p.sequence)
+                        continue;
+
+                    // if the two hold the same records, either can be erased
+                    const Page* copy = IsCopyPrefix(&p2, &p) ? &p2 : IsCopyPrefix(&p, &p2) ? &p : NULL;
+                    if (!copy)
+                    {
+                        MYDBG("WARNING - Pages %.4s-%d @ %08X and %08X hold different records", &p.id, p.sequence, &p, &p2);
+                        continue;
+                    }
+
+                    MYDBG("WARNING - Erasing interrupted copy of page %.4s-%d @ %08X", &p.id, p.sequence, copy);
+                    ErasePage(copy);
+                }
+            }
+        }
+    }
+}
+
+#endif
+
+}
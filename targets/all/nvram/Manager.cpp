@@ -21,18 +21,10 @@ INIT_PRIORITY(-9100)
 Manager _manager;
 
 /*!
- * Scans the area reserved for NVRAM for existing Blocks,
- * fixes any problems that may have been created by an unexpected reset,
- * so that we can make some assumptions about the flash layout
- * and not bother with them when doing scans in the future
- *
- * All blocks can be assumed to be in one of three states after initialization is complete,
- * indicated by the first word
- * - valid (magic value)
- * - free (all ones)
- * - erasable (zero) - note that generation field should be still valid or zero
+ * Resolves and aligns the area reserved for NVRAM and resets the state of the manager,
+ * the flash itself is neither checked nor modified
  */
-bool Manager::Initialize(Span area, InitFlags flags)
+Span Manager::Mount(Span area)
 {
     if (!area)
     {
@@ -54,13 +46,66 @@ bool Manager::Initialize(Span area, InitFlags flags)
     // align to actual block boundaries
     blkStart = (const Block*)(((uintptr_t)area.begin() + ~BlockMask) & BlockMask);
     blkFirst = blkEnd = (const Block*)((uintptr_t)area.end() & BlockMask);
+#if NVRAM_MULTIPLE_MANAGERS
+    Attach();
+#endif
     pagesAvailable = 0;
+    pagesWanted = largeWanted = 0;
     collectors.Clear();
     notifiers.Clear();
+#if NVRAM_NOTIFY_DEFERRED
+    pendingCount = 0;
+    pendingOverflow = false;
+    notifying = false;
+#endif
+#if NVRAM_KEY_INDEX
+    indices = NULL;
+#endif
+    mountCount++;
     collecting = false;
-    int corrupted = 0;
+#if NVRAM_STATS
+    ResetStats();
+#endif
+#if NVRAM_FLASH_ASYNC_WRITE
+    relocateDeferrable = false;
+    relocateFrom = relocateTo = NULL;
+#endif
+#if NVRAM_WRITE_CURSORS
+    CursorReset();
+#endif
+#if NVRAM_PAGE_FILTERS
+    FilterReset();
+#endif
+#if NVRAM_MAX_BLOCKS
+    PoolReset();
+#endif
+#if NVRAM_FLASH_DOUBLE_WRITE
+    streamed = NULL;
+#endif
+#if NVRAM_LARGE_PAGES
+    evacuating = NULL;
+#endif
 
     ASSERT(blkStart < blkEnd);
+    return area;
+}
+
+/*!
+ * Scans the area reserved for NVRAM for existing Blocks,
+ * fixes any problems that may have been created by an unexpected reset,
+ * so that we can make some assumptions about the flash layout
+ * and not bother with them when doing scans in the future
+ *
+ * All blocks can be assumed to be in one of three states after initialization is complete,
+ * indicated by the first word
+ * - valid (magic value)
+ * - free (all ones)
+ * - erasable (zero) - note that generation field should be still valid or zero
+ */
+bool Manager::Initialize(Span area, InitFlags flags)
+{
+    area = Mount(area);
+    int corrupted = 0;
 
 #if TRACE && Tcortex_m
     if ((const char*)blkStart < &__data_load_end)
@@ -76,7 +121,15 @@ bool Manager::Initialize(Span area, InitFlags flags)
         Flash::Erase(area);
     }
 
-    for (auto* blk = blkEnd - 1; blk >= blkStart; blk--)
+#if NVRAM_CHECKPOINT
+    // a valid checkpoint describes all blocks and pages, the scans can be skipped entirely
+    bool restored = CheckpointRestore(flags);
+#else
+    bool restored = false;
+#endif
+    auto* scanEnd = restored ? blkStart : blkEnd;
+
+    for (auto* blk = scanEnd - 1; blk >= blkStart; blk--)
     {
         if (blk->magic == Block::Magic)
         {
@@ -92,6 +145,10 @@ bool Manager::Initialize(Span area, InitFlags flags)
                     if (blk->Format(1))
                     {
                         // success
+#if NVRAM_MAX_BLOCKS
+                        PoolMark(blkUnused, blk, true);
+#endif
+                        pagesAvailable += PagesPerBlock;
                         continue;
                     }
                 }
@@ -104,10 +161,15 @@ bool Manager::Initialize(Span area, InitFlags flags)
                 Flash::ShredWord(&blk->generation);
                 Flash::ShredWord(&blk->magic);
 #endif
+#if NVRAM_MAX_BLOCKS
+                PoolMark(blkErasable, blk, true);
+#endif
+                blocksToErase = true;
             }
             else
             {
                 // scan through pages to see if the block can be erased
+                NVRAM_STATS_ADD(*this, pagesScanned, PagesPerBlock);
                 auto res = blk->CheckPages();
                 if (res.flags == Block::PagesErasable)
                 {
@@ -118,6 +180,12 @@ bool Manager::Initialize(Span area, InitFlags flags)
                 else
                 {
                     pagesAvailable += res.freeCount;
+#if NVRAM_MAX_BLOCKS
+                    if (res.flags == Block::PagesFree)
+                    {
+                        PoolMark(blkUnused, blk, true);
+                    }
+#endif
                 }
             }
         }
@@ -125,11 +193,17 @@ bool Manager::Initialize(Span area, InitFlags flags)
         {
             // verified free block, add to free page pool
             pagesAvailable += PagesPerBlock;
+#if NVRAM_MAX_BLOCKS
+            PoolMark(blkUnused, blk, true);
+#endif
         }
         else if (blk->IsErasable())
         {
             // block is already scheduled for erase
             MYDBG("WARNING - Block marked for erase found after reset @ %08X", blk);
+#if NVRAM_MAX_BLOCKS
+            PoolMark(blkErasable, blk, true);
+#endif
             blocksToErase = true;
         }
         else if (!!(flags & InitFlags::IgnoreCorrupted))
@@ -145,11 +219,37 @@ bool Manager::Initialize(Span area, InitFlags flags)
 #else
             Flash::ShredWord(&blk->generation);
             Flash::ShredWord(&blk->magic);
+#endif
+#if NVRAM_MAX_BLOCKS
+            PoolMark(blkErasable, blk, true);
 #endif
             blocksToErase = true;
         }
     }
 
+    if (!restored)
+    {
+#if NVRAM_WEAR_LEVELING_SPREAD || NVRAM_LARGE_PAGES
+        ResolveCopies();
+#endif
+
+#if NVRAM_PAGE_DIRECTORY
+        DirectoryBuild();
+#endif
+
+#if NVRAM_FLASH_DOUBLE_WRITE && NVRAM_UNIQUE_KEY_PAGES
+        ResolveShreds();
+#endif
+    }
+
+#if NVRAM_TRANSACTIONS
+    if (&For(TransactionJournal) == this)
+    {
+        // targets of the transactions in other areas must be initialized before the journal
+        Transaction::Recover();
+    }
+#endif
+
     MYDBG("Init complete - %08X <= %08X <= %08X", blkStart, blkFirst, blkEnd);
     MYDBG("  %d/%d pages free (%d/%d bytes)", pagesAvailable, PagesPerBlock * (blkEnd - blkStart - corrupted),
         pagesAvailable * PagePayload, (PagesPerBlock * (blkEnd - blkStart - corrupted)) * PagePayload);
@@ -165,7 +265,7 @@ bool Manager::Initialize(Span area, InitFlags flags)
         MYDBG("There are blocks marked to be erased, running collector");
         RunCollector();
     }
-    else if (pagesAvailable < PagesKeptFree)
+    else if (!EnoughFree())
     {
         MYDBG("Not enough pages free, running collector");
         RunCollector();
@@ -174,8 +274,95 @@ bool Manager::Initialize(Span area, InitFlags flags)
     return true;
 }
 
+#if NVRAM_UNIQUE_KEY_PAGES
+
+bool Manager::UseUniqueKeys(ID id)
+{
+    for (auto& unique: uniqueKeyPages)
+    {
+        if (unique == id || !unique)
+        {
+            unique = id;
+            return true;
+        }
+    }
+
+    MYDBG("ERROR - Cannot mark %.4s as storing unique keys, increase NVRAM_UNIQUE_KEY_PAGES", &id);
+    return false;
+}
+
+bool Manager::UsesUniqueKeys(ID id) const
+{
+    for (auto unique: uniqueKeyPages)
+    {
+        if (unique == id)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+#endif
+
+#if NVRAM_FLASH_DOUBLE_WRITE && NVRAM_UNIQUE_KEY_PAGES
+
+/*!
+ * Records are moved in order and each original is shredded right after it is copied,
+ * so only the first remaining record of a page can be a partially shredded original
+ * (see @ref Page::IsShreddedCopy). Lookups of unique keys do not care about the age
+ * of the records and could find it instead of the complete copy.
+ */
+void Manager::ResolveShreds()
+{
+    for (auto& b: Blocks(blkFirst))
+    {
+        if (!b.IsValid())
+            continue;
+
+        for (auto& p: b)
+        {
+            if (!p.IsValid() || p.IsFixed())
+                continue;
+
+            Span rec = Page::FindForwardNextImpl(&p, NULL, 0, NULL);
+            if (rec && Page::IsShreddedCopy(rec))
+            {
+                MYDBG("WARNING - Shredding record left behind by interrupted move @ %08X", rec.Pointer());
+                Page::ShredRecord(rec.Pointer());
+            }
+        }
+    }
+}
+
+#endif
+
 const Block* Manager::NewBlock()
 {
+    CheckpointDrop();
+
+#if NVRAM_MAX_BLOCKS
+    if (!blkUntracked)
+    {
+        while (auto* blk = PoolFindEmpty())
+        {
+            if (blk->Format(1))
+            {
+                if (blkFirst > blk)
+                    blkFirst = blk;
+                return blk;
+            }
+
+            // the block cannot be used until it is erased
+            MYDBG("ERROR - Failed to format block @ %08X", blk);
+            PoolMark(blkUnused, blk, false);
+            EraseBlock(blk);
+        }
+
+        return NULL;
+    }
+#endif
+
     // we can use only empty blocks, erase is too time consuming to perform synchronously
     for (auto* blk = blkEnd - 1; blk >= blkStart; blk--)
     {
@@ -192,11 +379,37 @@ const Block* Manager::NewBlock()
 
 /*!
  * Allocates a new page with the specified ID
+ *
+ * If @p replaces is specified, the new page gets the same sequence number
+ * and is meant to hold a copy of the replaced page
  */
-const Page* Manager::NewPage(ID id, uint32_t recordSize)
+const Page* Manager::NewPage(ID id, uint32_t recordSize, const Page* replaces)
 {
+    CheckpointDrop();
+
     uint32_t seq = ~0u;
     const Page* free = NULL;
+    bool seqKnown = !!replaces;
+    // copies keep the geometry of the replaced page
+    bool large = replaces ? replaces->Block()->IsLarge() : UsesLargePages(id);
+#if NVRAM_WEAR_LEVELING
+    //! first free page of the preferred block by wear
+    const Page* unused = NULL;
+#endif
+
+#if NVRAM_PAGE_DIRECTORY
+    const Page* oldest;
+    const Page* newest;
+    if (!seqKnown && DirectoryRange(id, oldest, newest))
+    {
+        // the directory knows the sequence, we only need to find a free page
+        if (newest)
+        {
+            seq = newest->sequence;
+        }
+        seqKnown = true;
+    }
+#endif
 
     // find all required information (new sequence and placement) in a single pass
     for (auto& b: Blocks(blkFirst))
@@ -213,15 +426,51 @@ const Page* Manager::NewPage(ID id, uint32_t recordSize)
                     seq = p.sequence;
                 }
             }
-            else if (!free && p.IsEmpty())
+            else if (!free && p.IsEmpty() && FitsGeometry(&p, large))
             {
+#if NVRAM_WEAR_LEVELING
+                if (replaces)
+                {
+                    // copies of cold pages go to the most worn block with free pages
+                    if (!unused || b.generation > unused->Block()->generation)
+                    {
+                        unused = &p;
+                    }
+                    break;
+                }
+
+                if (&p == b.begin())
+                {
+                    // blocks are filled before moving on to unused ones, preferring the least worn
+                    if (!unused || b.generation < unused->Block()->generation)
+                    {
+                        unused = &p;
+                    }
+                    break;
+                }
+#endif
                 free = &p;
                 break;
             }
         }
+
+        if (seqKnown && free)
+            break;
     }
 
-    seq = seq == ~0u ? 1 : seq + 1;
+#if NVRAM_WEAR_LEVELING
+    if (!free)
+    {
+        free = unused;
+    }
+
+    if (replaces && !free)
+    {
+        return NULL;
+    }
+#endif
+
+    seq = replaces ? replaces->sequence : seq == ~0u ? 1 : seq + 1;
 
     uint32_t w0 = (seq & MASK(16)) | (recordSize << 16);
     for (;;)
@@ -240,7 +489,17 @@ const Page* Manager::NewPage(ID id, uint32_t recordSize)
             }
         }
 
+#if NVRAM_LARGE_PAGES
+        if (large && !free->Block()->IsLarge() && !free->Block()->FormatLarge())
+        {
+            // the block keeps holding regular pages, try another one
+            free = NULL;
+            continue;
+        }
+#endif
+
         // try to prepare a page
+        EraseSuspension suspend(free);
 #if NVRAM_FLASH_DOUBLE_WRITE
         if (Flash::WriteDouble((const uint32_t*)&free->id, id, w0))
 #else
@@ -248,16 +507,32 @@ const Page* Manager::NewPage(ID id, uint32_t recordSize)
             Flash::WriteWord((const uint32_t*)&free->id, id))
 #endif
         {
-            if (recordSize)
+            if (Page::IsFixedSize(recordSize))
             {
                 MYDBG("Allocated page %.4s-%d with fixed record size %u @ %08X", &id, seq, recordSize, free);
             }
             else
             {
-                MYDBG("Allocated page %.4s-%d with variable record size @ %08X", &id, seq, free);
+                MYDBG("Allocated page %.4s-%d with variable record size%s @ %08X", &id, seq, recordSize ? " and footers" : "", free);
             }
 
-            pagesAvailable--;
+            pagesAvailable -= free->Block()->PageUnits();
+
+#if NVRAM_MAX_BLOCKS
+            PoolMark(blkUnused, free->Block(), false);
+#endif
+#if NVRAM_PAGE_DIRECTORY
+            DirectoryInsert(free);
+#endif
+#if NVRAM_PAGE_FILTERS
+            FilterDrop(free);
+#endif
+#if NVRAM_WRITE_CURSORS
+            if (!replaces)
+            {
+                CursorSet(id, free, free->data + (free->IsFixed() ? 0 : 4));
+            }
+#endif
 
             // always run the collector after allocating a new page
             RunCollector();
@@ -267,9 +542,14 @@ const Page* Manager::NewPage(ID id, uint32_t recordSize)
 
         // mark the page as bad
         _ShredWordOrDouble(free);
+#if NVRAM_MAX_BLOCKS
+        PoolMark(blkUnused, free->Block(), false);
+#endif
         MYDBG("ERROR - Failed to format page %.4s-%d @ %08X", &id, seq, free);
 
-        for (free++; free != free->Block()->end(); free++)
+        // the block is remembered, the end of its pages can be the start of the next one
+        auto* blk = free->Block();
+        for (free++; free != blk->end(); free++)
         {
             if (free->IsEmpty())
                 break;
@@ -281,15 +561,19 @@ const Page* Manager::NewPage(ID id, uint32_t recordSize)
             }
         }
 
-        if (free == free->Block()->end())
+        if (free == blk->end())
         {
             // this block is full, we need a new one
+            auto* next = blk + 1;
             free = NULL;
-            for (auto& b : Blocks(Block::FromPtr(free) + 1))
+            for (auto& b : Blocks(next))
             {
                 if (!b.IsValid())
                     continue;
 
+                if (free)
+                    break;
+
                 for (auto& p: b)
                 {
                     if (p.id == ~0u)
@@ -298,9 +582,10 @@ const Page* Manager::NewPage(ID id, uint32_t recordSize)
                         {
                             // mark the page as bad
                             MYDBG("Marking corrupted page @ %08X", p);
+                            EraseSuspension suspend(&p);
                             _ShredWordOrDouble(&p);
                         }
-                        else
+                        else if (FitsGeometry(&p, large))
                         {
                             free = &p;
                             break;
@@ -311,6 +596,7 @@ const Page* Manager::NewPage(ID id, uint32_t recordSize)
         }
     }
 
+    NVRAM_STATS_ADD(*this, allocationFailures, 1);
     return NULL;
 }
 
@@ -338,6 +624,18 @@ void Manager::RegisterCollector(ID key, unsigned level, CollectorDelegate delega
     m.Insert({ key, level, delegate });
 }
 
+void Manager::UnregisterCollector(ID key, unsigned level)
+{
+    for (auto m = collectors.Manipulate(); m; ++m)
+    {
+        if (m.Element().key == key && m.Element().level == level)
+        {
+            m.Remove();
+            return;
+        }
+    }
+}
+
 void Manager::RunCollector()
 {
     if (!collecting)
@@ -357,12 +655,34 @@ async_def()
 async_end
 
 async(Manager::Collector)
+#if NVRAM_WEAR_LEVELING_SPREAD
+async_def(bool leveled)
+#else
 async_def()
+#endif
 {
     MYDBG("Collection starting with %d pages free", pagesAvailable);
+    NVRAM_STATS_ADD(*this, collectorRuns, 1);
+#if NVRAM_WEAR_LEVELING_SPREAD
+    f.leveled = false;
+#endif
 
     // always run a non-destructive collection
-    Collect(false);
+    while (Collect(false))
+    {
+#if NVRAM_FLASH_ASYNC_WRITE
+        if (relocateFrom)
+        {
+            await(Relocate);
+            continue;
+        }
+#endif
+        if (!SliceExpired())
+        {
+            break;
+        }
+        async_yield();
+    }
 
     for (;;)
     {
@@ -371,8 +691,15 @@ async_def()
            await(EraseBlocks);
         }
 
-        if (pagesAvailable >= PagesKeptFree)
+        if (EnoughFree())
         {
+#if NVRAM_WEAR_LEVELING_SPREAD
+            // level at most one block per collection, the next one will be considered after another allocation
+            if (!f.leveled && (f.leveled = LevelWear()))
+            {
+                continue;
+            }
+#endif
             MYDBG("Collection finished with %d pages free", pagesAvailable);
             break;
         }
@@ -384,8 +711,17 @@ async_def()
             MYDBG("Collection finished with only %d pages free", pagesAvailable);
             break;
         }
+
+#if NVRAM_FLASH_ASYNC_WRITE
+        if (relocateFrom)
+        {
+            await(Relocate);
+        }
+#endif
     }
 
+    // the requested pages are either available or cannot be made available
+    pagesWanted = largeWanted = 0;
     collecting = false;
 }
 async_end
@@ -393,6 +729,19 @@ async_end
 int Manager::Collect(bool destructive)
 {
     int collected = 0;
+#if NVRAM_COLLECTOR_BUDGET
+    sliceStart = MONO_CLOCKS;
+#endif
+#if NVRAM_LARGE_PAGES
+    if (destructive && !LargePageAvailable(largeWanted ? largeWanted : 1) && Evacuate())
+    {
+        // moving a few pages is preferred to discarding data when only a whole block is missing
+        return 1;
+    }
+#endif
+#if NVRAM_FLASH_ASYNC_WRITE
+    relocateDeferrable = true;
+#endif
 
     for (auto& collector: collectors)
     {
@@ -407,38 +756,180 @@ int Manager::Collect(bool destructive)
             MYDBG("Page %.4s-%d @ %08X can be erased", &page->id, page->sequence, page);
             ErasePage(page);
             collected++;
+            NVRAM_STATS_ADD(*this, collected[collector.level < 3 ? collector.level : 3], 1);
 
             if (collector.level)
             {
                 // do not run any more collectors above level 0 at once
                 break;
             }
+
+            if (SliceExpired())
+            {
+                // let other tasks run, the collector task will call us again
+                MYDBG("Collection slice expired after %d pages", collected);
+#if NVRAM_FLASH_ASYNC_WRITE
+                relocateDeferrable = false;
+#endif
+                return collected;
+            }
         }
+
+#if NVRAM_FLASH_ASYNC_WRITE
+        if (relocateFrom)
+        {
+            // the page will be erased by the collector task after moving the records
+            collected++;
+            break;
+        }
+#endif
     }
 
+#if NVRAM_FLASH_ASYNC_WRITE
+    relocateDeferrable = false;
+#endif
     return collected;
 }
 
+#if NVRAM_FLASH_ASYNC_WRITE
+
+bool Manager::DeferRelocation(const Page* from, const Page* to)
+{
+    if (!relocateDeferrable || relocateFrom)
+    {
+        return false;
+    }
+
+    relocateFrom = from;
+    relocateTo = to;
+    return true;
+}
+
+async(Manager::Relocate)
+async_def()
+{
+    MYDBG("Relocating records from page %.4s-%d @ %08X", &relocateFrom->id, relocateFrom->sequence, relocateFrom);
+
+    if (await(Page::MoveRecordsAsync, relocateFrom, relocateTo))
+    {
+        ErasePage(relocateFrom);
+    }
+
+    relocateFrom = relocateTo = NULL;
+}
+async_end
+
+#endif
+
+#if NVRAM_FLASH_ERASE_BANKS > 1
+
 async(Manager::EraseBlocks)
-async_def(const Block* block; uint32_t gen)
+async_def(
+    const Block* scan[NVRAM_FLASH_ERASE_BANKS];
+    const Block* erasing[NVRAM_FLASH_ERASE_BANKS];
+    uint32_t gen[NVRAM_FLASH_ERASE_BANKS];
+    unsigned bank;
+    unsigned active;
+    bool pending;
+    bool stalled;
+)
 {
-    for (f.block = blkStart; f.block != blkEnd; f.block++)
+    // each bank walks the blocks independently, so that erases in different banks overlap;
+    // writes issued meanwhile suspend the erase running in their bank (see @ref EraseSuspension)
+    for (f.bank = 0; f.bank < NVRAM_FLASH_ERASE_BANKS; f.bank++)
     {
-        if (f.block->IsErasable())
+        f.scan[f.bank] = blkStart;
+        f.erasing[f.bank] = NULL;
+    }
+    f.stalled = false;
+
+    for (;;)
+    {
+        f.active = 0;
+        for (f.bank = 0; f.bank < NVRAM_FLASH_ERASE_BANKS; f.bank++)
         {
-#if NVRAM_FLASH_DOUBLE_WRITE
-            if (BlockPadding)
+            if (!f.erasing[f.bank])
             {
-                auto pb = (const Block*)f.block->padding;
-                f.gen = pb->magic == Block::Magic ? pb->generation : 0;
+                for (auto& b = f.scan[f.bank]; b != blkEnd; b++)
+                {
+                    if (Flash::EraseBank(b) == f.bank && IsBlockErasable(b))
+                    {
+                        CheckpointDrop();
+                        f.gen[f.bank] = ErasedGeneration(b);
+                        MYDBG("Starting erase of block @ %08X in bank %d", b, f.bank);
+                        if (Flash::EraseStart(b))
+                        {
+                            f.erasing[f.bank] = b++;
+                        }
+                        // otherwise try the same block again when another erase completes
+                        break;
+                    }
+                }
             }
-            else
+
+            if (f.erasing[f.bank])
+            {
+                f.active++;
+            }
+        }
+
+        if (!f.active)
+        {
+            f.pending = false;
+            for (f.bank = 0; f.bank < NVRAM_FLASH_ERASE_BANKS; f.bank++)
+            {
+                f.pending = f.pending || f.scan[f.bank] != blkEnd;
+            }
+            if (!f.pending)
+            {
+                break;
+            }
+
+            if (f.stalled)
+            {
+                // give up instead of spinning, the remaining blocks are erased
+                // the next time a block is marked for erasure
+                MYDBG("No flash bank available for erasing");
+                break;
+            }
+
+            // no erase could be started, the banks are busy with erases started elsewhere,
+            // wait for one of them to complete and try once more
+            f.stalled = true;
+            await(Flash::EraseWaitAsync);
+            continue;
+        }
+
+        f.stalled = false;
+        await(Flash::EraseWaitAsync);
+
+        for (f.bank = 0; f.bank < NVRAM_FLASH_ERASE_BANKS; f.bank++)
+        {
+            if (f.erasing[f.bank] && Flash::EraseDone(f.erasing[f.bank]))
             {
-                f.gen = 0;
+                EraseFinish(f.erasing[f.bank], f.gen[f.bank]);
+                f.erasing[f.bank] = NULL;
             }
+        }
+    }
+
+    // do not attempt another erase even if some blocks failed
+    // to avoid trying in an infinite loop
+    blocksToErase = false;
+}
+async_end
+
 #else
-            f.gen = f.block->generation;
-#endif
+
+async(Manager::EraseBlocks)
+async_def(const Block* block; uint32_t gen)
+{
+    for (f.block = blkStart; f.block != blkEnd; f.block++)
+    {
+        if (IsBlockErasable(f.block))
+        {
+            CheckpointDrop();
+            f.gen = ErasedGeneration(f.block);
 
             for (;;)
             {
@@ -450,23 +941,7 @@ async_def(const Block* block; uint32_t gen)
                 MYDBG("Erase of block interrupted @ %08X", f.block);
             }
 
-            if (!f.block->CheckEmpty())
-            {
-                MYDBG("ERROR - block not completely erased @ %08X");
-            }
-            else if (!f.gen || f.block->Format(f.gen + 1))  // no reason to format gen 1 blocks
-            {
-                pagesAvailable += PagesPerBlock;
-                continue;
-            }
-
-            // something has gone wrong, mark block for another erasure attempt
-#if NVRAM_FLASH_DOUBLE_WRITE
-            Flash::ShredDouble(&f.block->magic);
-#else
-            Flash::ShredWord(&f.block->generation);
-            Flash::ShredWord(&f.block->magic);
-#endif
+            EraseFinish(f.block, f.gen);
         }
     }
 
@@ -476,6 +951,54 @@ async_def(const Block* block; uint32_t gen)
 }
 async_end
 
+#endif
+
+uint32_t Manager::ErasedGeneration(const Block* block) const
+{
+#if NVRAM_FLASH_DOUBLE_WRITE
+    if (BlockPadding)
+    {
+        auto pb = (const Block*)block->padding;
+        return pb->magic == Block::Magic ? pb->generation : 0;
+    }
+    return 0;
+#else
+    return block->generation;
+#endif
+}
+
+void Manager::EraseFinish(const Block* block, uint32_t gen)
+{
+    if (!block->CheckEmpty())
+    {
+        MYDBG("ERROR - block not completely erased @ %08X", block);
+    }
+    else if (!gen || block->Format(gen + 1))  // no reason to format gen 1 blocks
+    {
+        NVRAM_STATS_ADD(*this, erases, 1);
+        pagesAvailable += PagesPerBlock;
+        if (gen && blkFirst > block)
+        {
+            // the block was not formatted when mounted, the page search must not skip it
+            blkFirst = block;
+        }
+#if NVRAM_MAX_BLOCKS
+        PoolMark(blkErasable, block, false);
+        PoolMark(blkUnused, block, true);
+#endif
+        return;
+    }
+
+    // something has gone wrong, mark block for another erasure attempt
+    NVRAM_STATS_ADD(*this, eraseFailures, 1);
+#if NVRAM_FLASH_DOUBLE_WRITE
+    Flash::ShredDouble(&block->magic);
+#else
+    Flash::ShredWord(&block->generation);
+    Flash::ShredWord(&block->magic);
+#endif
+}
+
 const Page* CollectorDiscardOldest(void* arg0, ID id)
 {
     return Page::OldestFirst(id);
@@ -498,7 +1021,18 @@ const Page* CollectorRelocate(void* arg0, ID id)
         // try to move records - never move more than half of a page's
         // usable payload to avoid moving that actually just
         // copy the entire old page to the new one
-        if (oldest->MoveRecords(newest, PagePayload / 2))
+#if NVRAM_FLASH_ASYNC_WRITE
+        if (!oldest->CanMoveRecords(newest, oldest->Payload() / 2))
+        {
+            continue;
+        }
+        if (Manager::For(id).DeferRelocation(oldest, newest))
+        {
+            // the collector task moves the records without blocking and erases the page afterwards
+            return NULL;
+        }
+#endif
+        if (oldest->MoveRecords(newest, oldest->Payload() / 2))
         {
             return oldest;
         }
@@ -507,6 +1041,69 @@ const Page* CollectorRelocate(void* arg0, ID id)
     return NULL;
 }
 
+const Page* CollectorRelocateCostBenefit(void* arg0, ID id)
+{
+    const Page* newest = Page::NewestFirst(id);
+    if (!newest)
+    {
+        return NULL;
+    }
+
+    // the same limit as in CollectorRelocate applies
+    uint32_t space = newest->UnusedBytes();
+    if (space > newest->Payload() / 2)
+    {
+        space = newest->Payload() / 2;
+    }
+
+    const Page* best = NULL;
+    uint32_t bestLive = 0, bestAge = 0;
+
+    for (auto p = Page::First(id); p; p = p->Next())
+    {
+        if (p == newest)
+        {
+            continue;
+        }
+
+        uint32_t live = p->UsedBytes();
+        if (!live)
+        {
+            // nothing to copy, the page can be erased right away
+            return p;
+        }
+
+        if (live > space)
+        {
+            continue;
+        }
+
+        // benefit is the reclaimed space weighted by age (older data is less likely
+        // to be overwritten soon), cost is the amount of live data to be copied,
+        // compare (reclaim * age / live) ratios without division
+        uint32_t age = uint16_t(newest->Sequence() - p->Sequence());
+        if (!best || uint64_t(p->Payload() - live) * age * bestLive > uint64_t(best->Payload() - bestLive) * bestAge * live)
+        {
+            best = p;
+            bestLive = live;
+            bestAge = age;
+        }
+    }
+
+#if NVRAM_FLASH_ASYNC_WRITE
+    if (best && best->CanMoveRecords(newest, best->Payload() / 2) && Manager::For(id).DeferRelocation(best, newest))
+    {
+        return NULL;
+    }
+#endif
+    if (best && best->MoveRecords(newest, best->Payload() / 2))
+    {
+        return best;
+    }
+
+    return NULL;
+}
+
 const Page* CollectorCleanup(void* arg0, ID id)
 {
     const Page* newest;
@@ -525,6 +1122,27 @@ const Page* CollectorCleanup(void* arg0, ID id)
     return NULL;
 }
 
+const Page* CollectorMerge(void* arg0, ID id)
+{
+    // pages emptied by deleting records need no merging
+    if (auto page = CollectorCleanup(arg0, id))
+    {
+        return page;
+    }
+
+    return Page::MergeRecords(id, Manager::For(id).UsesUniqueKeys(id));
+}
+
+const Page* CollectorMergeUnique(void* arg0, ID id)
+{
+    if (auto page = CollectorCleanup(arg0, id))
+    {
+        return page;
+    }
+
+    return Page::MergeRecords(id, true);
+}
+
 static void IncrementVersion(unsigned* pVersion, ID pageType)
 {
     (*pVersion)++;
@@ -533,24 +1151,71 @@ static void IncrementVersion(unsigned* pVersion, ID pageType)
 void Manager::RegisterVersionTracker(ID pageType, unsigned* pVersion)
 {
     *pVersion = 1;
-    RegisterNotifier(pageType, GetDelegate(&IncrementVersion, pVersion));
+    // versions must be current as soon as the change is complete
+    AddNotifier({ pageType, false, true, GetDelegate(&IncrementVersion, pVersion), {} });
+}
+
+void Manager::AddNotifier(const PageNotifier& notifier)
+{
+    auto m = notifiers.Manipulate();
+
+    // insert before the existing notifiers for the same page type, so the newest ones are invoked first
+    while (m && m.Element().key < notifier.key)
+    {
+        ++m;
+    }
+
+    m.Insert(notifier);
+}
+
+void Manager::Notify(ID id, uint32_t key)
+{
+#if NVRAM_NOTIFY_DEFERRED
+    if (InvokeNotifiers(id, key, true, false))
+    {
+        // the rest is left to the notification task
+        NotifyDefer(id, key);
+    }
+#else
+    InvokeNotifiers(id, key, true, true);
+#endif
 }
 
-void Manager::Notify(ID id)
+bool Manager::InvokeNotifiers(ID id, uint32_t key, bool immediate, bool deferred)
 {
+    bool skipped = false;
+
     for (auto& notifier : notifiers)
     {
-        if (notifier.key == id)
+        if (notifier.key < id)
         {
-            notifier.notifier(id);
+            continue;
+        }
+        else if (notifier.key != id)
+        {
+            // past the notifiers for the page type
+            break;
+        }
+        else if (!(notifier.immediate ? immediate : deferred))
+        {
+            skipped = true;
+        }
+        else
+        {
+            notifier(id, key);
         }
     }
+
+    return skipped;
 }
 
 size_t Manager::EraseAll(ID id)
 {
     size_t count = 0;
-    for (auto page = Page::First(id); page; page = Page::FastEnum(page->Block(), page + 1, id))
+    // enumerate the page headers directly, pages are removed from the directory while erasing
+    auto blk = UsedBlocks().begin();
+    auto first = blk == UsedBlocks().end() ? NULL : Page::FastEnum(blk, blk->begin(), id);
+    for (auto page = first; page; page = Page::FastEnum(page->Block(), page + 1, id))
     {
         ErasePage(page);
         count++;
@@ -566,6 +1231,20 @@ size_t Manager::EraseAll(ID id)
 
 void Manager::ErasePage(const Page* page)
 {
+    CheckpointDrop();
+
+#if NVRAM_PAGE_DIRECTORY
+    DirectoryRemove(page);
+#endif
+#if NVRAM_WRITE_CURSORS
+    CursorDrop(page);
+#endif
+#if NVRAM_PAGE_FILTERS
+    FilterDrop(page);
+#endif
+    IndexErase(page);
+
+    EraseSuspension suspend(page);
     _ShredWordOrDouble(&page->id);
 
     // mark the entire block erasable if it contains only erasable pages
@@ -578,6 +1257,9 @@ void Manager::ErasePage(const Page* page)
 
 void Manager::EraseBlock(const Block* block)
 {
+    CheckpointDrop();
+    EraseSuspension suspend(block);
+
 #if NVRAM_FLASH_DOUBLE_WRITE
     if (BlockPadding)
     {
@@ -591,8 +1273,87 @@ void Manager::EraseBlock(const Block* block)
     Flash::ShredDouble(&block->magic);
 #else
     Flash::ShredWord(&block->magic);
+#endif
+#if NVRAM_MAX_BLOCKS
+    PoolMark(blkErasable, block, true);
 #endif
     blocksToErase = true;
 }
 
+bool Manager::EnoughFree() const
+{
+#if NVRAM_MAX_BLOCKS
+    if (BlocksKeptFree && !blkUntracked && PoolUnusedCount() < BlocksKeptFree)
+    {
+        return false;
+    }
+#endif
+    if ((pagesWanted || largeWanted) && !CanAllocate(pagesWanted, largeWanted))
+    {
+        // pages requested using Reserve come first
+        return false;
+    }
+#if NVRAM_LARGE_PAGES
+    if (!LargePageAvailable())
+    {
+        return false;
+    }
+
+    if (largePages[0])
+    {
+        // allocating the large page must not take the pages kept free for the others
+        return pagesAvailable >= PagesKeptFree + PagesPerBlock;
+    }
+#endif
+    return pagesAvailable >= PagesKeptFree;
+}
+
+bool Manager::CanAllocate(unsigned pages, unsigned large) const
+{
+#if NVRAM_LARGE_PAGES
+    if (large && largePages[0])
+    {
+        if (!LargePageAvailable(large))
+        {
+            return false;
+        }
+
+        // the large pages take the free pages of whole blocks
+        pages += large * PagesPerBlock;
+    }
+#else
+    pages += large;
+#endif
+    return pagesAvailable >= pages;
+}
+
+/*!
+ * The request is kept only until the collector finishes, the caller has to retry
+ * the allocation (and reserve the pages again if it fails) afterwards
+ */
+bool Manager::Reserve(unsigned pages, unsigned large)
+{
+    if (CanAllocate(pages, large))
+    {
+        return true;
+    }
+
+    MYDBG("Cannot allocate %d pages and %d large pages, running collector", pages, large);
+    pagesWanted = pages;
+    largeWanted = large;
+    RunCollector();
+    return false;
+}
+
+bool Manager::IsBlockErasable(const Block* block) const
+{
+#if NVRAM_MAX_BLOCKS
+    if (!blkUntracked)
+    {
+        return PoolTest(blkErasable, block);
+    }
+#endif
+    return block->IsErasable();
+}
+
 }
@@ -10,6 +10,8 @@
 
 #include <kernel/kernel.h>
 
+#include <nvram/Layout.h>
+
 #include <collections/ArrayIterator.h>
 #include <collections/LinkedList.h>
 
@@ -18,9 +20,12 @@ namespace nvram
 
 class Page;
 class Block;
+class KeyIndex;
 
 using CollectorDelegate = Delegate<const Page*, ID>;
 using NotifierDelegate = Delegate<void, ID>;
+//! Notifier receiving the key (first word) of the changed record, zero if multiple records may have changed
+using KeyNotifierDelegate = Delegate<void, ID, uint32_t>;
 
 //! NVRAM initialization flags
 enum struct InitFlags
@@ -32,8 +37,40 @@ enum struct InitFlags
 
 DEFINE_FLAG_ENUM(InitFlags);
 
+#if NVRAM_STATS
+//! Adds @p n to the specified counter in the statistics of the @p manager
+#define NVRAM_STATS_ADD(manager, counter, n)   ((manager).stats.counter += (n))
+#else
+//! Statistics are not collected, the arguments are not even evaluated
+#define NVRAM_STATS_ADD(manager, counter, n)   ((void)0)
+#endif
+
 class Manager
 {
+public:
+#if NVRAM_STATS
+    //! Counters of the work performed by the manager since initialization
+    struct Statistics
+    {
+        uint32_t lookups;           //< searches started for records (first or next)
+        uint32_t pagesScanned;      //< pages visited by the searches, other record traversals and initialization scans
+        uint32_t recordsWalked;     //< record headers examined by the searches and other record traversals
+        uint32_t recordsWritten;    //< records written successfully, including moved ones
+        uint32_t recordBytes;       //< space taken by the written records, including headers and padding
+        uint32_t writeFailures;     //< failed attempts to write a record, each followed by a retry further on the page
+        uint32_t updatedInPlace;    //< replaced records reprogrammed in place instead of writing new ones
+        uint32_t recordShreds;      //< records shredded (deleted, replaced, moved, aborted or failed)
+        uint32_t erases;            //< blocks erased and formatted successfully
+        uint32_t eraseFailures;     //< blocks that were not erased completely and must be erased again
+        uint32_t collectorRuns;     //< executions of the collector task
+        uint32_t collected[4];      //< pages released by the collectors, by level (the last one includes all higher levels)
+        uint32_t relocatedRecords;  //< records moved to another page by the collectors
+        uint32_t relocatedBytes;    //< length of the records moved to another page
+        uint32_t allocationFailures; //< new pages requested when none were available
+        uint32_t allocationStalls;  //< writers waiting for the collector to make pages available
+    };
+#endif
+
 private:
     struct PageCollector
     {
@@ -45,9 +82,31 @@ private:
     struct PageNotifier
     {
         ID key;
+        bool keyed;             //< @ref keyNotifier is used instead of @ref notifier
+        bool immediate;         //< always invoked during the change, even with deferred notifications
         NotifierDelegate notifier;
+        KeyNotifierDelegate keyNotifier;
+
+        void operator()(ID id, uint32_t changedKey) const { if (keyed) keyNotifier(id, changedKey); else notifier(id); }
     };
 
+#if NVRAM_NOTIFY_DEFERRED
+    struct PendingNotification
+    {
+        ID id;                  //< page type that has changed
+        uint32_t key;           //< key of the changed records, zero if there were multiple
+    };
+#endif
+
+#if NVRAM_WRITE_CURSORS
+    struct WriteCursor
+    {
+        ID id;                  //< page type, zero if the cursor is not used
+        const Page* page;       //< newest page of the type
+        const uint8_t* free;    //< expected start of free space on the page
+    };
+#endif
+
     //! Start of the area reserved for NVRAM
     const Block* blkStart;
     //! End of the area reserved for NVRAM (not a valid block)
@@ -56,30 +115,193 @@ private:
     const Block* blkFirst;
     //! Count of pages available for allocation
     unsigned pagesAvailable;
+    //! Regular and large pages requested using @ref Reserve that the collector has to make available
+    unsigned pagesWanted, largeWanted;
     //! If the collector is currently running
     bool collecting;
     //! If there are blocks to be erased
     bool blocksToErase;
     //! List of collectors for various page types
     LinkedList<PageCollector> collectors;
-    //! List of notifiers for various page types
+    //! List of notifiers for various page types, ordered by page type so that only the matching ones are walked
     LinkedList<PageNotifier> notifiers;
+#if NVRAM_KEY_INDEX
+    //! Key indices registered since the last initialization
+    KeyIndex* indices;
+#endif
+    //! Incremented on each initialization
+    unsigned mountCount;
+#if NVRAM_PAGE_DIRECTORY
+    //! Directory of valid pages, grouped by ID and ordered from oldest to newest within each group
+    const Page* dir[NVRAM_PAGE_DIRECTORY];
+    //! Number of pages in the directory
+    unsigned dirCount;
+    //! Set if the directory could not hold all pages and cannot be used until the next initialization
+    bool dirOverflow;
+#endif
+#if NVRAM_MAX_BLOCKS
+    //! Bitmap of blocks without any allocated pages, either empty or formatted with all pages free
+    uint32_t blkUnused[(NVRAM_MAX_BLOCKS + 31) / 32];
+    //! Bitmap of blocks marked for erasure
+    uint32_t blkErasable[(NVRAM_MAX_BLOCKS + 31) / 32];
+    //! Set if there are more blocks than can be tracked and the bitmaps cannot be used until the next initialization
+    bool blkUntracked;
+#endif
+#if NVRAM_PAGE_FILTERS
+    struct PageFilter
+    {
+        const Page* page;       //< page summarized by the filter, NULL if the filter is not used
+        const uint8_t* end;     //< position up to which the records are included in the filter
+        uint32_t bits[8];       //< bitset of hashed first words of the records
+    };
+#endif
+
+#if NVRAM_CHECKPOINT
+    //! Checkpoint record matching the current state, NULL if the state has changed since it was written
+    const void* checkpoint;
+#endif
+#if NVRAM_COLLECTOR_BUDGET
+    //! Time when the current collection slice started, collectors yield after NVRAM_COLLECTOR_BUDGET milliseconds
+    mono_t sliceStart;
+#endif
+#if NVRAM_PAGE_FILTERS
+    //! Summaries of keys on recently searched pages, direct-mapped by page index
+    PageFilter filters[NVRAM_PAGE_FILTERS];
+#endif
+#if NVRAM_FLASH_ASYNC_WRITE
+    //! Set while the collector task executes the collectors, so relocations can be deferred to it
+    bool relocateDeferrable;
+    //! Page with records to be moved by the collector task using asynchronous writes, NULL if there is none
+    const Page* relocateFrom;
+    //! Page receiving the records moved by the collector task
+    const Page* relocateTo;
+#endif
+#if NVRAM_FLASH_DOUBLE_WRITE
+    //! Record reserved by @ref RecordWriter that is not complete yet, nothing is written before it is
+    //! committed, so no other records may be written on its page in the meantime
+    const uint8_t* streamed;
+#endif
+#if NVRAM_MULTIPLE_MANAGERS
+    //! Page types stored by this manager instead of the default one
+    LinkedList<ID> routes;
+    //! Next initialized manager other than the default one
+    Manager* nextInstance;
+    //! List of initialized managers other than the default one
+    static Manager* instances;
+#endif
+#if NVRAM_LARGE_PAGES
+    //! Page types allocating large pages spanning whole blocks, unused entries are zero
+    ID largePages[NVRAM_LARGE_PAGES];
+    //! Block whose pages are being moved by @ref Evacuate, no new pages are allocated in it
+    const Block* evacuating;
+#endif
+#if NVRAM_NOTIFY_DEFERRED
+    //! Coalesced changes waiting for the notification task
+    PendingNotification pending[NVRAM_NOTIFY_DEFERRED];
+    //! Number of used entries in @ref pending
+    unsigned pendingCount;
+    //! Set if more page types have changed than @ref pending can hold, all notifiers are invoked then
+    bool pendingOverflow;
+    //! If the notification task is scheduled or running
+    bool notifying;
+#endif
+#if NVRAM_STATS
+    //! Counters updated using @ref NVRAM_STATS_ADD
+    Statistics stats;
+#endif
+#if NVRAM_WRITE_CURSORS
+    //! Cached locations of free space on the newest pages of recently written page types
+    WriteCursor cursors[NVRAM_WRITE_CURSORS];
+    //! Index of the cursor to be replaced next when a new page type is written
+    unsigned cursorReplace;
+#endif
+#if NVRAM_UNIQUE_KEY_PAGES
+    //! Page types storing at most one record per key, unused entries are zero
+    ID uniqueKeyPages[NVRAM_UNIQUE_KEY_PAGES];
+#endif
 
 public:
+#if NVRAM_MULTIPLE_MANAGERS
+    //! Detaches the manager from page type routing
+    ~Manager();
+#endif
+
     //! Sets up the area reserved for NVRAM
     bool Initialize(Span area, InitFlags flags);
+    //! Attaches the manager to the area without checking or repairing it, so that its contents
+    //! can be examined as they are (e.g. by offline tools), nothing should be written afterwards
+    //! @returns the area actually used, before aligning to block boundaries
+    Span Mount(Span area);
+#if NVRAM_UNIQUE_KEY_PAGES
+    //! Marks the page type as storing at most one record per key (e.g. @ref VariableUniqueKeyStorage),
+    //! so that a record left behind by moving records interrupted by reset can be removed when initializing
+    //! and @ref CollectorMerge drops the superseded records, the setting is kept when the manager is reinitialized and must be made before initialization
+    //! @returns false if more than NVRAM_UNIQUE_KEY_PAGES page types would be marked
+    bool UseUniqueKeys(ID id);
+    //! Determines if the page type stores at most one record per key
+    bool UsesUniqueKeys(ID id) const;
+#else
+    //! Determines if the page type stores at most one record per key
+    constexpr bool UsesUniqueKeys(ID id) const { return false; }
+#endif
+#if NVRAM_MULTIPLE_MANAGERS
+    //! Stores the specified page type using this manager instead of the default one
+    //! Routes are kept when the manager is reinitialized and should be set before the page type is first used
+    void Route(ID id) { routes.Push(id); }
+    //! Returns the manager storing the specified page type
+    static Manager& For(ID id);
+    //! Returns the manager of the area containing the specified location
+    static Manager& Containing(const void* ptr);
+#else
+    //! Returns the manager storing the specified page type
+    static constexpr Manager& For(ID id);
+    //! Returns the manager of the area containing the specified location
+    static constexpr Manager& Containing(const void* ptr);
+#endif
+#if NVRAM_LARGE_PAGES
+    //! Allocates new pages of the specified page type spanning whole blocks instead of regular pages,
+    //! which reduces the overhead of page headers and the number of pages scanned for high volume data,
+    //! the setting is kept when the manager is reinitialized and applies only to pages allocated afterwards
+    //! @returns false if more than NVRAM_LARGE_PAGES page types would use large pages
+    bool UseLargePages(ID id);
+    //! Determines if new pages of the specified page type span whole blocks
+    bool UsesLargePages(ID id) const;
+#else
+    //! Determines if new pages of the specified page type span whole blocks
+    constexpr bool UsesLargePages(ID id) const { return false; }
+#endif
     //! Registers a collector with the specified key (usually page type), at the specified level
     void RegisterCollector(ID key, unsigned level, CollectorDelegate collector);
+    //! Removes the collector registered with the specified key at the specified level
+    void UnregisterCollector(ID key, unsigned level);
     //! Registers a change notifier for the specified page type
-    void RegisterNotifier(ID type, NotifierDelegate notifier) { notifiers.Push({ type, notifier }); }
+    void RegisterNotifier(ID type, NotifierDelegate notifier) { AddNotifier({ type, false, false, notifier, {} }); }
+    //! Registers a change notifier for the specified page type, receiving the key of the changed records
+    void RegisterKeyNotifier(ID type, KeyNotifierDelegate notifier) { AddNotifier({ type, true, false, {}, notifier }); }
     //! Registers a version number trackker for the specified page type
     void RegisterVersionTracker(ID type, unsigned* pVersion);
     //! Runs the collector process if it is not already running
     void RunCollector();
     //! Triggers a collection and waits for it to complete
     async(Collect);
-    //! Notifies that the contents of the specified page type have changed
-    void Notify(ID id);
+    //! Notifies that the records with the specified key (first word) have changed,
+    //! zero if multiple records of the page type may have changed
+    void Notify(ID id, uint32_t key = 0);
+#if NVRAM_CHECKPOINT
+    //! Stores the state of all blocks, allowing the next initialization to skip the full scan
+    bool Checkpoint();
+#endif
+#if NVRAM_FLASH_ASYNC_WRITE
+    //! Requests the records to be moved by the collector task without blocking, the old page is erased when done
+    //! @returns false if the relocation cannot be deferred and must be performed immediately
+    bool DeferRelocation(const Page* from, const Page* to);
+#endif
+#if NVRAM_STATS
+    //! Returns the counters of the work performed since initialization or the last @ref ResetStats
+    const Statistics& Stats() const { return stats; }
+    //! Clears all the counters
+    void ResetStats() { stats = {}; }
+#endif
 
     //! Iterates over all the blocks starting at the specified @ref Block
     //! Invalid blocks in between are returned, make sure to use @ref IsValid before accessing the contents
@@ -93,11 +315,16 @@ public:
 
     //! Returns the number of pages available for allocation
     constexpr size_t PagesAvailable() const { return pagesAvailable; }
+    //! Determines if the specified numbers of regular and large pages can be allocated right away
+    bool CanAllocate(unsigned pages, unsigned large = 0) const;
+    //! Same as @ref CanAllocate, but if the pages cannot be allocated, the collector is started
+    //! to make them available, so that the allocation can be retried once it finishes
+    bool Reserve(unsigned pages, unsigned large = 0);
 
     //! Returns a newly formatted NVRAM block, or NULL if no free space found
     const Block* NewBlock();
     //! Returns a newly formatted NVRAM page, or NULL if no free space found
-    const Page* NewPage(ID id, uint32_t recordSize);
+    const Page* NewPage(ID id, uint32_t recordSize) { return NewPage(id, recordSize, NULL); }
     //! Erases all NVRAM pages with the specified ID
     size_t EraseAll(ID id);
 
@@ -106,23 +333,200 @@ private:
     async(Collector);
     //! Executes collectors until at least one page is collected
     int Collect(bool destructive);
+#if NVRAM_COLLECTOR_BUDGET
+    //! Determines if the current collection slice has used up its time budget
+    bool SliceExpired() const { return MONO_CLOCKS - sliceStart >= MonoFromMilliseconds(NVRAM_COLLECTOR_BUDGET); }
+#else
+    //! Collection is never interrupted without a time budget
+    constexpr bool SliceExpired() const { return false; }
+#endif
+#if NVRAM_MULTIPLE_MANAGERS
+    //! Adds the manager to the list of instances used for routing, unless it is the default one
+    void Attach();
+#endif
+    //! Inserts the notifier next to the other notifiers for the same page type
+    void AddNotifier(const PageNotifier& notifier);
+    //! Invokes the @ref PageNotifier::immediate notifiers for the page type if @p immediate is set, the others if @p deferred is set
+    //! @returns true if there are notifiers that were skipped
+    bool InvokeNotifiers(ID id, uint32_t key, bool immediate, bool deferred);
+#if NVRAM_NOTIFY_DEFERRED
+    //! Queues the change for the notification task, coalescing it with a pending change of the same page type
+    void NotifyDefer(ID id, uint32_t key);
+    //! Delivers the pending notifications
+    async(NotifyDispatch);
+#endif
     //! Erases all blocks that are marked
     async(EraseBlocks);
+    //! Returns the generation of a block marked for erasure, to be restored after it is erased
+    uint32_t ErasedGeneration(const Block* block) const;
+    //! Formats a block that has been erased, or marks it for another erasure if the erase failed
+    void EraseFinish(const Block* block, uint32_t gen);
+#if NVRAM_FLASH_ASYNC_WRITE
+    //! Moves the records of the page requested by @ref DeferRelocation and erases it
+    async(Relocate);
+#endif
     //! Marks a page (and, if possible, the block that holds it) for erasure
     void ErasePage(const Page* page);
     //! Marks a block for erasure
     void EraseBlock(const Block* block);
+    //! Returns a newly formatted NVRAM page, optionally meant to replace an existing one, or NULL if no free space found
+    const Page* NewPage(ID id, uint32_t recordSize, const Page* replaces);
+#if NVRAM_CHECKPOINT
+    struct CheckpointRecord;
+    //! Restores the state from a valid checkpoint, if there is one
+    bool CheckpointRestore(InitFlags flags);
+    //! Invalidates the current checkpoint before the state is changed
+    void CheckpointDrop();
+#else
+    void CheckpointDrop() {}
+#endif
+#if NVRAM_WEAR_LEVELING_SPREAD
+    //! Moves pages out of the least worn block if it holds cold data and the wear difference is too large
+    //! @returns true if the pages have been moved
+    bool LevelWear();
+#endif
+#if NVRAM_WEAR_LEVELING_SPREAD || NVRAM_LARGE_PAGES
+    //! Replaces a page with a copy in a different location
+    bool CopyPage(const Page* page);
+    //! Erases the incomplete page left behind by a copy interrupted by reset
+    void ResolveCopies();
+    //! Determines if the records of @p copy are the first records of @p page
+    static bool IsCopyPrefix(const Page* copy, const Page* page);
+#endif
+#if NVRAM_FLASH_DOUBLE_WRITE && NVRAM_UNIQUE_KEY_PAGES
+    //! Completes shredding of the record left behind by moving records interrupted by reset
+    void ResolveShreds();
+#endif
+#if NVRAM_LARGE_PAGES
+    //! Determines if the free page can be allocated for a page type using the specified geometry,
+    //! large pages are allocated only in blocks that contain no other pages
+    bool FitsGeometry(const Page* free, bool large) const;
+    //! Determines if the specified number of large pages can be allocated right away, always true if no page types use large pages
+    bool LargePageAvailable(unsigned count = 1) const;
+    //! Moves the pages out of a partially used block to release it for a large page
+    //! @returns true if the block has been released
+    bool Evacuate();
+#else
+    static constexpr bool FitsGeometry(const Page* free, bool large) { return true; }
+#endif
+    //! Determines if there are enough free pages and blocks available for allocation
+    bool EnoughFree() const;
+    //! Determines if the block has been marked for erasure
+    bool IsBlockErasable(const Block* block) const;
+
+#if NVRAM_KEY_INDEX
+    //! Updates key indices after a record has been written (or deleted, if @p rec is NULL)
+    void IndexUpdate(ID id, uint32_t key, const void* rec) { if (indices) IndexUpdateImpl(id, key, rec); }
+    //! Updates key indices after a record has been relocated
+    void IndexMove(ID id, uint32_t key, const void* from, const void* to) { if (indices) IndexMoveImpl(id, key, from, to); }
+    //! Updates key indices after a page has been erased
+    void IndexErase(const Page* page) { if (indices) IndexEraseImpl(page); }
+    //! Looks up the newest record with the specified key in a complete key index of the page type
+    //! @returns the record, or NULL if there is no such index or it does not know the key
+    const uint8_t* IndexFind(ID id, uint32_t key) const { return indices ? IndexFindImpl(id, key) : NULL; }
+    void IndexUpdateImpl(ID id, uint32_t key, const void* rec);
+    void IndexMoveImpl(ID id, uint32_t key, const void* from, const void* to);
+    void IndexEraseImpl(const Page* page);
+    const uint8_t* IndexFindImpl(ID id, uint32_t key) const;
+#else
+    void IndexUpdate(ID id, uint32_t key, const void* rec) {}
+    void IndexMove(ID id, uint32_t key, const void* from, const void* to) {}
+    void IndexErase(const Page* page) {}
+    static constexpr const uint8_t* IndexFind(ID id, uint32_t key) { return NULL; }
+#endif
+
+#if NVRAM_PAGE_DIRECTORY
+    //! Rebuilds the page directory from page headers
+    void DirectoryBuild();
+    //! Adds a newly allocated or discovered page to the directory
+    void DirectoryInsert(const Page* page);
+    //! Removes a page from the directory
+    void DirectoryRemove(const Page* page);
+    //! Retrieves the oldest and newest page with the specified ID from the directory
+    //! @returns false if the directory cannot be used and the pages must be scanned
+    bool DirectoryRange(ID id, const Page*& oldest, const Page*& newest) const;
+    //! Retrieves the next older and newer page relative to the specified page from the directory
+    //! @returns false if the directory cannot be used or does not contain the page
+    bool DirectoryNeighbors(const Page* page, const Page*& older, const Page*& newer) const;
+    //! Returns the index of the first directory entry with the same or higher ID
+    unsigned DirectoryFind(ID id) const;
+    //! Returns the index of the first directory entry that is not ordered before the specified page
+    unsigned DirectoryLowerBound(const Page* page) const;
+    //! Determines if page @p a is ordered before page @p b in the directory, comparing sequences relative to @p base
+    static bool DirectoryOrder(const Page* a, const Page* b, uint16_t base);
+#endif
+
+#if NVRAM_MAX_BLOCKS
+    //! Clears the block bitmaps
+    void PoolReset();
+    //! Updates the bitmap bit for the block
+    void PoolMark(uint32_t* bitmap, const Block* block, bool set);
+    //! Determines if the bitmap bit for the block is set
+    bool PoolTest(const uint32_t* bitmap, const Block* block) const;
+    //! Returns the number of blocks without any allocated pages
+    unsigned PoolUnusedCount() const;
+    //! Returns the empty block closest to the end of NVRAM, NULL if there is none or the blocks are not tracked
+    const Block* PoolFindEmpty() const;
+#endif
+
+#if NVRAM_WRITE_CURSORS
+    //! Discards all write cursors
+    void CursorReset();
+    //! Retrieves the cached newest page and the expected start of its free space for the specified page type
+    //! @returns false if there is no cursor for the page type
+    bool CursorGet(ID id, const Page*& page, const uint8_t*& free) const;
+    //! Sets the newest page and the start of its free space for the specified page type
+    void CursorSet(ID id, const Page* page, const uint8_t* free);
+    //! Advances the cursor after a record has been written to the specified page, if it is the cached newest page
+    void CursorAdvance(const Page* page, const uint8_t* free);
+    //! Discards the cursor referencing the specified page
+    void CursorDrop(const Page* page);
+#endif
+
+#if NVRAM_PAGE_FILTERS
+    //! Discards all page filters
+    void FilterReset();
+    //! Returns the filter slot used by the specified page
+    PageFilter& FilterFor(const Page* page);
+    //! Discards the filter of the specified page, if there is one
+    void FilterDrop(const Page* page);
+    //! Determines if the page may contain records with the specified first word, updating its filter as needed
+    bool FilterMayContain(const Page* page, uint32_t firstWord);
+    //! Adds the first word of a record to the filter
+    static void FilterAdd(PageFilter& filter, uint32_t firstWord);
+#endif
+
+    friend class Page;
+    friend class KeyIndex;
+    friend class Ring;
 };
 
 extern Manager _manager;
 
+#if !NVRAM_MULTIPLE_MANAGERS
+constexpr Manager& Manager::For(ID id) { return _manager; }
+constexpr Manager& Manager::Containing(const void* ptr) { return _manager; }
+#endif
+
 //! Simple collector that discards the oldest page, if it exists
 const Page* CollectorDiscardOldest(void* arg0, ID key);
 
 //! Simple collector that moves records from the oldest page to the newest, if they fit
 const Page* CollectorRelocate(void* arg0, ID key);
 
+//! Collector that picks the page with the best ratio of reclaimed space (weighted by page age)
+//! to live data that must be copied and moves its records to the newest page
+const Page* CollectorRelocateCostBenefit(void* arg0, ID key);
+
 //! Simple collector that locates older pages containing no records
 const Page* CollectorCleanup(void* arg0, ID key);
 
+//! Collector that merges the live records of several sparse pages into a new one, see @ref Page::MergeRecords,
+//! the superseded records are dropped only for page types marked using @ref Manager::UseUniqueKeys
+const Page* CollectorMerge(void* arg0, ID key);
+
+//! Same as @ref CollectorMerge, also dropping the records superseded by newer ones with the same first word,
+//! suitable only for page types where the first word is a key and only the newest record of each key is used
+const Page* CollectorMergeUnique(void* arg0, ID key);
+
 }
@@ -0,0 +1,273 @@
+/*
+ * Copyright (c) 2026 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * nvram/Page.Async.cpp
+ *
+ * Record storage waiting for the collector when NVRAM is full
+ */
+
+#include <nvram/nvram.h>
+
+#define MYDBG(...)  DBGCL("nvram", __VA_ARGS__)
+
+namespace nvram
+{
+
+async(Page::AddFixedAsync, ID page, Span data, mono_t timeout)
+async_def()
+{
+    ASSERT(data && data.Length());
+    async_return(await(AddAsyncImpl, page, data.Element<uint32_t>(), data.Pointer() + 4, data.Length(), false, timeout));
+}
+async_end
+
+async(Page::AddFixedAsync, ID page, uint32_t firstWord, Span data, mono_t timeout)
+async_def(const uint8_t* rec)
+{
+    if (!(f.rec = (const uint8_t*)await(AddAsyncImpl, page, firstWord, data, data.Length() + 4, false, timeout)))
+    {
+        async_return(NULL);
+    }
+    async_return(f.rec + 4);
+}
+async_end
+
+async(Page::AddVarAsync, ID page, Span data, mono_t timeout)
+async_def()
+{
+    ASSERT(data || !data.Length());
+    async_return(await(AddAsyncImpl, page, data.Element<uint32_t>(), data.Pointer() + 4, LengthAndFlags(data.Length(), true), false, timeout));
+}
+async_end
+
+async(Page::AddVarAsync, ID page, uint32_t firstWord, Span data, mono_t timeout)
+async_def(const uint8_t* rec)
+{
+    if (!(f.rec = (const uint8_t*)await(AddAsyncImpl, page, firstWord, data, LengthAndFlags(data.Length() + 4, true), false, timeout)))
+    {
+        async_return(NULL);
+    }
+    async_return(f.rec + 4);
+}
+async_end
+
+async(Page::ReplaceFixedAsync, ID page, uint32_t firstWord, Span data, mono_t timeout)
+async_def(const uint8_t* rec)
+{
+    if (!(f.rec = (const uint8_t*)await(AddAsyncImpl, page, firstWord, data, data.Length() + 4, true, timeout)))
+    {
+        async_return(NULL);
+    }
+    async_return(f.rec + 4);
+}
+async_end
+
+async(Page::ReplaceVarAsync, ID page, uint32_t firstWord, Span data, mono_t timeout)
+async_def(const uint8_t* rec)
+{
+    if (!(f.rec = (const uint8_t*)await(AddAsyncImpl, page, firstWord, data, LengthAndFlags(data.Length() + 4, true), true, timeout)))
+    {
+        async_return(NULL);
+    }
+    async_return(f.rec + 4);
+}
+async_end
+
+/*!
+ * Attempts to store the record, and if no new page can be allocated for it,
+ * waits for the collector to make more pages available and tries again until
+ * the timeout expires.
+ *
+ * Returns the pointer to the entire record including the first word.
+ */
+async(Page::AddAsyncImpl, ID page, uint32_t firstWord, const void* restOfData, LengthAndFlags totalLengthAndFlags, bool replace, mono_t timeout)
+async_def(
+    Manager* manager;
+    mono_t deadline;
+    unsigned available;
+    Span res;
+)
+{
+    f.manager = &Manager::For(page);
+    f.deadline = MONO_CLOCKS + timeout;
+
+    if (RequiredAligned(totalLengthAndFlags.length + totalLengthAndFlags.var * 4) > PagePayload)
+    {
+        // won't fit even on an empty page, no point in waiting
+        async_return(NULL);
+    }
+
+    for (;;)
+    {
+        f.available = f.manager->pagesAvailable;
+
+        f.res = replace ?
+            ReplaceImpl(page, firstWord, restOfData, totalLengthAndFlags) :
+            AddImpl(page, firstWord, restOfData, totalLengthAndFlags);
+
+        if (f.res)
+        {
+            async_return(f.res.Pointer());
+        }
+
+        MYDBG("Waiting for free pages to store %.4s record, %d available", &page, f.available);
+        NVRAM_STATS_ADD(*f.manager, allocationStalls, 1);
+        f.manager->RunCollector();
+
+        if (!await_mask_not_until(f.manager->pagesAvailable, ~0u, f.available, f.deadline))
+        {
+            MYDBG("Timed out waiting for free pages");
+            async_return(NULL);
+        }
+    }
+}
+async_end
+
+#if NVRAM_FLASH_ASYNC_WRITE
+
+/*!
+ * Moves all records from the old page to the new one like @ref MoveRecords,
+ * letting other tasks run while the records are written.
+ *
+ * With single writes, the space for each variable record is reserved by writing
+ * its length and the payload is programmed using @ref Flash::WriteAsync.
+ * Fixed records and all records with double writes cannot be reserved this way,
+ * so they are written synchronously, but still one at a time.
+ *
+ * Other tasks may write to the new page or delete records from the old page
+ * in the meantime, so the free space is located again if needed and records
+ * deleted while being moved are not completed.
+ */
+async(Page::MoveRecordsAsync, const Page* from, const Page* to)
+async_def(
+    Span rec;
+    Span body;
+    const uint8_t* free;
+    const uint8_t* copy;
+    unsigned moved;
+    bool success;
+#if NVRAM_FLASH_ERASE_BANKS > 1
+    bool suspended;
+#endif
+)
+{
+    ASSERT(from->id == to->id);
+    f.free = NULL;
+    f.moved = 0;
+    f.success = true;
+    // a move interrupted by reset is resolved by the full scan
+    Manager::For(from->id).CheckpointDrop();
+
+    for (f.rec = FindForwardNextImpl(from, NULL, 0, NULL); f.rec; f.rec = FindForwardNextImpl(from, f.rec, 0, NULL))
+    {
+        if (!from->id || from->id != to->id)
+        {
+            // the old page has been erased in the meantime
+            f.success = false;
+            break;
+        }
+
+        if (!f.free || f.free >= to->PayloadEnd() || !to->IsFreeAt(f.free))
+        {
+            f.free = to->FindFree();
+            if (!f.free)
+            {
+                f.success = false;
+                break;
+            }
+        }
+
+#if !NVRAM_FLASH_DOUBLE_WRITE
+        if (!to->IsFixed())
+        {
+            {
+                EraseSuspension suspend(f.free);
+                f.copy = to->VarReserve(f.free, f.rec.Length());
+            }
+            if (!f.copy)
+            {
+                f.success = false;
+                break;
+            }
+
+            f.free = to->SkipRecord(f.copy, f.rec.Length());
+            f.body = Span(f.rec.Pointer() + 4, f.rec.Length() - 4);
+#if NVRAM_FLASH_ERASE_BANKS > 1
+            // the erase stays suspended while the payload is being programmed in the background
+            f.suspended = Flash::EraseSuspend(f.copy);
+#endif
+            f.success = !f.body.Length() || await(Flash::WriteAsync, f.copy + 4, &f.body, 1);
+#if NVRAM_FLASH_ERASE_BANKS > 1
+            if (f.suspended)
+            {
+                Flash::EraseResume(f.copy);
+            }
+#endif
+            if (!f.success)
+            {
+                MYDBG("Failed to write moved record @ %08X", f.copy);
+                ShredRecord(f.copy);
+                break;
+            }
+
+            if (!FirstWord(f.rec))
+            {
+                // deleted while being moved
+                ShredRecord(f.copy);
+                continue;
+            }
+
+            bool committed;
+            {
+                EraseSuspension suspend(f.copy);
+                committed = to->VarCommit(f.copy, f.rec.Length(), FirstWord(f.rec));
+            }
+            if (!committed)
+            {
+                MYDBG("Failed to complete moved record @ %08X", f.copy);
+                ShredRecord(f.copy);
+                f.success = false;
+                break;
+            }
+
+            WriteSuccess(to, f.copy, f.rec.Length());
+        }
+        else
+#endif
+        {
+            if (!(f.copy = Span(WriteImpl(f.free, FirstWord(f.rec), f.rec.Pointer() + 4, f.rec.Length())).Pointer()))
+            {
+                f.success = false;
+                break;
+            }
+
+            f.free = to->SkipRecord(f.copy, f.rec.Length());
+        }
+
+        Manager::For(from->id).IndexMove(from->id, FirstWord(f.copy), f.rec, f.copy);
+        ShredRecord(f.rec);
+        f.moved++;
+        NVRAM_STATS_ADD(Manager::For(from->id), relocatedRecords, 1);
+        NVRAM_STATS_ADD(Manager::For(from->id), relocatedBytes, f.rec.Length());
+
+        // let other tasks run between records
+        async_yield();
+    }
+
+    if (f.moved)
+    {
+        MYDBG("Moved %d records from page %.4s-%d @ %08X to page %.4s-%d @ %08X", f.moved,
+            &from->id, from->sequence, from,
+            &to->id, to->sequence, to);
+        Manager::For(to->id).Notify(to->id);
+    }
+
+    async_return(f.success);
+}
+async_end
+
+#endif
+
+}
@@ -26,6 +26,7 @@ Span::packed_t Page::FindUnorderedFirstImpl(ID page, uint32_t firstWord)
     const Page* p = First(page);
     if (!p)
         return Span();
+    NVRAM_STATS_ADD(Manager::For(page), lookups, 1);
     return FindForwardNextImpl(p, NULL, firstWord, Page::UnorderedNextImpl);
 }
 
@@ -36,6 +37,7 @@ Span::packed_t Page::FindUnorderedFirstImpl(ID page, uint32_t firstWord)
  */
 Span::packed_t Page::FindUnorderedNextImpl(const uint8_t* rec, uint32_t firstWord)
 {
+    NVRAM_STATS_ADD(Manager::Containing(rec), lookups, 1);
     return FindForwardNextImpl(FromPtrInline(rec), rec, firstWord, Page::UnorderedNextImpl);
 }
 
@@ -48,18 +50,30 @@ Span::packed_t Page::FindForwardNextImpl(const Page* p, const uint8_t* rec, uint
 {
     do
     {
-        const uint8_t* pe = p->data + PagePayload;
+#if NVRAM_PAGE_FILTERS
+        if (firstWord && !Manager::Containing(p).FilterMayContain(p, firstWord))
+        {
+            // the key cannot be on this page
+            rec = NULL;
+            continue;
+        }
+#endif
 
-        if (uint32_t recordSize = p->recordSize)
+        NVRAM_STATS_ADD(Manager::Containing(p), pagesScanned, 1);
+        const uint8_t* pe = p->PayloadEnd();
+
+        if (p->IsFixed())
         {
             // fixed records
+            uint32_t recordSize = p->recordSize;
             if (rec)
                 rec += recordSize;
             else
                 rec = p->data;
 
-            for (; rec + recordSize < pe; rec += recordSize)
+            for (; rec + recordSize <= pe; rec += recordSize)
             {
+                NVRAM_STATS_ADD(Manager::Containing(p), recordsWalked, 1);
                 uint32_t first = FirstWord(rec);
                 if (first == 0)
                 {
@@ -76,9 +90,9 @@ Span::packed_t Page::FindForwardNextImpl(const Page* p, const uint8_t* rec, uint
         }
         else
         {
-            // variable records
+            // variable records, those without the first word are not complete yet
             if (rec)
-                rec = VarNext(rec);
+                rec += p->VarSkip(VarGetLen(rec));
             else
                 rec = p->data + 4;
 
@@ -86,6 +100,7 @@ Span::packed_t Page::FindForwardNextImpl(const Page* p, const uint8_t* rec, uint
 
             while (rec < pe)
             {
+                NVRAM_STATS_ADD(Manager::Containing(p), recordsWalked, 1);
                 len = VarGetLen(rec);
                 if (len == 0)
                 {
@@ -93,14 +108,24 @@ Span::packed_t Page::FindForwardNextImpl(const Page* p, const uint8_t* rec, uint
                     rec += WriteAlignment;
                     continue;
                 }
-                else if (len != ~0u && (first = FirstWord(rec)) != 0)
+                else if (len == ~0u)
+                {
+                    // start of free space, or of a record being written with double writes
+                    break;
+                }
+                else if (!VarFits(rec, len, pe))
+                {
+                    // damaged length, the following records cannot be located
+                    break;
+                }
+                else if ((first = FirstWord(rec)) != 0 && first != ~0u)
                 {
                     if (firstWord == 0 || first == firstWord)
                     {
                         return Span(rec, len);
                     }
                 }
-                rec += VarSkipLen(len);
+                rec += p->VarSkip(len);
             }
         }
 
@@ -127,6 +152,19 @@ Span::packed_t Page::LastRecordImpl(const Page* p)
     return FindNewestNextImpl(p, NULL, 0, NULL);
 }
 
+/*!
+ * Returns the space occupied by valid records on the page, including record headers
+ */
+uint32_t Page::UsedBytes() const
+{
+    uint32_t used = 0;
+    for (Span rec = FirstRecordImpl(this); rec; rec = NextRecordImpl(rec))
+    {
+        used += IsFixed() ? recordSize : VarSkip(rec.Length());
+    }
+    return used;
+}
+
 /*!
  * Returns the next valid record on the same page
  */
@@ -148,6 +186,7 @@ Span::packed_t Page::FindNewestFirstImpl(ID page, uint32_t firstWord)
     const Page* p = NewestFirst(page);
     if (!p)
         return Span();
+    NVRAM_STATS_ADD(Manager::For(page), lookups, 1);
     return FindNewestNextImpl(p, NULL, firstWord, Page::NewestNextImpl);
 }
 
@@ -156,6 +195,7 @@ Span::packed_t Page::FindNewestFirstImpl(ID page, uint32_t firstWord)
  */
 Span::packed_t Page::FindNewestNextImpl(const uint8_t* stop, uint32_t firstWord)
 {
+    NVRAM_STATS_ADD(Manager::Containing(stop), lookups, 1);
     return FindNewestNextImpl(FromPtrInline(stop), stop, firstWord, Page::NewestNextImpl);
 }
 
@@ -168,15 +208,26 @@ Span::packed_t Page::FindNewestNextImpl(const Page* p, const uint8_t* stop, uint
 
     do
     {
-        const uint8_t* pe = p->data + PagePayload;
+#if NVRAM_PAGE_FILTERS
+        if (firstWord && !Manager::Containing(p).FilterMayContain(p, firstWord))
+        {
+            // the key cannot be on this page
+            continue;
+        }
+#endif
+
+        NVRAM_STATS_ADD(Manager::Containing(p), pagesScanned, 1);
+        const uint8_t* pe = p->PayloadEnd();
 
-        if (uint32_t recordSize = p->recordSize)
+        if (p->IsFixed())
         {
             // fixed records
+            uint32_t recordSize = p->recordSize;
             const uint8_t* rec = p->data;
 
-            for (; rec + recordSize < pe && rec != stop; rec += recordSize)
+            for (; rec + recordSize <= pe && rec != stop; rec += recordSize)
             {
+                NVRAM_STATS_ADD(Manager::Containing(p), recordsWalked, 1);
                 uint32_t first = FirstWord(rec);
                 if (first == 0)
                 {
@@ -200,14 +251,41 @@ Span::packed_t Page::FindNewestNextImpl(const Page* p, const uint8_t* stop, uint
             const uint8_t* rec = p->data + 4;
             uint32_t len, first;
 
-            for (; rec < pe && rec != stop; rec += VarSkipLen(len))
+            if (p->HasFooters())
             {
+                // walk backwards from the stop record or the end of the page
+                const uint8_t* prev = stop >= p->data && stop < pe ? stop : p->VarEnd();
+                while ((prev = p->VarPrev(prev)) && prev != p->data)
+                {
+                    NVRAM_STATS_ADD(Manager::Containing(p), recordsWalked, 1);
+                    if ((first = FirstWord(prev)) != 0 && first != ~0u && (firstWord == 0 || first == firstWord))
+                    {
+                        return Span(prev, VarGetLen(prev));
+                    }
+                }
+
+                if (prev)
+                {
+                    // no matching record on this page
+                    continue;
+                }
+
+                // the footers are not consistent (e.g. after an interrupted write), fall back to forward scan
+            }
+
+            for (; rec < pe && rec != stop; rec += p->VarSkip(len))
+            {
+                NVRAM_STATS_ADD(Manager::Containing(p), recordsWalked, 1);
                 len = VarGetLen(rec);
                 if (len == 0)
                 {
                     continue;
                 }
-                else if (len != ~0u && (first = FirstWord(rec)) != 0)
+                else if (len == ~0u || !VarFits(rec, len, pe))
+                {
+                    break;
+                }
+                else if ((first = FirstWord(rec)) != 0 && first != ~0u)
                 {
                     if (firstWord == 0 || first == firstWord)
                     {
@@ -228,6 +306,71 @@ Span::packed_t Page::FindNewestNextImpl(const Page* p, const uint8_t* stop, uint
 
 
 
+/*!
+ * Returns the location following the last variable record on the page,
+ * i.e. the start of free space or a location past the end of the page
+ */
+const uint8_t* Page::VarEnd() const
+{
+    const uint8_t* pe = PayloadEnd();
+    const uint8_t* rec = data + 4;
+    uint32_t len;
+
+    for (; rec < pe; rec += VarSkip(len))
+    {
+        len = VarGetLen(rec);
+        if (len == ~0u || !VarFits(rec, len, pe))
+            break;
+    }
+
+    return rec;
+}
+
+/*!
+ * Returns the variable record preceding the specified location on a page with footers
+ *
+ * Each record is followed by a copy of its length, aligned to a separate write unit.
+ * Ranges of zeroes left by shredding and failed writes are walked over, just like
+ * when walking forward. The length at the start of the preceding record must match
+ * the footer, otherwise NULL is returned and the page has to be walked forward.
+ *
+ * Returns @ref data if there are no more records before the specified location.
+ */
+const uint8_t* Page::VarPrev(const uint8_t* rec) const
+{
+    const uint8_t* first = data + 4;
+
+    if (rec > PayloadEnd() + 4)
+    {
+        return NULL;
+    }
+
+    while (rec > first)
+    {
+        uint32_t len = ((const uint32_t*)(rec - WriteAlignment))[-1];
+        if (len == 0)
+        {
+            rec -= WriteAlignment;
+            continue;
+        }
+
+        if (len > Payload())
+        {
+            return NULL;
+        }
+
+        const uint8_t* prev = rec - VarSkip(len);
+        if (prev < first || VarGetLen(prev) != len)
+        {
+            return NULL;
+        }
+
+        return prev;
+    }
+
+    return data;
+}
+
 /**************************************************/
 /*************** OLD-TO-NEW SEARCH ****************/
 /**************************************************/
@@ -241,6 +384,7 @@ Span::packed_t Page::FindOldestFirstImpl(ID page, uint32_t firstWord)
     const Page* p = OldestFirst(page);
     if (!p)
         return Span();
+    NVRAM_STATS_ADD(Manager::For(page), lookups, 1);
     return FindForwardNextImpl(p, NULL, firstWord, Page::OldestNextImpl);
 }
 
@@ -249,6 +393,7 @@ Span::packed_t Page::FindOldestFirstImpl(ID page, uint32_t firstWord)
  */
 Span::packed_t Page::FindOldestNextImpl(const uint8_t* rec, uint32_t firstWord)
 {
+    NVRAM_STATS_ADD(Manager::Containing(rec), lookups, 1);
     return FindForwardNextImpl(FromPtrInline(rec), rec, firstWord, Page::OldestNextImpl);
 }
 
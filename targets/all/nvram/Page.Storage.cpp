@@ -18,9 +18,9 @@ namespace nvram
  */
 const uint8_t* Page::FindFree() const
 {
-    const uint8_t* pe = data + PagePayload;
+    const uint8_t* pe = PayloadEnd();
 
-    if (uint32_t recordSize = this->recordSize)
+    if (IsFixed())
     {
         for (const uint8_t* rec = data; rec + recordSize <= pe; rec += recordSize)
         {
@@ -33,13 +33,18 @@ const uint8_t* Page::FindFree() const
     else
     {
         uint32_t len;
-        for (const uint8_t* rec = data + 4; rec < pe; rec += VarSkipLen(len))
+        for (const uint8_t* rec = data + 4; rec < pe; rec += VarSkip(len))
         {
             len = VarGetLen(rec);
             if (len == ~0u)
             {
                 return rec;
             }
+            if (!VarFits(rec, len, pe))
+            {
+                // nothing can be appended after a damaged record
+                break;
+            }
         }
     }
 
@@ -114,9 +119,57 @@ Span::packed_t Page::ReplaceVarImpl(ID page, uint32_t firstWord, Span data)
  */
 Span::packed_t Page::AddImpl(ID page, uint32_t firstWord, const void* restOfData, LengthAndFlags totalLengthAndFlags)
 {
-    const Page* p = NewestFirst(page);
-    const uint8_t* free = p ? p->FindFree() : NULL;
+    const Page* p;
+    const uint8_t* free;
+
+    LocateFree(page, p, free);
+    auto res = Span(AppendImpl(page, p, free, firstWord, restOfData, totalLengthAndFlags, 0));
+    if (res && !totalLengthAndFlags.noNotify)
+    {
+        Manager::For(page).Notify(page, firstWord);
+    }
+    return res;
+}
+
+/*!
+ * Locates the newest page with the specified ID and the start of free space on it.
+ *
+ * Both can be NULL if there is no such page or no free space is left on it.
+ */
+void Page::LocateFree(ID page, const Page*& p, const uint8_t*& free)
+{
+#if NVRAM_WRITE_CURSORS
+    if (Manager::For(page).CursorGet(page, p, free))
+    {
+        // the cursor is just a hint, make sure nobody else has written there in the meantime
+        if (free && free < p->PayloadEnd() && !p->IsFreeAt(free))
+        {
+            free = p->FindFree();
+        }
+        return;
+    }
+#endif
+
+    p = NewestFirst(page);
+    free = p ? p->FindFree() : NULL;
+#if NVRAM_WRITE_CURSORS
+    if (p)
+    {
+        Manager::For(page).CursorSet(page, p, free);
+    }
+#endif
+}
 
+/*!
+ * Writes a record at the located free space. In case the page format is not suitable
+ * or verification fails, more attempts are made and new pages are allocated as needed.
+ *
+ * New pages with fixed records are allocated with a record size of at least @p allocSize.
+ * On success, the location is updated to point to the free space after the record.
+ * The change is not notified, this is left to the caller.
+ */
+Span::packed_t Page::AppendImpl(ID page, const Page*& p, const uint8_t*& free, uint32_t firstWord, const void* restOfData, LengthAndFlags totalLengthAndFlags, uint32_t allocSize)
+{
     bool var = totalLengthAndFlags.var;
     uint32_t totalLength = totalLengthAndFlags.length;
     uint32_t requiredLength = RequiredAligned(totalLength);
@@ -126,24 +179,25 @@ Span::packed_t Page::AddImpl(ID page, uint32_t firstWord, const void* restOfData
     for (;;)
     {
         if (!free ||
-            (free + requiredLength > p->data + PagePayload) ||
-            (var && p->recordSize) ||
-            (!var && p->recordSize && requiredLength > p->recordSize))
+            (free + requiredLength > p->PayloadEnd()) ||
+            (var && p->IsFixed()) ||
+            (!var && p->IsFixed() && requiredLength > p->recordSize))
         {
             // we need a new page, either because there is not enough free space or a different format is required
-            p = New(page, var ? 0 : requiredLength);
+            p = New(page, var ? VarDefault : (requiredLength > allocSize ? requiredLength : allocSize));
             if (!p)
+            {
+                free = NULL;
                 return Span();
+            }
             free = p->data + var * 4;
         }
 
         auto res = Span(WriteImpl(free, firstWord, restOfData, totalLength));
         if (res)
         {
-            if (!totalLengthAndFlags.noNotify)
-            {
-                _manager.Notify(page);
-            }
+            Manager::For(page).IndexUpdate(page, firstWord, res);
+            free = p->SkipRecord(res, totalLength);
             return res;
         }
 
@@ -152,18 +206,15 @@ Span::packed_t Page::AddImpl(ID page, uint32_t firstWord, const void* restOfData
 }
 
 /*!
- * Ensures that the provided record is the only one stored with the specified key (i.e. firstWord).
- *
- * If the newest stored instance of the record is the same as the new one provided, it is *not* written again.
+ * Finds the newest record with the specified key (i.e. firstWord), shredding all older ones
  */
-Span::packed_t Page::ReplaceImpl(ID page, uint32_t firstWord, const void* restOfData, LengthAndFlags totalLengthAndFlags)
+Span::packed_t Page::FindReplaced(ID page, uint32_t firstWord)
 {
     Span rec = FindUnorderedFirst(page, firstWord);
 
     if (!rec)
     {
-        // no previous record exists, simply add a new one
-        return AddImpl(page, firstWord, restOfData, totalLengthAndFlags);
+        return rec;
     }
 
     // the one found might not be the only one
@@ -185,17 +236,122 @@ Span::packed_t Page::ReplaceImpl(ID page, uint32_t firstWord, const void* restOf
         ShredRecord(del);
     }
 
+    return rec;
+}
+
+/*!
+ * Determines if the existing record already contains the data about to be written.
+ *
+ * If using fixed size records, the existing record might be longer, but we care only
+ * about the part that was about to be written.
+ */
+bool Page::IsSameRecord(Span rec, const void* restOfData, LengthAndFlags totalLengthAndFlags)
+{
     uint32_t len = totalLengthAndFlags.length;
     bool var = totalLengthAndFlags.var;
 
-    if ((rec.Length() == len || (!var && rec.Length() > len)) &&
-        (len <= 4 || !memcmp(restOfData, rec.Pointer() + 4, len - 4)))
+    return (rec.Length() == len || (!var && rec.Length() > len)) &&
+        (len <= 4 || !memcmp(restOfData, rec.Pointer() + 4, len - 4));
+}
+
+#if NVRAM_INPLACE_UPDATES
+
+/*!
+ * Updates a fixed record in place if the new data differs from the existing one only by cleared bits.
+ *
+ * Only the write units containing the changes are programmed again, the rest of the record
+ * must be blank, as it would be in a newly written record. The words are not updated atomically
+ * as a whole, so this is suitable for data where every intermediate state is valid,
+ * like counters or bitmaps that only ever clear bits.
+ */
+bool Page::UpdateInPlace(Span rec, const void* restOfData, LengthAndFlags totalLengthAndFlags)
+{
+    uint32_t len = totalLengthAndFlags.length;
+
+    // the page of the existing record decides, variable records would have their length programmed again
+    if (!FromPtrInline(rec.Pointer())->IsFixed() || rec.Length() < len || len <= 4)
+    {
+        return false;
+    }
+
+    const uint8_t* src = (const uint8_t*)restOfData;
+    const uint8_t* dst = rec.Pointer() + 4;
+    size_t n = len - 4, start = n, end = 0;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        if (src[i] & ~dst[i])
+        {
+            // bits would have to be set
+            return false;
+        }
+        if (src[i] != dst[i])
+        {
+            if (start == n)
+            {
+                start = i;
+            }
+            end = i + 1;
+        }
+    }
+
+    if (start == n || !Span(dst + n, rec.Length() - len).IsAllOnes())
+    {
+        return false;
+    }
+
+    // the record data is aligned, so are the whole write units around the changes
+    start &= ~(WriteAlignment - 1);
+    end = RequiredAligned(end);
+    if (end > n)
+    {
+        end = n;
+    }
+
+    EraseSuspension suspend(dst);
+    if (!Flash::Write(dst + start, Span(src + start, end - start)))
+    {
+        MYDBG("Failed to update record in place @ %08X", rec.Pointer());
+        NVRAM_STATS_ADD(Manager::Containing(rec), writeFailures, 1);
+        return false;
+    }
+
+    NVRAM_STATS_ADD(Manager::Containing(rec), updatedInPlace, 1);
+    return true;
+}
+
+#endif
+
+/*!
+ * Ensures that the provided record is the only one stored with the specified key (i.e. firstWord).
+ *
+ * If the newest stored instance of the record is the same as the new one provided, it is *not* written again.
+ */
+Span::packed_t Page::ReplaceImpl(ID page, uint32_t firstWord, const void* restOfData, LengthAndFlags totalLengthAndFlags)
+{
+    Span rec = FindReplaced(page, firstWord);
+
+    if (!rec)
+    {
+        // no previous record exists, simply add a new one
+        return AddImpl(page, firstWord, restOfData, totalLengthAndFlags);
+    }
+
+    if (IsSameRecord(rec, restOfData, totalLengthAndFlags))
     {
-        // the record is the same - if using fixed size records, it might be longer, but we care only about the part that was about to be written
         MYDBG("Same record already written @ %08X", rec);
         return rec;
     }
 
+#if NVRAM_INPLACE_UPDATES
+    if (UpdateInPlace(rec, restOfData, totalLengthAndFlags))
+    {
+        MYDBG("Record updated in place @ %08X", rec);
+        Manager::For(page).Notify(page, firstWord);
+        return rec;
+    }
+#endif
+
     totalLengthAndFlags.noNotify = true;    // suppress notification when adding, notify after deleting the previous record
     Span res = AddImpl(page, firstWord, restOfData, totalLengthAndFlags);
 
@@ -205,11 +361,358 @@ Span::packed_t Page::ReplaceImpl(ID page, uint32_t firstWord, const void* restOf
         ShredRecord(rec);
     }
 
-    _manager.Notify(page);
+    Manager::For(page).Notify(page, firstWord);
+
+    return res;
+}
+
+/*!
+ * Stores multiple records one after another, locating the free space only once
+ * and notifying about the change only once after all records are stored.
+ *
+ * When replacing, records identical to the existing ones are not written again,
+ * but are still counted as stored.
+ */
+size_t Page::BatchImpl(ID page, const BatchRecord* records, size_t count, bool var, bool replace)
+{
+    uint32_t allocSize = 0;
+    if (!var)
+    {
+        // allocate new pages large enough for any record in the batch
+        for (size_t i = 0; i < count; i++)
+        {
+            uint32_t requiredLength = RequiredAligned(records[i].data.Length() + 4);
+            if (requiredLength > allocSize)
+            {
+                allocSize = requiredLength;
+            }
+        }
+    }
+
+    const Page* p;
+    const uint8_t* free;
+    LocateFree(page, p, free);
+
+    size_t stored = 0;
+    bool changed = false;
+
+    for (; stored < count; stored++)
+    {
+        auto& record = records[stored];
+        LengthAndFlags totalLengthAndFlags(record.data.Length() + 4, var);
+
+        Span prev = replace ? Span(FindReplaced(page, record.firstWord)) : Span();
+        if (prev && IsSameRecord(prev, record.data, totalLengthAndFlags))
+        {
+            MYDBG("Same record already written @ %08X", prev);
+            continue;
+        }
+
+#if NVRAM_INPLACE_UPDATES
+        if (prev && UpdateInPlace(prev, record.data, totalLengthAndFlags))
+        {
+            changed = true;
+            continue;
+        }
+#endif
+
+        if (!Span(AppendImpl(page, p, free, record.firstWord, record.data, totalLengthAndFlags, allocSize)))
+        {
+            break;
+        }
+
+        if (prev)
+        {
+            // delete the previous record if the new one has been written successfully
+            ShredRecord(prev);
+        }
+        changed = true;
+    }
+
+    if (changed)
+    {
+        Manager::For(page).Notify(page);
+    }
+
+    return stored;
+}
+
+/*!
+ * Writes variable records staged in RAM, each consisting of the length word, first word
+ * and the rest of the record padded to the required alignment.
+ *
+ * As many records as fit on the newest page are programmed together, falling back to writing
+ * them one by one when a new page has to be allocated or the burst fails.
+ */
+size_t Page::WriteStagedImpl(ID page, const uint8_t* image, size_t length)
+{
+    const Page* p;
+    const uint8_t* free;
+    LocateFree(page, p, free);
+
+    size_t done = 0;
+
+    while (done < length)
+    {
+        size_t fit = 0;
+        // the staged layout matches only pages without footers
+        if (free && !p->recordSize)
+        {
+            while (done + fit < length)
+            {
+                uint32_t skip = VarSkipLen(FirstWord(image + done + fit));
+                if (free - 4 + fit + skip > p->PayloadEnd())
+                {
+                    break;
+                }
+                fit += skip;
+            }
+        }
+
+        if (fit)
+        {
+            size_t written = WriteBurst(p, free, image + done, fit);
+            done += written;
+            if (written == fit)
+            {
+                continue;
+            }
+        }
+
+        if (done < length)
+        {
+            // write the next record separately, this also takes care of allocating pages and skipping garbage
+            const uint8_t* rec = image + done;
+            uint32_t totalLength = FirstWord(rec);
+            if (!Span(AppendImpl(page, p, free, FirstWord(rec + 4), rec + 8, LengthAndFlags(totalLength, true), 0)))
+            {
+                break;
+            }
+            done += VarSkipLen(totalLength);
+        }
+    }
+
+    if (done)
+    {
+        Manager::For(page).Notify(page);
+    }
+
+    return done;
+}
+
+/*!
+ * Programs staged variable records with all the length words and record bodies first
+ * and the first words last, so every record becomes valid only when it is complete.
+ *
+ * Records that fail to be written are shredded so they can be written again
+ * after the records that were programmed successfully.
+ */
+size_t Page::WriteBurst(const Page* p, const uint8_t*& free, const uint8_t* image, size_t length)
+{
+    const uint8_t* base = free - 4;
+    const uint8_t* end = base + length;
+    EraseSuspension suspend(base);
+
+    // make sure there are no unfinished writes in the target span and the word following it
+    if (!Span(base, end < p->PayloadEnd() ? length + WriteAlignment : length).IsAllOnes())
+    {
+        MYDBG("Found garbage in the area for staged records @ %08X", free);
+        return 0;
+    }
+
+    size_t off, limit = length;
+    uint32_t len;
+
+#if NVRAM_FLASH_DOUBLE_WRITE
+    // with doublewords, the length is written together with the first word,
+    // so only the bodies can be written upfront
+    for (off = 0; off < length; off += VarSkipLen(len))
+    {
+        len = FirstWord(image + off);
+        if (len > 4 && !Flash::Write(base + off + 8, Span(image + off + 8, len - 4)))
+        {
+            limit = off;
+            break;
+        }
+    }
+#else
+    if (!Flash::WriteWord(base, FirstWord(image)))
+    {
+        MYDBG("Failed to write length for staged record @ %08X", base);
+        Flash::ShredWord(base);
+        free += 4;
+        return 0;
+    }
+
+    // each burst contains the rest of a record, padding and the length of the following record
+    for (off = 0; off < length; off += VarSkipLen(len))
+    {
+        len = FirstWord(image + off);
+        size_t next = off + VarSkipLen(len);
+        size_t burstEnd = next < length ? next + 4 : off + 4 + len;
+        if (burstEnd > off + 8 && !Flash::Write(base + off + 8, Span(image + off + 8, burstEnd - off - 8)))
+        {
+            limit = off;
+            break;
+        }
+    }
+#endif
+
+    // complete the records by writing the first words
+    for (off = 0; off < limit; off += VarSkipLen(len))
+    {
+        len = FirstWord(image + off);
+        uint32_t firstWord = FirstWord(image + off + 4);
+#if NVRAM_FLASH_DOUBLE_WRITE
+        if (!Flash::WriteDouble(base + off, len, firstWord))
+#else
+        if (!Flash::WriteWord(base + off + 4, firstWord))
+#endif
+        {
+            break;
+        }
+        Manager::Containing(p).IndexUpdate(p->id, firstWord, base + off + 4);
+    }
+
+    size_t written = off;
+    size_t shredEnd = limit < length ? limit + VarSkipLen(FirstWord(image + limit)) : limit;
+
+    if (written < shredEnd)
+    {
+        MYDBG("Failed to write staged records @ %08X", base + written + 4);
+#if NVRAM_FLASH_DOUBLE_WRITE
+        // shred everything from the end, so the records cannot appear valid
+        for (auto shred = base + shredEnd - 8; shred >= base + written; shred -= 8)
+        {
+            Flash::ShredDouble(shred);
+        }
+#else
+        // records with valid length and shredded first word are simply walked over
+        for (off = written; off < shredEnd; off += VarSkipLen(FirstWord(image + off)))
+        {
+            Flash::ShredWord(base + off + 4);
+        }
+        if (shredEnd < length)
+        {
+            // the length of the following record might have been written partially
+            Flash::ShredWord(base + shredEnd);
+            shredEnd += 4;
+        }
+#endif
+    }
+
+    free = base + shredEnd + 4;
+#if NVRAM_WRITE_CURSORS
+    Manager::Containing(p).CursorAdvance(p, free);
+#endif
+    return written;
+}
+
+/*!
+ * Reserves space for a variable record that will be written in parts, on the newest page
+ * with the specified ID or on a newly allocated one.
+ *
+ * Returns the location of the record, or NULL if there is no space for it.
+ */
+const uint8_t* Page::ReserveStreamedImpl(ID page, size_t totalLength)
+{
+    if (VarSkipLen(totalLength) + (VarDefault ? WriteAlignment : 0) > PagePayload)
+    {
+        // the record cannot fit even on an empty page
+        return NULL;
+    }
+
+    const Page* p;
+    const uint8_t* free;
+    LocateFree(page, p, free);
+
+    for (bool fresh = false;; fresh = true)
+    {
+        if (free && free < p->PayloadEnd() && !p->IsFixed())
+        {
+            EraseSuspension suspend(free);
+            if (auto rec = p->VarReserve(free, totalLength))
+            {
+#if NVRAM_FLASH_DOUBLE_WRITE
+                // nothing marks the reserved space, only one record can be written in parts at a time
+                auto& manager = Manager::Containing(p);
+                ASSERT(!manager.streamed);
+                manager.streamed = rec;
+#endif
+                return rec;
+            }
+        }
+
+        if (fresh)
+        {
+            MYDBG("Failed to reserve %d bytes for a streamed record on a new page @ %08X", totalLength, p);
+            return NULL;
+        }
+
+        // we need a new page, either because there is not enough free space or a different format is required
+        if (!(p = New(page, VarDefault)))
+        {
+            return NULL;
+        }
+        free = p->data + 4;
+    }
+}
+
+/*!
+ * Completes a variable record written in parts at a location returned by @ref ReserveStreamedImpl
+ *
+ * Returns the Span of the complete record, or an empty Span if it could not be completed
+ */
+Span::packed_t Page::CommitStreamedImpl(ID page, const uint8_t* rec, size_t totalLength, uint32_t firstWord, bool replace)
+{
+    const Page* p = FromPtrInline(rec);
+#if NVRAM_FLASH_DOUBLE_WRITE
+    Manager::Containing(p).streamed = NULL;
+#endif
+
+    EraseSuspension suspend(rec);
+    if (!p->VarCommit(rec, totalLength, firstWord))
+    {
+        MYDBG("Failed to commit streamed record @ %08X", rec);
+        return Span();
+    }
 
+    auto res = Span(WriteSuccess(p, rec, totalLength));
+    if (replace)
+    {
+        // the record has been written after all the existing ones, so it is the one that remains
+        FindReplaced(page, firstWord);
+    }
+    auto& manager = Manager::For(page);
+    manager.IndexUpdate(page, firstWord, res);
+    manager.Notify(page, firstWord);
     return res;
 }
 
+/*!
+ * Abandons a variable record written in parts, so that it is never considered valid
+ */
+void Page::AbortStreamedImpl(const uint8_t* rec, size_t totalLength)
+{
+    EraseSuspension suspend(rec);
+#if NVRAM_FLASH_DOUBLE_WRITE
+    Manager::Containing(rec).streamed = NULL;
+    NVRAM_STATS_ADD(Manager::Containing(rec), recordShreds, 1);
+    // the length has not been written yet, shred everything from the end,
+    // so the partially written payload can be walked over as zeroes
+    auto start = rec - 4;
+    auto end = start + FromPtrInline(rec)->VarSkip(totalLength);
+    for (auto shred = end - 8; shred >= start; shred -= 8)
+    {
+        Flash::ShredDouble(shred);
+    }
+#else
+    // the length is already reserved, so the record is simply walked over
+    (void)totalLength;
+    ShredRecord(rec);
+#endif
+}
+
 /*!
  * Tries to write the record, starting at the specified location
  *
@@ -219,14 +722,15 @@ Span::packed_t Page::ReplaceImpl(ID page, uint32_t firstWord, const void* restOf
 Span::packed_t Page::WriteImpl(const uint8_t* free, uint32_t firstWord, const void* restOfData, size_t totalLength)
 {
     const Page* p = FromPtrInline(free);
+    EraseSuspension suspend(p);
 
     for (;;)
     {
 #if NVRAM_FLASH_DOUBLE_WRITE
-        if (p->recordSize)
+        if (p->IsFixed())
         {
             // record size is already validated, just make sure there is still enough free space
-            if (free + p->recordSize > endof(p->data))
+            if (free + p->recordSize > p->PayloadEnd())
             {
                 return {};
             }
@@ -241,127 +745,188 @@ Span::packed_t Page::WriteImpl(const uint8_t* free, uint32_t firstWord, const vo
                     if (Flash::WriteDouble(free, firstWord, *(const uint32_t*)restOfData))
                     {
                         // success
-                        return Span(free, totalLength);
+                        return WriteSuccess(p, free, totalLength);
                     }
                 }
             }
 
             // failed, just shred the first dword to skip over the corrupted record
             MYDBG("Failed to write fixed record @ %08X", free);
+            NVRAM_STATS_ADD(Manager::Containing(p), writeFailures, 1);
             Flash::ShredDouble(free);
             free += p->recordSize;
         }
         else
         {
-            auto end = free - 4 + RequiredAligned(totalLength + 4);
-
-            if (end > endof(p->data))
+            if (!(free = p->VarReserve(free, totalLength)))
             {
                 // record won't fit
                 return {};
             }
 
-            // With doublewords, we cannot start by reserving the length first to avoid having
-            // a valid looking but unfinished record in case of power loss, so we just write the payload first
-            // this also means we need to make sure there are no accidental unfinished writes in the target
-            // span before writing
-            // also verify the next word, if it doesn't reach the end of the page, to make sure we don't
-            // create a record that makes corrupted data accessible
-            if (end < endof(p->data))
+            if ((totalLength <= 4 || Flash::Write(free + 4, Span(restOfData, totalLength - 4))) &&
+                p->VarCommit(free, totalLength, firstWord))
             {
-                end += 8;
-            }
-
-            while (end > free && ((const uint64_t*)end)[-1] + 1 == 0)
-            {
-                end -= 8;
-            }
-
-            if (end > free)
-            {
-                MYDBG("Failed to write variable record @ %08X, found garbage @ %08X: %8H", free, end - 8, Span(end - 8, 8));
-
-                // shred the garbage and continue after that
-                auto newFree = end + 4;
-                while (end > free)
-                {
-                    Flash::ShredDouble(end - 8);
-                    end -= 8;
-                }
-
-                free = newFree;
-                continue;
-            }
-
-            if (totalLength <= 4 || Flash::Write(free + 4, Span(restOfData, totalLength - 4)))
-            {
-                // write first doubleword
-                if (Flash::WriteDouble(free - 4, totalLength, firstWord))
-                {
-                    // success
-                    return Span(free, totalLength);
-                }
+                // success
+                return WriteSuccess(p, free, totalLength);
             }
 
             // simply retry - any garbage will be detected and repaired
             MYDBG("Failed to write variable record @ %08X", free);
+            NVRAM_STATS_ADD(Manager::Containing(p), writeFailures, 1);
         }
 #else
-        if (p->recordSize)
+        if (p->IsFixed())
         {
             // record size is already validated, just make sure there is still enough free space
-            if (free + p->recordSize > endof(p->data))
+            if (free + p->recordSize > p->PayloadEnd())
             {
                 return {};
             }
         }
-        else
+        else if (!(free = p->VarReserve(free, totalLength)))
         {
-            uint32_t requiredLength = RequiredAligned(totalLength);
-
-            for (;;)
-            {
-                if (free + requiredLength > endof(p->data))
-                {
-                    return {};
-                }
-
-                // variable records - first reserve space by writing the record length
-                if (Flash::WriteWord(free - 4, totalLength))
-                {
-                    break;
-                }
-
-                MYDBG("Failed to write length for var record @ %08X", free - 4);
-                Flash::ShredWord(free - 4);
-                free += 4;	// we can try starting at the next word - since the length is now zero, it will be simply walked over
-            }
+            return {};
         }
 
         // the rest is written the same for both record types, with first word written last
         if (totalLength <= 4 || Flash::Write(free + 4, Span(restOfData, totalLength - 4)))
         {
-            if (Flash::WriteWord(free, firstWord))
+            if (p->IsFixed() ? Flash::WriteWord(free, firstWord) : p->VarCommit(free, totalLength, firstWord))
             {
                 // success - return the span of the written record
-                return Span(free, totalLength);
+                return WriteSuccess(p, free, totalLength);
             }
         }
 
         MYDBG("Failed to write record @ %08X", free);
+        NVRAM_STATS_ADD(Manager::Containing(p), writeFailures, 1);
         ShredRecord(free);
-        free += p->recordSize ? p->recordSize : VarSkipLen(totalLength);
+        free = p->SkipRecord(free, totalLength);
 #endif
     }
 }
 
+/*!
+ * Prepares the space for a variable record at the specified location, skipping over any garbage
+ *
+ * Returns the location where the record can be written, or NULL if it doesn't fit on the page
+ */
+const uint8_t* Page::VarReserve(const uint8_t* free, size_t totalLength) const
+{
+#if NVRAM_FLASH_DOUBLE_WRITE
+    // a record being written in parts looks like free space, any record written
+    // next to it would be taken for garbage (see RecordWriter)
+    auto* streamed = Manager::Containing(this).streamed;
+    ASSERT(!streamed || FromPtrInline(streamed) != this);
+
+    for (;;)
+    {
+        auto end = free - 4 + VarSkip(totalLength);
+
+        if (end > PayloadEnd())
+        {
+            // record won't fit
+            return NULL;
+        }
+
+        // With doublewords, we cannot start by reserving the length first to avoid having
+        // a valid looking but unfinished record in case of power loss, so we just write the payload first
+        // this also means we need to make sure there are no accidental unfinished writes in the target
+        // span before writing
+        // also verify the next word, if it doesn't reach the end of the page, to make sure we don't
+        // create a record that makes corrupted data accessible
+        if (end < PayloadEnd())
+        {
+            end += 8;
+        }
+
+        while (end > free && ((const uint64_t*)end)[-1] + 1 == 0)
+        {
+            end -= 8;
+        }
+
+        if (end <= free)
+        {
+            return free;
+        }
+
+        MYDBG("Failed to write variable record @ %08X, found garbage @ %08X: %8H", free, end - 8, Span(end - 8, 8));
+        NVRAM_STATS_ADD(Manager::Containing(this), writeFailures, 1);
+
+        // shred the garbage and continue after that
+        auto newFree = end + 4;
+        while (end > free)
+        {
+            Flash::ShredDouble(end - 8);
+            end -= 8;
+        }
+
+        free = newFree;
+    }
+#else
+    uint32_t requiredLength = VarSkip(totalLength) - 4;
+
+    for (;;)
+    {
+        if (free + requiredLength > PayloadEnd())
+        {
+            return NULL;
+        }
+
+        // first reserve space by writing the record length
+        if (Flash::WriteWord(free - 4, totalLength))
+        {
+            return free;
+        }
+
+        MYDBG("Failed to write length for var record @ %08X", free - 4);
+        NVRAM_STATS_ADD(Manager::Containing(this), writeFailures, 1);
+        Flash::ShredWord(free - 4);
+        free += 4;	// we can try starting at the next word - since the length is now zero, it will be simply walked over
+    }
+#endif
+}
+
+/*!
+ * Completes a variable record with the payload already written, writing the footer (if any) and the first word
+ *
+ * With doublewords, the length is written together with the first word and the footer
+ * occupies a separate doubleword, so it can be written after the payload.
+ */
+bool Page::VarCommit(const uint8_t* rec, size_t totalLength, uint32_t firstWord) const
+{
+#if NVRAM_FLASH_DOUBLE_WRITE
+    return (!HasFooters() || Flash::WriteDouble(rec - 4 + VarSkipLen(totalLength), totalLength, ~0u)) &&
+        Flash::WriteDouble(rec - 4, totalLength, firstWord);
+#else
+    return (!HasFooters() || Flash::WriteWord(rec - 4 + VarSkipLen(totalLength), totalLength)) &&
+        Flash::WriteWord(rec, firstWord);
+#endif
+}
+
+/*!
+ * Completes a successful record write, returning the Span of the written record
+ */
+Span::packed_t Page::WriteSuccess(const Page* p, const uint8_t* rec, size_t totalLength)
+{
+    NVRAM_STATS_ADD(Manager::Containing(p), recordsWritten, 1);
+    NVRAM_STATS_ADD(Manager::Containing(p), recordBytes, p->SkipRecord(rec, totalLength) - rec);
+#if NVRAM_WRITE_CURSORS
+    Manager::Containing(p).CursorAdvance(p, p->SkipRecord(rec, totalLength));
+#endif
+    return Span(rec, totalLength);
+}
+
 #if NVRAM_FLASH_DOUBLE_WRITE
 
 void Page::ShredRecord(const void* ptr)
 {
     const Page* p = FromPtrInline(ptr);
+    NVRAM_STATS_ADD(Manager::Containing(p), recordShreds, 1);
+    EraseSuspension suspend(p);
 
-    if (p->recordSize)
+    if (p->IsFixed())
     {
         // easy for fixed records
         Flash::ShredDouble(ptr);
@@ -377,12 +942,12 @@ void Page::ShredRecord(const void* ptr)
     uint32_t totalLength = VarGetLen(ptr);
     ASSERT(totalLength != 0 && totalLength != ~0u);
     auto start = (const uint8_t*)ptr - 4;
-    auto end = start + VarSkipLen(totalLength);
-    if (end > endof(p->data))
+    auto end = start + p->VarSkip(totalLength);
+    if (end > p->PayloadEnd())
     {
         // if the record was corrupted, just erase the rest of page...
         MYDBG("Erasing the rest of corrupted page from %p", start);
-        end = endof(p->data);
+        end = p->PayloadEnd();
     }
 
     for (auto shred = end - 8; shred >= start; shred -= 8)
@@ -413,14 +978,16 @@ bool Page::Delete(ID page, uint32_t firstWord)
         ShredRecord(rec);
     } while ((rec = FindUnorderedNext(rec, firstWord)));
 
-    _manager.Notify(page);
+    auto& manager = Manager::For(page);
+    manager.IndexUpdate(page, firstWord, NULL);
+    manager.Notify(page, firstWord);
     return true;
 }
 
 /*!
- * Moves all records from the old page to the new page
+ * Determines if all records from the old page fit on the new page, using at most @p limit bytes (unless zero)
  */
-bool Page::MoveRecords(const Page* p, size_t limit) const
+bool Page::CanMoveRecords(const Page* p, size_t limit) const
 {
     ASSERT(p);
     ASSERT(p->id == id);
@@ -431,7 +998,7 @@ bool Page::MoveRecords(const Page* p, size_t limit) const
         return false;
     }
 
-    const uint8_t* freeMax = endof(p->data);
+    const uint8_t* freeMax = p->PayloadEnd();
     if (limit && free + limit < freeMax)
     {
         freeMax = free + limit;
@@ -439,10 +1006,9 @@ bool Page::MoveRecords(const Page* p, size_t limit) const
 
     const uint8_t* testFree = free;
 
-    // first simulate moving the records and start only if they fit
     for (Span rec = FindForwardNextImpl(this, NULL, 0, NULL); rec; rec = FindForwardNextImpl(this, rec, 0, NULL))
     {
-        if (p->recordSize)
+        if (p->IsFixed())
         {
             // if the new page is fixed size, old records must also all be small enough
             if (testFree + p->recordSize > freeMax || rec.Length() > p->recordSize)
@@ -453,7 +1019,7 @@ bool Page::MoveRecords(const Page* p, size_t limit) const
         }
         else
         {
-            uint32_t requiredLength = RequiredAligned(rec.Length() + 4);
+            uint32_t requiredLength = p->VarSkip(rec.Length());
             if (testFree - 4 + requiredLength > freeMax)
             {
                 return false;
@@ -463,22 +1029,42 @@ bool Page::MoveRecords(const Page* p, size_t limit) const
         }
     }
 
-    // records should fit, move them
+    return true;
+}
+
+/*!
+ * Moves all records from the old page to the new page
+ */
+bool Page::MoveRecords(const Page* p, size_t limit) const
+{
+    // first simulate moving the records and start only if they fit
+    if (!CanMoveRecords(p, limit))
+    {
+        return false;
+    }
+
+    // records should fit, move them, a move interrupted by reset is resolved by the full scan
+    Manager::For(id).CheckpointDrop();
+    const uint8_t* free = p->FindFree();
     int moved = 0;
     bool success = true;
 
     for (Span rec = FindForwardNextImpl(this, NULL, 0, NULL); rec; rec = FindForwardNextImpl(this, rec, 0, NULL))
     {
         // free can point past the end of data if the last moved record filled the page exactly to the end
-        if (free < endof(p->data))
+        if (free < p->PayloadEnd())
         {
             auto span = Span(WriteImpl(free, rec.Element<uint32_t>(), rec.Pointer() + 4, rec.Length()));
 
             if (span)
             {
                 // successful write
+                Manager::For(id).IndexMove(id, span.Element<uint32_t>(), rec, span);
                 ShredRecord(rec);
-                free = span.Pointer<uint8_t>() + (p->recordSize ? p->recordSize : VarSkipLen(rec.Length()));
+                free = p->SkipRecord(span, rec.Length());
+                moved++;
+                NVRAM_STATS_ADD(Manager::For(id), relocatedRecords, 1);
+                NVRAM_STATS_ADD(Manager::For(id), relocatedBytes, rec.Length());
                 continue;
             }
         }
@@ -492,10 +1078,219 @@ bool Page::MoveRecords(const Page* p, size_t limit) const
         MYDBG("Moved %d records from page %.4s-%d @ %08X to page %.4s-%d @ %08X", moved,
             &id, sequence, this,
             &p->id, p->sequence, p);
-        _manager.Notify(id);
+        Manager::For(id).Notify(id);
     }
 
     return success;
 }
 
+#if NVRAM_FLASH_DOUBLE_WRITE && NVRAM_UNIQUE_KEY_PAGES
+
+/*!
+ * Variable records are shredded from the end (see @ref ShredRecord), so the original
+ * of a moved record can remain valid with its last doublewords cleared when the power
+ * is lost. Records are moved to the newest page and each original is shredded right
+ * after its copy is written, so the copy is the last record of the newest page, with
+ * the same length and the same contents up to the cleared doublewords.
+ *
+ * Matching contents alone do not prove anything for page types with multiple records
+ * per key, the record can be removed only if the page type stores unique keys.
+ */
+bool Page::IsShreddedCopy(Span rec)
+{
+    const Page* p = FromPtrInline(rec.Pointer());
+    auto* data = rec.Pointer();
+    size_t len = rec.Length();
+
+    if (p->IsFixed() || !len || !Manager::For(p->id).UsesUniqueKeys(p->id))
+    {
+        return false;
+    }
+
+    // the cleared doublewords at the end of the record, including its padding and footer,
+    // the first doubleword with the length and first word is shredded last
+    auto end = data - 4 + p->VarSkip(len);
+    auto shred = end;
+    while (shred > data + 4 && !((const uint32_t*)shred)[-1] && !((const uint32_t*)shred)[-2])
+    {
+        shred -= 8;
+    }
+
+    const Page* newest = NewestFirst(p->id);
+    if (shred == end || newest == p)
+    {
+        return false;
+    }
+
+    Span copy;
+    for (Span next = FindForwardNextImpl(newest, NULL, 0, NULL); next; next = FindForwardNextImpl(newest, next, 0, NULL))
+    {
+        copy = next;
+    }
+
+    size_t same = shred - data < len ? shred - data : len;
+    return copy && copy.Length() == len && CompareAge(rec, copy) < 0 && !memcmp(data, copy.Pointer(), same);
+}
+
+#endif
+
+/*!
+ * Determines if there is a newer record with the same first word as the specified one,
+ * the key index of the page type is used when available instead of searching all pages
+ */
+bool Page::IsSuperseded(Span rec)
+{
+    uint32_t firstWord = rec.Element<uint32_t>();
+    ID id = FromPtrInline(rec)->id;
+
+    if (auto newest = Manager::For(id).IndexFind(id, firstWord))
+    {
+        return newest != rec.Pointer();
+    }
+
+    for (Span other = FindUnorderedFirst(id, firstWord); other; other = FindUnorderedNext(other, firstWord))
+    {
+        if (CompareAge(rec, other) < 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*!
+ * The superseded records would be dropped by merging the page anyway, shredding them
+ * right away means each record is looked up only once when the page is examined
+ */
+uint32_t Page::DropSuperseded() const
+{
+    uint32_t used = 0;
+    for (Span rec = FirstRecordImpl(this); rec; rec = NextRecordImpl(rec))
+    {
+        if (IsSuperseded(rec))
+        {
+            ShredRecord(rec);
+        }
+        else
+        {
+            used += IsFixed() ? recordSize : VarSkip(rec.Length());
+        }
+    }
+    return used;
+}
+
+/*!
+ * Merges the live records of several sparse pages into a newly allocated one
+ *
+ * The pages are selected from the oldest ones, so that their live records fit
+ * on a single page together. With @p uniqueKeys, records superseded by newer ones
+ * (anywhere, not only on the merged pages) are shredded while examining the pages.
+ * The remaining records are then copied in a single pass, oldest page first, which
+ * preserves their relative order.
+ *
+ * At most @ref MergeScanPages pages are examined, as each record has to be looked
+ * up among all records of the page type unless the type has a complete key index.
+ */
+const Page* Page::MergeRecords(ID id, bool uniqueKeys)
+{
+    const Page* newest;
+    const Page* oldest;
+
+    Scan(id, oldest, newest);
+
+    const Page* sources[MergeMaxPages];
+    size_t count = 0, examined = 0;
+    uint32_t total = 0, capacity = 0;
+    uint32_t payload = Manager::For(id).UsesLargePages(id) ? LargePagePayload : PagePayload;
+
+    // the newest page is left alone, it is most likely still being written
+    for (auto p = oldest; p && p != newest && count < MergeMaxPages && examined < MergeScanPages; p = p->OldestNext(), examined++)
+    {
+        if (count && p->recordSize != sources[0]->recordSize)
+        {
+            // all records must fit the format of the new page
+            continue;
+        }
+
+        uint32_t live = uniqueKeys ? p->DropSuperseded() : p->UsedBytes();
+        if (!count)
+        {
+            capacity = p->IsFixed() ? payload - payload % p->recordSize : payload;
+        }
+        if (live > p->Payload() / 2 || total + live > capacity)
+        {
+            continue;
+        }
+
+        sources[count++] = p;
+        total += live;
+    }
+
+    if (count < 2)
+    {
+        // merging less than two pages does not release anything
+        return NULL;
+    }
+
+    const Page* p = New(id, sources[0]->recordSize);
+    if (!p)
+    {
+        return NULL;
+    }
+
+    auto& manager = Manager::For(id);
+    const uint8_t* free = p->FindFree();
+    int moved = 0;
+    bool success = true;
+
+    for (size_t i = 0; i < count && success; i++)
+    {
+        // the superseded records, if any, have already been shredded by DropSuperseded
+        for (Span rec = FindForwardNextImpl(sources[i], NULL, 0, NULL); rec; rec = FindForwardNextImpl(sources[i], rec, 0, NULL))
+        {
+            // free can point past the end of data if the last moved record filled the page exactly to the end
+            if (free < p->PayloadEnd())
+            {
+                auto span = Span(WriteImpl(free, rec.Element<uint32_t>(), rec.Pointer() + 4, rec.Length()));
+
+                if (span)
+                {
+                    manager.IndexMove(id, span.Element<uint32_t>(), rec, span);
+                    ShredRecord(rec);
+                    free = p->SkipRecord(span, rec.Length());
+                    moved++;
+                    NVRAM_STATS_ADD(manager, relocatedRecords, 1);
+                    NVRAM_STATS_ADD(manager, relocatedBytes, rec.Length());
+                    continue;
+                }
+            }
+
+            success = false;
+            break;
+        }
+    }
+
+    if (moved)
+    {
+        MYDBG("Merged %d records from %d pages %.4s to page %.4s-%d @ %08X", moved, count,
+            &id, &p->id, p->sequence, p);
+        manager.Notify(id);
+    }
+
+    if (!success)
+    {
+        // the pages that have been emptied will be released by CollectorCleanup
+        return NULL;
+    }
+
+    // the oldest page is returned to the collector, the others are released right away
+    for (size_t i = 1; i < count; i++)
+    {
+        manager.ErasePage(sources[i]);
+    }
+
+    return sources[0];
+}
+
 }
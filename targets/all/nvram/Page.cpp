@@ -43,15 +43,7 @@ int Page::CompareAge(const void* rec1, const void* rec2)
  */
 bool Page::CheckEmpty() const
 {
-    const uint32_t* p = (const uint32_t*)this;
-    const uint32_t* e = (const uint32_t*)(this + 1);
-    while (p != e)
-    {
-        if (*p++ != ~0u)
-            return false;
-    }
-
-    return true;
+    return Block::IsBlank((const uint32_t*)this, (const uint32_t*)PayloadEnd());
 }
 
 /*!
@@ -61,8 +53,16 @@ bool Page::CheckEmpty() const
  */
 const Page* Page::First(ID id)
 {
-    auto* blk = _manager.UsedBlocks().begin();
-    return blk == _manager.UsedBlocks().end() ? NULL : FastEnum(blk, blk->begin(), id);
+#if NVRAM_PAGE_DIRECTORY
+    const Page* oldest;
+    const Page* newest;
+    if (Manager::For(id).DirectoryRange(id, oldest, newest))
+        return oldest;
+#endif
+
+    auto blocks = Manager::For(id).UsedBlocks();
+    auto* blk = blocks.begin();
+    return blk == blocks.end() ? NULL : FastEnum(blk, blk->begin(), id);
 }
 
 /*!
@@ -72,6 +72,13 @@ const Page* Page::First(ID id)
  */
 const Page* Page::UnorderedNextImpl(const Page* after)
 {
+#if NVRAM_PAGE_DIRECTORY
+    const Page* older;
+    const Page* newer;
+    if (Manager::Containing(after).DirectoryNeighbors(after, older, newer))
+        return newer;
+#endif
+
     return FastEnum(after->Block(), after + 1, after->id);
 }
 
@@ -90,6 +97,8 @@ const Page* Page::NewestNextImpl(const Page* after)
  */
 const Page* Page::FastEnum(const nvram::Block* blk, const Page* p, ID id)
 {
+    auto blkEnd = Manager::Containing(blk).UsedBlocks().end();
+
     // first finish searching the current block
     for (;;)
     {
@@ -105,7 +114,7 @@ const Page* Page::FastEnum(const nvram::Block* blk, const Page* p, ID id)
         for (;;)
         {
             blk++;
-            if (blk == _manager.UsedBlocks().end())
+            if (blk == blkEnd)
                 return NULL;
             if (blk->IsValid())
                 break;
@@ -120,9 +129,17 @@ const Page* Page::FastEnum(const nvram::Block* blk, const Page* p, ID id)
  * while the newest one is the one enumerated last
  * Indeterminate sequence handling - the oldest and newest page sequence is
  * always determined relative to the first page
+ * If the page directory is available, the pages are looked up there instead
  */
 Packed<Page::FirstScanResult> Page::Scan(ID id)
 {
+#if NVRAM_PAGE_DIRECTORY
+    const Page* dirOldest;
+    const Page* dirNewest;
+    if (Manager::For(id).DirectoryRange(id, dirOldest, dirNewest))
+        return pack<FirstScanResult>(dirNewest, dirOldest);
+#endif
+
     const Page* p = First(id);
     const Page* oldest = p;
     const Page* newest = p;
@@ -154,9 +171,17 @@ Packed<Page::FirstScanResult> Page::Scan(ID id)
  * but a higher address
  * Indeterminate sequence handling - sequence start is disambiguated by the
  * first page with the specified ID
+ * If the page directory is available, the pages are looked up there instead
  */
 Packed<Page::NextScanResult> Page::Scan(ID id, const Page* relativeTo)
 {
+#if NVRAM_PAGE_DIRECTORY
+    const Page* dirOlder;
+    const Page* dirNewer;
+    if (relativeTo->id == id && Manager::For(id).DirectoryNeighbors(relativeTo, dirOlder, dirNewer))
+        return pack<NextScanResult>(dirOlder, dirNewer);
+#endif
+
     const Page* p = First(id);
     const Page* oldest = p;
     const Page* newest = p;
@@ -35,8 +35,14 @@ public:
     constexpr ID GetID() const { return id; }
     //! Gets the sequence number of the page
     constexpr uint16_t Sequence() const { return sequence; }
+    //! Gets the fixed record size, or zero (or @ref VarWithFooter) for variable records
+    constexpr uint32_t GetRecordSize() const { return recordSize; }
+    //! Gets the size of the page payload, larger for pages spanning a whole block
+    size_t Payload() const { return Block()->IsLarge() ? LargePagePayload : PagePayload; }
+    //! Gets the end of the page payload
+    const uint8_t* PayloadEnd() const { return data + Payload(); }
     //! Gets the free bytes on the page
-    uint32_t UnusedBytes() const { auto ptr = FindFree(); return ptr ? data + PagePayload - ptr : 0; }
+    uint32_t UnusedBytes() const { auto ptr = FindFree(); return ptr ? PayloadEnd() - ptr : 0; }
     //! Gets the used bytes on the page
     uint32_t UsedBytes() const;
 
@@ -70,6 +76,15 @@ public:
     //! Returns the next newer record on a page with the same ID and optional matching first word
     static Span FindOldestNext(const void* rec, uint32_t firstWord = 0) { return FindOldestNextImpl((const uint8_t*)rec, firstWord); }
 
+    //! Variants of the searches above specialized for fixed size records of the specified size (including the first word),
+    //! pages with a different layout are searched using the generic implementation
+    template<uint32_t RecordSize> static Span FindUnorderedFirstFixed(ID page, uint32_t firstWord = 0) { auto p = First(page); return p ? Span(FindFixedForwardImpl<RecordSize>(p, NULL, firstWord, UnorderedNextImpl)) : Span(); }
+    template<uint32_t RecordSize> static Span FindUnorderedNextFixed(const void* rec, uint32_t firstWord = 0) { return FindFixedForwardImpl<RecordSize>(FromPtrInline(rec), (const uint8_t*)rec, firstWord, UnorderedNextImpl); }
+    template<uint32_t RecordSize> static Span FindNewestFirstFixed(ID page, uint32_t firstWord = 0) { auto p = NewestFirst(page); return p ? Span(FindFixedNewestImpl<RecordSize>(p, NULL, firstWord, NewestNextImpl)) : Span(); }
+    template<uint32_t RecordSize> static Span FindNewestNextFixed(const void* rec, uint32_t firstWord = 0) { return FindFixedNewestImpl<RecordSize>(FromPtrInline(rec), (const uint8_t*)rec, firstWord, NewestNextImpl); }
+    template<uint32_t RecordSize> static Span FindOldestFirstFixed(ID page, uint32_t firstWord = 0) { auto p = OldestFirst(page); return p ? Span(FindFixedForwardImpl<RecordSize>(p, NULL, firstWord, OldestNextImpl)) : Span(); }
+    template<uint32_t RecordSize> static Span FindOldestNextFixed(const void* rec, uint32_t firstWord = 0) { return FindFixedForwardImpl<RecordSize>(FromPtrInline(rec), (const uint8_t*)rec, firstWord, OldestNextImpl); }
+
     //! Adds a new record to a page with the specified ID
     //! If a new page is required, a page with fixed size records is allocated
     //! Returns a @ref Span representing the stored record in NVRAM,
@@ -104,20 +119,104 @@ public:
     //! or an invalid @ref Span if the record could not be stored
     static Span ReplaceVar(ID page, uint32_t firstWord, Span data) { return ReplaceVarImpl(page, firstWord, data); }
 
+    //! Adds a new record to a page with the specified ID, waiting up to @p timeout ticks for the collector
+    //! to free up space if there is not enough of it
+    //! If a new page is required, a page with fixed size records is allocated
+    //! Returns a pointer to the stored record in NVRAM, or NULL if the record could not be stored
+    static async(AddFixedAsync, ID page, Span data, mono_t timeout);
+    //! Adds a new record to a page with the specified ID, waiting up to @p timeout ticks for the collector
+    //! to free up space if there is not enough of it
+    //! The content of the record is concatenation of the @p firstWord and the contents of the @p data @ref Span
+    //! If a new page is required, a page with fixed size records is allocated
+    //! Returns a pointer to the stored @p data part in NVRAM, or NULL if the record could not be stored
+    static async(AddFixedAsync, ID page, uint32_t firstWord, Span data, mono_t timeout);
+    //! Adds a new record to a page with the specified ID, waiting up to @p timeout ticks for the collector
+    //! to free up space if there is not enough of it
+    //! If a new page is required, a page with variable size records is allocated
+    //! Returns a pointer to the stored record in NVRAM, or NULL if the record could not be stored
+    static async(AddVarAsync, ID page, Span data, mono_t timeout);
+    //! Adds a new record to a page with the specified ID, waiting up to @p timeout ticks for the collector
+    //! to free up space if there is not enough of it
+    //! The content of the record is concatenation of the @p firstWord and the contents of the @p data @ref Span
+    //! If a new page is required, a page with variable size records is allocated
+    //! Returns a pointer to the stored @p data part in NVRAM, or NULL if the record could not be stored
+    static async(AddVarAsync, ID page, uint32_t firstWord, Span data, mono_t timeout);
+    //! Adds a new record to a page with the specified ID, removing all records with the same @p firstWord,
+    //! waiting up to @p timeout ticks for the collector to free up space if there is not enough of it
+    //! If a new page is required, a page with fixed size records is allocated
+    //! Returns a pointer to the stored @p data part in NVRAM, or NULL if the record could not be stored
+    static async(ReplaceFixedAsync, ID page, uint32_t firstWord, Span data, mono_t timeout);
+    //! Adds a new record to a page with the specified ID, removing all records with the same @p firstWord,
+    //! waiting up to @p timeout ticks for the collector to free up space if there is not enough of it
+    //! If a new page is required, a page with variable size records is allocated
+    //! Returns a pointer to the stored @p data part in NVRAM, or NULL if the record could not be stored
+    static async(ReplaceVarAsync, ID page, uint32_t firstWord, Span data, mono_t timeout);
+
+    //! Record for batched writes, the content of the record is concatenation of the @p firstWord and the contents of the @p data @ref Span
+    struct BatchRecord
+    {
+        uint32_t firstWord;
+        Span data;
+    };
+
+    //! Adds multiple records to pages with the specified ID, one after another
+    //! If a new page is required, a page with fixed size records large enough to hold any of the records is allocated
+    //! A single change notification is sent after all the records are stored
+    //! @returns the number of records stored, stops at the first record that could not be stored
+    static size_t AddFixedBatch(ID page, const BatchRecord* records, size_t count) { return BatchImpl(page, records, count, false, false); }
+    //! Adds multiple records to pages with the specified ID, one after another
+    //! If a new page is required, a page with variable size records is allocated
+    //! A single change notification is sent after all the records are stored
+    //! @returns the number of records stored, stops at the first record that could not be stored
+    static size_t AddVarBatch(ID page, const BatchRecord* records, size_t count) { return BatchImpl(page, records, count, true, false); }
+    //! Adds multiple records to pages with the specified ID, removing all older records with the same @p firstWord as each of them
+    //! If a new page is required, a page with fixed size records large enough to hold any of the records is allocated
+    //! A single change notification is sent after all the records are stored
+    //! @returns the number of records stored, stops at the first record that could not be stored
+    static size_t ReplaceFixedBatch(ID page, const BatchRecord* records, size_t count) { return BatchImpl(page, records, count, false, true); }
+    //! Adds multiple records to pages with the specified ID, removing all older records with the same @p firstWord as each of them
+    //! If a new page is required, a page with variable size records is allocated
+    //! A single change notification is sent after all the records are stored
+    //! @returns the number of records stored, stops at the first record that could not be stored
+    static size_t ReplaceVarBatch(ID page, const BatchRecord* records, size_t count) { return BatchImpl(page, records, count, true, true); }
+
     //! Deletes all records with the specified @p firstWord from pages with the specified ID
     //! @returns a boolean indicating whethere at least one record was deleted
     static bool Delete(ID page, uint32_t firstWord);
 
-    //! Allocates a new page with the specified ID and optional fixed record size
-    static const Page* New(ID id, uint32_t recordSize = 0) { return _manager.NewPage(id, recordSize); }
+    //! Record size of pages with variable records that are also followed by their length, allowing them to be walked backwards
+    static constexpr uint32_t VarWithFooter = 1;
+#if NVRAM_VAR_FOOTERS
+    //! Record size used for newly allocated pages with variable records
+    static constexpr uint32_t VarDefault = VarWithFooter;
+#else
+    //! Record size used for newly allocated pages with variable records
+    static constexpr uint32_t VarDefault = 0;
+#endif
+
+    //! Allocates a new page with the specified ID and optional fixed record size (or @ref VarWithFooter)
+    static const Page* New(ID id, uint32_t recordSize = 0) { return Manager::For(id).NewPage(id, recordSize); }
 
     //! Tries to move all records from the old page to the new one
     bool MoveRecords(const Page* newPage, size_t limit) const;
+    //! Determines if all records from the old page would fit on the new one
+    bool CanMoveRecords(const Page* newPage, size_t limit) const;
+    //! Moves the records from up to @ref MergeMaxPages of the @ref MergeScanPages oldest pages that are at most half full
+    //! to a newly allocated page and marks the emptied pages for erasure except for the oldest one. If @p uniqueKeys
+    //! is set, only the newest record of each first word is used and the records superseded by newer ones are dropped.
+    //! @returns the oldest of the merged pages, which no longer contains any records, or NULL if nothing was merged
+    static const Page* MergeRecords(ID id, bool uniqueKeys);
+#if NVRAM_FLASH_ASYNC_WRITE
+    //! Tries to move all records from the old page to the new one, letting other tasks run while the records are written
+    static async(MoveRecordsAsync, const Page* from, const Page* to);
+#endif
 
     //! Returns the first record on the page
     Span FirstRecord() const { return FirstRecordImpl(this); }
     //! Returns the last record on the page
     Span LastRecord() const { return LastRecordImpl(this); }
+    //! Returns the next record on the same page as the specified one
+    static Span NextRecord(const void* rec) { return NextRecordImpl((const uint8_t*)rec); }
     //! Returns the full page data span
     Span PageData() const { return data; }
 
@@ -199,7 +298,7 @@ public:
 private:
     ID id;
     uint16_t sequence;          //< page sequence number, wraps around
-    uint16_t recordSize;        //< fixed record size, or 0 for variable records each prefixed with its size
+    uint16_t recordSize;        //< fixed record size, or 0 for variable records each prefixed with its size, or VarWithFooter
     uint8_t data[PagePayload];  //< page payload, expected to contain records
 
     //! Verifies if the page is completely empty
@@ -236,6 +335,8 @@ private:
     static Span::packed_t FindNewestNextImpl(const Page* p, const uint8_t* stop, uint32_t firstWord, const Page* (*nextPage)(const Page*));
     static Span::packed_t FindOldestFirstImpl(ID pageId, uint32_t firstWord);
     static Span::packed_t FindOldestNextImpl(const uint8_t* rec, uint32_t firstWord);
+    template<uint32_t RecordSize> static Span::packed_t FindFixedForwardImpl(const Page* p, const uint8_t* rec, uint32_t firstWord, const Page* (*nextPage)(const Page*));
+    template<uint32_t RecordSize> static Span::packed_t FindFixedNewestImpl(const Page* p, const uint8_t* stop, uint32_t firstWord, const Page* (*nextPage)(const Page*));
     static Span::packed_t FirstRecordImpl(const Page* p);
     static Span::packed_t LastRecordImpl(const Page* p);
     static Span::packed_t NextRecordImpl(const uint8_t* rec);
@@ -251,8 +352,35 @@ private:
 
     //! Pointer to the start of free space on this page, or NULL if no free space is left
     const uint8_t* FindFree() const;
+    //! Pointer to the location following a record written at the specified location
+    const uint8_t* SkipRecord(const uint8_t* rec, size_t totalLength) const { return rec + (IsFixed() ? recordSize : VarSkip(totalLength)); }
+    //! Quickly verifies that a record can start at the specified location, which must be inside the page
+    bool IsFreeAt(const uint8_t* rec) const { return (IsFixed() ? FirstWord(rec) : VarGetLen(rec)) == ~0u; }
+    //! Determines if the record size value describes pages with fixed size records
+    static constexpr bool IsFixedSize(uint32_t recordSize) { return recordSize > VarWithFooter; }
+    //! Determines if the page holds fixed size records
+    constexpr bool IsFixed() const { return IsFixedSize(recordSize); }
+    //! Determines if the variable records on the page are followed by their length
+    constexpr bool HasFooters() const { return recordSize == VarWithFooter; }
+    //! Returns the space between a variable record on this page and the next one, a zero length is a single write unit
+    constexpr uint32_t VarSkip(uint32_t payloadLen) const { return VarSkipLen(payloadLen) + (payloadLen && HasFooters() ? WriteAlignment : 0); }
+    //! Returns the location following the last variable record on the page
+    const uint8_t* VarEnd() const;
+    //! Returns the variable record preceding the specified location on a page with footers,
+    //! @ref data if there are no more records before it, or NULL if the footers are not consistent
+    const uint8_t* VarPrev(const uint8_t* rec) const;
     //! Compares the relative age of two records
     static int CompareAge(const void* rec1, const void* rec2);
+#if NVRAM_FLASH_DOUBLE_WRITE && NVRAM_UNIQUE_KEY_PAGES
+    //! Determines if the record is a partially shredded version of the newest record of a page type with unique keys,
+    //! left behind when moving the record was interrupted
+    static bool IsShreddedCopy(Span rec);
+#endif
+    //! Determines if there is a newer record with the same first word
+    static bool IsSuperseded(Span rec);
+    //! Shreds the records superseded by newer ones with the same first word
+    //! @returns the bytes used on the page by the remaining records
+    uint32_t DropSuperseded() const;
 
     union LengthAndFlags
     {
@@ -266,37 +394,179 @@ private:
         };
 
         constexpr LengthAndFlags(uint32_t length)
-            : length(uint16_t(length)) {}
+            : length(uint16_t(length)), noNotify(false), var(false) {}
         constexpr LengthAndFlags(uint32_t length, bool var)
-            : length(uint16_t(length)), var(var) {}
+            : length(uint16_t(length)), noNotify(false), var(var) {}
     };
 
     static Span::packed_t AddImpl(ID page, uint32_t firstWord, const void* restOfData, LengthAndFlags totalLengthAndFlags);
     static Span::packed_t ReplaceImpl(ID page, uint32_t firstWord, const void* restOfData, LengthAndFlags totalLengthAndFlags);
+    static async(AddAsyncImpl, ID page, uint32_t firstWord, const void* restOfData, LengthAndFlags totalLengthAndFlags, bool replace, mono_t timeout);
+    static size_t BatchImpl(ID page, const BatchRecord* records, size_t count, bool var, bool replace);
+    //! Locates the newest page with the specified ID and the start of free space on it
+    static void LocateFree(ID page, const Page*& p, const uint8_t*& free);
+    //! Writes a record at the located free space, allocating new pages as needed, and updates the location for the next record
+    static Span::packed_t AppendImpl(ID page, const Page*& p, const uint8_t*& free, uint32_t firstWord, const void* restOfData, LengthAndFlags totalLengthAndFlags, uint32_t allocSize);
+    //! Writes variable records staged in RAM in the same layout they have in NVRAM
+    //! @returns the number of bytes of the staged records that were written
+    static size_t WriteStagedImpl(ID page, const uint8_t* image, size_t length);
+    //! Writes staged variable records that fit on the page starting at the specified free location in as few bursts as possible
+    //! @returns the number of bytes of the staged records that were written, the free location is updated
+    static size_t WriteBurst(const Page* p, const uint8_t*& free, const uint8_t* image, size_t length);
+    //! Reserves space for a variable record written in parts by @ref RecordWriter
+    //! @returns the location of the record, or NULL if there is no space for it
+    static const uint8_t* ReserveStreamedImpl(ID page, size_t totalLength);
+    //! Completes a variable record written in parts, making it valid, and notifies the change,
+    //! optionally shredding the older records with the same first word
+    static Span::packed_t CommitStreamedImpl(ID page, const uint8_t* rec, size_t totalLength, uint32_t firstWord, bool replace);
+    //! Abandons a variable record written in parts
+    static void AbortStreamedImpl(const uint8_t* rec, size_t totalLength);
+    //! Finds the record with the specified first word that is about to be replaced, shredding any older duplicates
+    static Span::packed_t FindReplaced(ID page, uint32_t firstWord);
+    //! Determines if the existing record already contains the data about to be written
+    static bool IsSameRecord(Span rec, const void* restOfData, LengthAndFlags totalLengthAndFlags);
+#if NVRAM_INPLACE_UPDATES
+    //! Reprograms an existing fixed record with the new data if it only clears bits
+    //! @returns false if the data cannot be written in place
+    static bool UpdateInPlace(Span rec, const void* restOfData, LengthAndFlags totalLengthAndFlags);
+#endif
     static Span::packed_t WriteImpl(const uint8_t* free, uint32_t firstWord, const void* restOfData, size_t totalLength);
+    static Span::packed_t WriteSuccess(const Page* p, const uint8_t* rec, size_t totalLength);
+    //! Prepares the space for a variable record, reserving it by writing the length first if possible
+    //! @returns the location of the record, or NULL if it doesn't fit on the page
+    const uint8_t* VarReserve(const uint8_t* free, size_t totalLength) const;
+    //! Writes the parts of a variable record that make it valid, after the payload has been written
+    bool VarCommit(const uint8_t* rec, size_t totalLength, uint32_t firstWord) const;
 
     static constexpr uint32_t VarGetLen(const void* rec) { return ((const uint32_t*)rec)[-1]; }
     static constexpr uint32_t VarSkipLen(uint32_t payloadLen) { return RequiredAligned(payloadLen + 4); }
-    static constexpr const uint8_t* VarNext(const void* rec) { return (const uint8_t*)rec + VarSkipLen(VarGetLen(rec)); }
+    //! Checks that a variable record length read at @p rec does not reach past @p pe,
+    //! a length damaged by an interrupted shred makes the rest of the page unwalkable
+    static constexpr bool VarFits(const uint8_t* rec, uint32_t len, const uint8_t* pe) { return len <= uint32_t(pe - rec); }
 
     static constexpr uint32_t FirstWord(const void* rec) { return ((const uint32_t*)rec)[0]; }
+    //! Returns the @ref Span of a valid record at the specified location
+    static Span RecordSpan(const void* rec) { return Span(rec, FromPtrInline(rec)->IsFixed() ? FromPtrInline(rec)->recordSize : VarGetLen(rec)); }
 
     static constexpr Span::packed_t OffsetPackedData(Span::packed_t data, int offset) { Span res(data); if (res) { res = Span(res.Pointer() + offset, res.Length() - offset); } return res; }
 
     static RELEASE_ALWAYS_INLINE const Page* FromPtrInline(const void* ptr)
     {
         uintptr_t firstPageInBlock = ((uintptr_t)ptr & BlockMask) + BlockHeader;
-        ASSERT(firstPageInBlock > (uintptr_t)_manager.Blocks().begin() && firstPageInBlock < (uintptr_t)_manager.Blocks().end());
+        ASSERT(firstPageInBlock > (uintptr_t)Manager::Containing(ptr).Blocks().begin() && firstPageInBlock < (uintptr_t)Manager::Containing(ptr).Blocks().end());
+        if (Block::FromPtr(ptr)->IsLarge())
+            return (const Page*)firstPageInBlock;
         return (const Page*)((uintptr_t)ptr - ((uintptr_t)ptr - firstPageInBlock) % PageSize);
     }
 
 #if NVRAM_FLASH_DOUBLE_WRITE
     static void ShredRecord(const void* ptr);
 #else
-    static void ShredRecord(const void* ptr) { Flash::ShredWord(ptr); }
+    static void ShredRecord(const void* ptr)
+    {
+        NVRAM_STATS_ADD(Manager::Containing(ptr), recordShreds, 1);
+        EraseSuspension suspend(ptr);
+        Flash::ShredWord(ptr);
+    }
 #endif
 
     friend class Manager;
+    friend class KeyIndex;
+    friend class WriteBuffer;
+    friend class RecordWriter;
+    friend class Transaction;
 };
 
+/*!
+ * Same as @ref Page::FindForwardNextImpl, with the stride and bounds of the records known at compile time
+ */
+template<uint32_t RecordSize> Span::packed_t Page::FindFixedForwardImpl(const Page* p, const uint8_t* rec, uint32_t firstWord, const Page* (*nextPage)(const Page*))
+{
+    static_assert(IsFixedSize(RecordSize) && RecordSize == RequiredAligned(RecordSize), "record size must be aligned like records written to fixed pages");
+    constexpr uint32_t Count = PagePayload / RecordSize, LargeCount = LargePagePayload / RecordSize;
+    NVRAM_STATS_ADD(Manager::Containing(p), lookups, 1);
+
+    do
+    {
+        if (p->recordSize != RecordSize)
+        {
+            // different layout, continue with the generic search
+            return FindForwardNextImpl(p, rec, firstWord, nextPage);
+        }
+
+#if NVRAM_PAGE_FILTERS
+        if (firstWord && !Manager::Containing(p).FilterMayContain(p, firstWord))
+        {
+            // the key cannot be on this page
+            rec = NULL;
+            continue;
+        }
+#endif
+
+        NVRAM_STATS_ADD(Manager::Containing(p), pagesScanned, 1);
+        const uint8_t* end = p->data + (p->Block()->IsLarge() ? LargeCount : Count) * RecordSize;
+        for (rec = rec ? rec + RecordSize : p->data; rec != end; rec += RecordSize)
+        {
+            NVRAM_STATS_ADD(Manager::Containing(p), recordsWalked, 1);
+            uint32_t first = FirstWord(rec);
+            if (first != 0 && first != ~0u && (firstWord == 0 || first == firstWord))
+            {
+                return Span(rec, RecordSize);
+            }
+        }
+
+        // try the next page
+        rec = NULL;
+    } while ((p = nextPage ? nextPage(p) : NULL));
+
+    return Span();
+}
+
+/*!
+ * Same as @ref Page::FindNewestNextImpl, with the stride and bounds of the records known at compile time
+ *
+ * The records are walked backwards from the stop record, so that the newest match is found first.
+ */
+template<uint32_t RecordSize> Span::packed_t Page::FindFixedNewestImpl(const Page* p, const uint8_t* stop, uint32_t firstWord, const Page* (*nextPage)(const Page*))
+{
+    static_assert(IsFixedSize(RecordSize) && RecordSize == RequiredAligned(RecordSize), "record size must be aligned like records written to fixed pages");
+    constexpr uint32_t Count = PagePayload / RecordSize, LargeCount = LargePagePayload / RecordSize;
+    NVRAM_STATS_ADD(Manager::Containing(p), lookups, 1);
+
+    do
+    {
+        if (p->recordSize != RecordSize)
+        {
+            // different layout, continue with the generic search
+            return FindNewestNextImpl(p, stop, firstWord, nextPage);
+        }
+
+#if NVRAM_PAGE_FILTERS
+        if (firstWord && !Manager::Containing(p).FilterMayContain(p, firstWord))
+        {
+            // the key cannot be on this page
+            continue;
+        }
+#endif
+
+        NVRAM_STATS_ADD(Manager::Containing(p), pagesScanned, 1);
+        const uint8_t* end = p->data + (p->Block()->IsLarge() ? LargeCount : Count) * RecordSize;
+        const uint8_t* rec = stop >= p->data && stop < end ? stop : end;
+        while (rec != p->data)
+        {
+            rec -= RecordSize;
+            NVRAM_STATS_ADD(Manager::Containing(p), recordsWalked, 1);
+            uint32_t first = FirstWord(rec);
+            if (first != 0 && first != ~0u && (firstWord == 0 || first == firstWord))
+            {
+                return Span(rec, RecordSize);
+            }
+        }
+
+        // try the next page
+    } while ((p = nextPage ? nextPage(p) : NULL));
+
+    return Span();
+}
+
 }
@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2026 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * nvram/RecordWriter.cpp
+ */
+
+#include <nvram/nvram.h>
+#include <nvram/RecordWriter.h>
+
+#define MYDBG(...)  DBGCL("nvram", __VA_ARGS__)
+
+namespace nvram
+{
+
+bool RecordWriter::Begin(size_t totalLength)
+{
+    Abort();
+
+    if (totalLength < 4)
+    {
+        // every record must contain at least the first word
+        return false;
+    }
+
+    if (!(rec = Page::ReserveStreamedImpl(pageId, totalLength)))
+    {
+        return false;
+    }
+
+    length = totalLength;
+    done = 0;
+    return true;
+}
+
+bool RecordWriter::Begin(ID key, size_t length)
+{
+    uint32_t firstWord = key;
+    return Begin(length + 4) && Append(Span(firstWord));
+}
+
+/*!
+ * Programs the data at the current position in the record
+ *
+ * Whole write units are programmed directly from the provided data,
+ * only the parts of write units that are not yet complete are copied
+ * to RAM and programmed once the following data is appended.
+ */
+bool RecordWriter::Append(Span data)
+{
+    if (!rec || done + data.Length() > length)
+    {
+        Abort();
+        return false;
+    }
+
+    const uint8_t* src = data;
+    size_t n = data.Length();
+    EraseSuspension suspend(rec);
+
+    // the first word is kept in RAM until the record is committed
+    for (; n && done < 4; n--)
+    {
+        ((uint8_t*)&first)[done++] = *src++;
+    }
+
+    while (n)
+    {
+        size_t fill = (done - 4) % WriteAlignment;
+        size_t chunk;
+
+        if (!fill && (n >= WriteAlignment || done + n == length))
+        {
+            // whole write units, the last one can be incomplete only at the end of the record
+            chunk = done + n == length ? n : n - n % WriteAlignment;
+            if (!Flash::Write(rec + done, Span(src, chunk)))
+            {
+                break;
+            }
+        }
+        else
+        {
+            // complete the unit in RAM first
+            chunk = WriteAlignment - fill;
+            if (chunk > n)
+            {
+                chunk = n;
+            }
+            memcpy(pending + fill, src, chunk);
+            if ((fill + chunk == WriteAlignment || done + chunk == length) &&
+                !Flash::Write(rec + done - fill, Span(pending, fill + chunk)))
+            {
+                break;
+            }
+        }
+
+        done += chunk;
+        src += chunk;
+        n -= chunk;
+    }
+
+    if (n)
+    {
+        MYDBG("Failed to write streamed record @ %08X + %d", rec, done);
+        Abort();
+        return false;
+    }
+
+    return true;
+}
+
+bool RecordWriter::Append(const Span* parts, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!Append(parts[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+Span RecordWriter::Commit(bool replace)
+{
+    if (!rec || done != length)
+    {
+        Abort();
+        return Span();
+    }
+
+    Span res = Page::CommitStreamedImpl(pageId, rec, length, first, replace);
+    if (!res)
+    {
+        Abort();
+    }
+
+    rec = NULL;
+    return res;
+}
+
+void RecordWriter::Abort()
+{
+    if (rec)
+    {
+        MYDBG("Abandoning streamed record @ %08X", rec);
+        Page::AbortStreamedImpl(rec, length);
+        rec = NULL;
+    }
+}
+
+Span RecordWriter::Add(ID key, const Span* parts, size_t count)
+{
+    size_t length = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        length += parts[i].Length();
+    }
+
+    if (!Begin(key, length) || !Append(parts, count))
+    {
+        return Span();
+    }
+
+    return Commit();
+}
+
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2026 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * nvram/RecordWriter.h
+ *
+ * Streaming writer for variable size records assembled from multiple buffers
+ */
+
+#pragma once
+
+#include <nvram/Page.h>
+
+namespace nvram
+{
+
+//! Writes a variable size record directly to NVRAM in parts, without assembling it in RAM
+//!
+//! The space for the record is reserved on the newest page when it is started,
+//! the parts are programmed as they are appended and the first word is written
+//! last when the record is committed, so the record is not visible to readers
+//! until it is complete. Only incomplete write units are kept in RAM.
+//!
+//! The record must be committed or aborted before yielding to other tasks,
+//! as the collector could otherwise relocate the page holding the record.
+//!
+//! With NVRAM_FLASH_DOUBLE_WRITE, nothing is written to mark the reserved space
+//! until the record is committed, so no other records may be written to the same
+//! page in the meantime (they would be placed over the reserved space) and only
+//! one record can be written in parts at a time, which is checked by assertions.
+class RecordWriter
+{
+public:
+    constexpr RecordWriter(ID pageId) : pageId(pageId) {}
+    ~RecordWriter() { Abort(); }
+
+    //! Reserves space for a record of the specified total length, including the first word
+    //! @returns false if no space could be reserved
+    bool Begin(size_t totalLength);
+    //! Reserves space for a record with the specified key, followed by @p length bytes of data
+    //! @returns false if no space could be reserved
+    bool Begin(ID key, size_t length);
+    //! Writes the next part of the record
+    //! @returns false if the part doesn't fit in the reserved space or could not be written, the record is aborted
+    bool Append(Span data);
+    //! Writes the next parts of the record
+    //! @returns false if the parts don't fit in the reserved space or could not be written, the record is aborted
+    bool Append(const Span* parts, size_t count);
+    //! Completes the record, which must be filled completely, and sends a change notification,
+    //! if @p replace is set, the older records with the same first word are deleted
+    //! @returns the complete record including the first word, or an empty @ref Span if it could not be written
+    Span Commit(bool replace = false);
+    //! Abandons the record being written, if any
+    void Abort();
+
+    //! Writes a complete record with the specified key assembled from multiple parts
+    //! @returns the complete record including the key, or an empty @ref Span if it could not be written
+    Span Add(ID key, const Span* parts, size_t count);
+
+    //! Determines if a record is being written
+    bool Active() const { return rec; }
+    //! Returns the number of bytes that remain to be appended to the record
+    size_t Remaining() const { return length - done; }
+
+    const uint32_t pageId;
+
+private:
+    const uint8_t* rec = NULL;
+    size_t length = 0;
+    size_t done = 0;
+    uint32_t first = 0;
+    alignas(WriteAlignment) uint8_t pending[WriteAlignment] = {};
+};
+
+}
@@ -0,0 +1,278 @@
+/*
+ * Copyright (c) 2026 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * nvram/Ring.cpp
+ */
+
+#include <nvram/nvram.h>
+#include <nvram/Ring.h>
+
+#define MYDBG(...)  DBGCL("nvram", __VA_ARGS__)
+
+namespace nvram
+{
+
+Ring::~Ring()
+{
+    // registrations are discarded each time NVRAM is initialized
+    if (collectorMount && collectorMount == Manager::For(pageId).mountCount)
+    {
+        Manager::For(pageId).UnregisterCollector(pageId, collectorLevel);
+    }
+}
+
+void Ring::RegisterCollector(unsigned level, CollectorDelegate collector)
+{
+    auto& manager = Manager::For(pageId);
+    if (collectorMount && collectorMount == manager.mountCount && collectorLevel != level)
+    {
+        // only the last registration is removed on destruction
+        manager.UnregisterCollector(pageId, collectorLevel);
+    }
+
+    manager.RegisterCollector(pageId, level, collector);
+    collectorMount = manager.mountCount;
+    collectorLevel = level;
+}
+
+bool Ring::Current()
+{
+    if (!filled || mount != Manager::For(pageId).mountCount ||
+        (count && (!IsValid(At(0)) || !IsValid(At(count - 1)))))
+    {
+        Fill();
+    }
+
+    return !overflow;
+}
+
+void Ring::Fill()
+{
+    mount = Manager::For(pageId).mountCount;
+    filled = true;
+    overflow = false;
+    first = count = 0;
+
+    for (auto p = Page::First(pageId); p; p = p->Next())
+    {
+        if (count == capacity)
+        {
+            MYDBG("WARNING - Too many pages %.4s for a ring with %d entries", &pageId, capacity);
+            overflow = true;
+            return;
+        }
+
+        // keep the entries ordered by sequence
+        unsigned i = count++;
+        for (; i && OVF_LT(p->Sequence(), At(i - 1).sequence); i--)
+        {
+            At(i) = At(i - 1);
+        }
+        At(i) = { p, p->Sequence() };
+    }
+}
+
+Span::packed_t Ring::FirstImpl()
+{
+    if (!Current())
+    {
+        return Page::FindOldestFirst(pageId);
+    }
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        if (Span rec = At(i).page->FirstRecord())
+        {
+            return rec;
+        }
+    }
+
+    return Span();
+}
+
+Span::packed_t Ring::NextImpl(const uint8_t* rec)
+{
+    if (Span next = Page::NextRecord(rec))
+    {
+        return next;
+    }
+
+    if (!Current())
+    {
+        return Page::FindOldestNext(rec);
+    }
+
+    return FirstAfter(Page::FromPtr(rec)->Sequence());
+}
+
+Span::packed_t Ring::FirstAfter(uint16_t sequence)
+{
+    for (unsigned i = 0; i < count; i++)
+    {
+        auto& e = At(i);
+        if (!OVF_LT(sequence, e.sequence))
+        {
+            continue;
+        }
+
+        if (!IsValid(e))
+        {
+            // a page has been replaced in the middle of the log, start over
+            Fill();
+            return overflow ? ScanAfter(sequence) : FirstAfter(sequence);
+        }
+
+        if (Span rec = e.page->FirstRecord())
+        {
+            return rec;
+        }
+    }
+
+    return Span();
+}
+
+Span::packed_t Ring::ScanAfter(uint16_t sequence)
+{
+    const Page* next = NULL;
+    for (auto p = Page::First(pageId); p; p = p->Next())
+    {
+        if (OVF_LT(sequence, p->Sequence()) && (!next || OVF_LT(p->Sequence(), next->Sequence())))
+        {
+            next = p;
+        }
+    }
+
+    for (; next; next = next->OldestNext())
+    {
+        if (Span rec = next->FirstRecord())
+        {
+            return rec;
+        }
+    }
+
+    return Span();
+}
+
+Span::packed_t Ring::AfterImpl(Cursor cursor)
+{
+    if (!cursor.offset)
+    {
+        return FirstImpl();
+    }
+
+    if (!Current())
+    {
+        // locate the page the hard way
+        for (auto p = Page::First(pageId); p; p = p->Next())
+        {
+            if (p->Sequence() == cursor.sequence)
+            {
+                return NextImpl((const uint8_t*)p + cursor.offset);
+            }
+        }
+        return ScanAfter(cursor.sequence);
+    }
+
+    if (count && OVF_LT(cursor.sequence, At(0).sequence))
+    {
+        // the page has been discarded in the meantime, continue with the oldest record
+        return FirstImpl();
+    }
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        auto& e = At(i);
+        if (e.sequence == cursor.sequence)
+        {
+            if (!IsValid(e))
+            {
+                // the page has been replaced, start over
+                Fill();
+                return AfterImpl(cursor);
+            }
+
+            if (Span rec = Page::NextRecord((const uint8_t*)e.page + cursor.offset))
+            {
+                return rec;
+            }
+            break;
+        }
+    }
+
+    return FirstAfter(cursor.sequence);
+}
+
+Span::packed_t Ring::NewestImpl()
+{
+    if (!Current())
+    {
+        return Page::FindNewestFirst(pageId);
+    }
+
+    for (unsigned i = count; i--;)
+    {
+        if (Span rec = At(i).page->LastRecord())
+        {
+            return rec;
+        }
+    }
+
+    return Span();
+}
+
+void Ring::Added(const void* rec)
+{
+    if (!Current())
+    {
+        return;
+    }
+
+    auto p = Page::FromPtr(rec);
+    if (count && At(count - 1).page == p)
+    {
+        return;
+    }
+
+    if (count && !OVF_LT(At(count - 1).sequence, p->Sequence()))
+    {
+        // not the newest page, something else has changed the pages
+        Fill();
+    }
+    else if (count == capacity)
+    {
+        MYDBG("WARNING - Too many pages %.4s for a ring with %d entries", &pageId, capacity);
+        overflow = true;
+    }
+    else
+    {
+        At(count++) = { p, p->Sequence() };
+    }
+}
+
+const Page* Ring::Discard()
+{
+    if (!Current())
+    {
+        return Page::OldestFirst(pageId);
+    }
+
+    if (!count)
+    {
+        return NULL;
+    }
+
+    auto p = At(0).page;
+    first = (first + 1) % capacity;
+    count--;
+    return p;
+}
+
+Ring::Cursor Ring::Position(const void* rec)
+{
+    auto p = Page::FromPtr(rec);
+    return { p->Sequence(), uint16_t((const uint8_t*)rec - (const uint8_t*)p) };
+}
+
+}
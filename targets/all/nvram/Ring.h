@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2026 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * nvram/Ring.h
+ *
+ * RAM index of the pages of a circular log in sequence order
+ */
+
+#pragma once
+
+#include <nvram/Page.h>
+
+namespace nvram
+{
+
+//! Keeps the pages of a single type ordered from oldest to newest in RAM,
+//! so that the log can be traversed and the oldest page discarded without scanning the pages
+//!
+//! The order is built lazily on first use, extended as records are written through
+//! @ref Added and rebuilt when the oldest or newest page is found to have been replaced
+//! or NVRAM has been reinitialized. If there are more pages than it can hold,
+//! the regular page scans are used instead.
+class Ring
+{
+public:
+    //! Position of a record in the log, independent of its location in memory so it can be stored in NVRAM as well
+    //! A zero-initialized cursor is positioned before the oldest record
+    struct Cursor
+    {
+        uint16_t sequence;      //< sequence number of the page containing the record
+        uint16_t offset;        //< offset of the record from the start of the page, zero before the oldest record
+    };
+
+#if NVRAM_LARGE_PAGES
+    static_assert(LargePageSize <= 0x10000, "offsets of the records on large pages do not fit in Ring::Cursor");
+#else
+    static_assert(PageSize <= 0x10000, "offsets of the records on pages do not fit in Ring::Cursor");
+#endif
+
+    //! Returns the position of the specified record
+    static Cursor Position(const void* rec);
+
+    //! Removes the collector registered through the ring, unless NVRAM has been initialized since
+    ~Ring();
+
+protected:
+    struct Entry
+    {
+        const Page* page;       //< page of the log
+        uint16_t sequence;      //< sequence number of the page, to detect that it has been erased
+    };
+
+    constexpr Ring(ID pageId, Entry* entries, size_t capacity)
+        : pageId(pageId), entries(entries), capacity(capacity) {}
+
+    //! Returns the oldest record
+    Span First() { return FirstImpl(); }
+    //! Returns the record following the specified one
+    Span Next(const void* rec) { return NextImpl((const uint8_t*)rec); }
+    //! Returns the record following the specified position
+    Span After(Cursor cursor) { return AfterImpl(cursor); }
+    //! Returns the newest record
+    Span Newest() { return NewestImpl(); }
+    //! Records the page of a newly written record, if it is a new one
+    void Added(const void* rec);
+    //! Removes the oldest page from the ring and returns it, to be used as a collector
+    const Page* Discard();
+    //! Registers the collector for the page type at the specified level, it is removed when the ring is destroyed
+    void RegisterCollector(unsigned level, CollectorDelegate collector);
+
+    const ID pageId;
+
+private:
+    Entry* entries;
+    uint16_t capacity;
+    uint16_t first = 0;
+    uint16_t count = 0;
+    unsigned mount = 0;
+    unsigned collectorMount = 0;
+    unsigned collectorLevel = 0;
+    bool filled = false;
+    bool overflow = false;
+
+    Span::packed_t FirstImpl();
+    Span::packed_t NextImpl(const uint8_t* rec);
+    Span::packed_t AfterImpl(Cursor cursor);
+    Span::packed_t NewestImpl();
+    //! Returns the first record on pages newer than the specified sequence number
+    Span::packed_t FirstAfter(uint16_t sequence);
+    //! Same as @ref FirstAfter, scanning the pages when the ring cannot be used
+    Span::packed_t ScanAfter(uint16_t sequence);
+
+    //! Returns the entry at the specified position from the oldest one
+    Entry& At(unsigned i) const { return entries[(first + i) % capacity]; }
+    //! Determines if the entry still refers to a page of the log
+    bool IsValid(const Entry& e) const { return e.page->GetID() == pageId && e.page->Sequence() == e.sequence; }
+    //! Rebuilds the ring if needed
+    //! @returns false if the ring cannot hold all the pages and they must be scanned instead
+    bool Current();
+    //! Reads all page headers to build the ring
+    void Fill();
+};
+
+//! @ref Ring with storage for the specified number of pages
+template<size_t Capacity> class RingTable : public Ring
+{
+public:
+    constexpr RingTable(ID pageId)
+        : Ring(pageId, entries, Capacity), entries{} {}
+
+    using Ring::First;
+    using Ring::Next;
+    using Ring::After;
+    using Ring::Newest;
+    using Ring::Added;
+    using Ring::Discard;
+    using Ring::RegisterCollector;
+
+private:
+    Entry entries[Capacity];
+};
+
+}
@@ -13,7 +13,7 @@ namespace nvram
 
 Setting* Settings::GetSetting(ID id)
 {
-    for (auto setting: *this)
+    for (auto setting = Bucket(id); setting; setting = setting->nextInBucket)
     {
         if (setting->GetID() == id)
             return setting;
@@ -22,6 +22,30 @@ Setting* Settings::GetSetting(ID id)
     return NULL;
 }
 
+Setting* Settings::Bucket(ID id)
+{
+    if (!indexed)
+    {
+        BuildIndex();
+    }
+
+    return buckets[id & (SettingsBuckets - 1)];
+}
+
+void Settings::BuildIndex()
+{
+    // settings are prepended to the chains, walk backwards so that the first one wins for duplicate IDs
+    for (auto it = end(); it != begin();)
+    {
+        auto setting = *--it;
+        auto& bucket = buckets[setting->GetID() & (SettingsBuckets - 1)];
+        setting->nextInBucket = bucket;
+        bucket = setting;
+    }
+
+    indexed = true;
+}
+
 Setting* Settings::GetNotifySetting()
 {
     for (auto setting: *this)
@@ -58,6 +82,48 @@ bool Settings::InitVersionTracking(uint16_t& ver)
     return false;
 }
 
+/*!
+ * Walks the stored records once, updating each setting from the first record
+ * found with its ID, the same one a separate lookup would return,
+ * and resets settings without a record to their default values
+ */
+void Settings::Reload()
+{
+    uint16_t current;
+    if (version == ~0u)
+    {
+        InitVersionTracking(current);
+    }
+    current = version;
+
+    for (auto setting: *this)
+    {
+        setting->version = current - 1;
+    }
+
+    for (Span rec = Page::FindUnorderedFirst(storage.pageId); rec; rec = Page::FindUnorderedNext(rec))
+    {
+        uint32_t id = rec.Element<uint32_t>();
+        for (auto setting = Bucket(id); setting; setting = setting->nextInBucket)
+        {
+            if (setting->GetID() == id && setting->version != current)
+            {
+                setting->Update(Span(rec.Pointer() + 4, rec.Length() - 4));
+                setting->version = current;
+            }
+        }
+    }
+
+    for (auto setting: *this)
+    {
+        if (setting->version != current)
+        {
+            setting->Update(Span());
+            setting->version = current;
+        }
+    }
+}
+
 async(Settings::VersionChange)
 async_def()
 {
@@ -67,12 +133,25 @@ async_end
 
 Span::packed_t Setting::GetImpl()
 {
-    return spec.Owner().IsCurrentVersion(version) ? (Span::packed_t)value : Load();
+    auto& owner = spec.Owner();
+    if (!owner.IsCurrentVersion(version))
+    {
+        if (owner.GetSetting(GetID()) == this)
+        {
+            // other settings are usually read after a change as well, refresh them all at once
+            owner.Reload();
+        }
+        else
+        {
+            // not part of the table of the owner, load just this one
+            Update(spec.Get());
+        }
+    }
+    return value;
 }
 
-Span::packed_t Setting::Load()
+void Setting::Update(Span val)
 {
-    auto val = spec.Get();
     if (!val || val.Length() < spec.ValueLength())
     {
         val = spec.DefaultValue();
@@ -81,7 +160,7 @@ Span::packed_t Setting::Load()
     {
         notify = true;
     }
-    return value = val;
+    value = val;
 }
 
 Span::packed_t Setting::SetImpl(Span value)
@@ -18,6 +18,15 @@ class Setting;
 typedef Setting* SettingPtr;
 typedef const SettingPtr* SettingIterator;
 
+//! Number of hash buckets used to look up settings by ID, must be a power of two
+#ifdef NVRAM_SETTINGS_BUCKETS
+constexpr size_t SettingsBuckets = NVRAM_SETTINGS_BUCKETS;
+#else
+constexpr size_t SettingsBuckets = 32;
+#endif
+
+static_assert(SettingsBuckets && !(SettingsBuckets & (SettingsBuckets - 1)), "NVRAM_SETTINGS_BUCKETS must be a power of two");
+
 class Settings
 {
 public:
@@ -26,10 +35,14 @@ public:
     {
     }
 
+    //! Returns the setting with the specified ID, or NULL if there is none
     Setting* GetSetting(ID id);
     Setting* GetNotifySetting();
+    //! Refreshes the cached values of all settings in a single pass over the stored records
+    void Reload();
     Span Get(ID id) const { return storage.Get(id); }
     Span Set(ID id, Span value) const { return storage.Set(id, value); }
+    size_t SetBatch(const Page::BatchRecord* values, size_t count) const { return storage.SetBatch(values, count); }
     bool Delete(ID id) const { return storage.Delete(id); }
 
     const SettingPtr* begin() const { return first; }
@@ -42,7 +55,14 @@ private:
     unsigned version;
     const SettingPtr* first;
     const SettingPtr* last;
-
+    //! Settings chained by the low bits of their IDs, built on first lookup
+    Setting* buckets[SettingsBuckets] = {};
+    bool indexed = false;
+
+    //! Returns the first setting in the bucket for the specified ID
+    Setting* Bucket(ID id);
+    //! Chains all the settings into @ref buckets
+    void BuildIndex();
     bool IsCurrentVersion(uint16_t& version);
     bool InitVersionTracking(uint16_t& version);
 
@@ -109,10 +129,13 @@ private:
     uint16_t version = 0;
     bool notify = false;
     Span value;
+    //! Next setting in the same bucket of the owner
+    Setting* nextInBucket = NULL;
 
     Span::packed_t GetImpl();
     Span::packed_t SetImpl(Span value);
-    Span::packed_t Load();
+    //! Updates the cached value with a stored one, using the default if it is missing or too short
+    void Update(Span stored);
 
     friend class Settings;
 };
@@ -11,6 +11,8 @@
 #pragma once
 
 #include <nvram/Page.h>
+#include <nvram/KeyIndex.h>
+#include <nvram/Ring.h>
 
 namespace nvram
 {
@@ -21,24 +23,36 @@ template<typename T> struct FixedStorage
     constexpr FixedStorage(ID pageId = T::PageID) : pageId(pageId) {}
 
     //! Returns the first record in no specific order
-    const T* UnorderedFirst() const { return (const T*)Page::FindUnorderedFirst(pageId); }
+    const T* UnorderedFirst() const { return (const T*)Page::FindUnorderedFirstFixed<RecordSize>(pageId); }
     //! Returns the next record in no specific order
-    const T* UnorderedNext(const T* after) const { return (const T*)Page::FindUnorderedNext(after); }
+    const T* UnorderedNext(const T* after) const { return (const T*)Page::FindUnorderedNextFixed<RecordSize>(after); }
     //! Returns the newest record
-    const T* NewestFirst() const { return (const T*)Page::FindNewestFirst(pageId); }
+    const T* NewestFirst() const { return (const T*)Page::FindNewestFirstFixed<RecordSize>(pageId); }
     //! Returns the next older record
-    const T* NewestNext(const T* after) const { return (const T*)Page::FindNewestNext(after); }
+    const T* NewestNext(const T* after) const { return (const T*)Page::FindNewestNextFixed<RecordSize>(after); }
     //! Returns the oldest record
-    const T* OldestFirst() const { return (const T*)Page::FindOldestFirst(pageId); }
+    const T* OldestFirst() const { return (const T*)Page::FindOldestFirstFixed<RecordSize>(pageId); }
     //! Returns the next newer record
-    const T* OldestNext(const T* after) const { return (const T*)Page::FindOldestNext(after); }
+    const T* OldestNext(const T* after) const { return (const T*)Page::FindOldestNextFixed<RecordSize>(after); }
 
     //! Adds a new record, returns pointer to the new record in NVRAM or NULL if the record could not be written
     const T* Add(const T* record) const { return Page::AddFixed(pageId, Span(record, sizeof(T))); }
     //! Adds a new record, returns pointer to the new record in NVRAM or NULL if the record could not be written
     const T* Add(const T& record) const { return Add(&record); }
+    //! Adds a new record, waiting up to @p timeout ticks for the collector to free up space if needed,
+    //! returns pointer to the new record in NVRAM or NULL if the record could not be written
+    async(AddAsync, const T& record, mono_t timeout) const
+    async_def()
+    {
+        async_return(await(Page::AddFixedAsync, pageId, Span(&record, sizeof(T)), timeout));
+    }
+    async_end
 
     const uint32_t pageId;
+
+private:
+    //! Size of the records on pages written by the storage
+    static constexpr uint32_t RecordSize = RequiredAligned(sizeof(T));
 };
 
 //! Helper for NVRAM storage pages with variable size records
@@ -62,6 +76,14 @@ struct VariableStorage
     //! Adds a new record, returns a @ref Span representing the new record in NVRAM,
     //! or an invalid @ref Span if the record could not be written
     Span Add(Span data) const { return Page::AddVar(pageId, data); }
+    //! Adds a new record, waiting up to @p timeout ticks for the collector to free up space if needed,
+    //! returns pointer to the new record in NVRAM or NULL if the record could not be written
+    async(AddAsync, Span data, mono_t timeout) const
+    async_def()
+    {
+        async_return(await(Page::AddVarAsync, pageId, data, timeout));
+    }
+    async_end
 
     const uint32_t pageId;
 };
@@ -72,22 +94,22 @@ template<typename T> struct FixedKeyStorage
     constexpr FixedKeyStorage(ID pageId = T::PageID) : pageId(pageId) {}
 
     //! Returns the first record with the specified key, in no specific order
-    const T* UnorderedFirst(ID key) const { return KeyToPtr(Page::FindUnorderedFirst(pageId, key)); }
+    const T* UnorderedFirst(ID key) const { return KeyToPtr(Page::FindUnorderedFirstFixed<RecordSize>(pageId, key)); }
     //! Returns the next record with the same key in no specific order
-    const T* UnorderedNext(const T* after) const { return KeyToPtr(Page::FindUnorderedNext(PtrToKey(after), KeyFromPtr(after))); }
+    const T* UnorderedNext(const T* after) const { return KeyToPtr(Page::FindUnorderedNextFixed<RecordSize>(PtrToKey(after), KeyFromPtr(after))); }
     //! Returns the newest record with the specified key
-    const T* NewestFirst(ID key) const { return KeyToPtr(Page::FindNewestFirst(pageId, key)); }
+    const T* NewestFirst(ID key) const { return KeyToPtr(Page::FindNewestFirstFixed<RecordSize>(pageId, key)); }
     //! Returns the next older record with the same key
-    const T* NewestNext(const T* after) const { return KeyToPtr(Page::FindNewestNext(PtrToKey(after), KeyFromPtr(after))); }
+    const T* NewestNext(const T* after) const { return KeyToPtr(Page::FindNewestNextFixed<RecordSize>(PtrToKey(after), KeyFromPtr(after))); }
     //! Returns the oldest record with the specified key
-    const T* OldestFirst(ID key) const { return KeyToPtr(Page::FindOldestFirst(pageId, key)); }
+    const T* OldestFirst(ID key) const { return KeyToPtr(Page::FindOldestFirstFixed<RecordSize>(pageId, key)); }
     //! Returns the next newer record with the same key
-    const T* OldestNext(const T* after) const { return KeyToPtr(Page::FindOldestNext(PtrToKey(after), KeyFromPtr(after))); }
+    const T* OldestNext(const T* after) const { return KeyToPtr(Page::FindOldestNextFixed<RecordSize>(PtrToKey(after), KeyFromPtr(after))); }
 
     //! Returns the first record and its associated key in no specified order
-    const T* EnumerateUnorderedFirst(ID& key) const { return KeyToPtr(Page::FindUnorderedFirst(pageId), key); }
+    const T* EnumerateUnorderedFirst(ID& key) const { return KeyToPtr(Page::FindUnorderedFirstFixed<RecordSize>(pageId), key); }
     //! Returns the next record and its associated key in no specified order
-    const T* EnumerateUnorderedNext(const T* after, ID& key) const { return KeyToPtr(Page::FindUnorderedNext(PtrToKey(after)), key); }
+    const T* EnumerateUnorderedNext(const T* after, ID& key) const { return KeyToPtr(Page::FindUnorderedNextFixed<RecordSize>(PtrToKey(after)), key); }
 
     //! Adds a new record with the specified key, returns a pointer to the new record in NVRAM,
     //! or NULL if the record could not be written
@@ -103,6 +125,28 @@ template<typename T> struct FixedKeyStorage
     //! returns a pointer to the new record in NVRAM,
     //! or NULL if the record could not be written
     const T* Replace(ID key, const T& record) const { return Replace(key, &record); }
+    //! Adds a new record with the specified key, waiting up to @p timeout ticks for the collector to free up space if needed,
+    //! returns a pointer to the new record in NVRAM or NULL if the record could not be written
+    async(AddAsync, ID key, const T& record, mono_t timeout) const
+    async_def()
+    {
+        async_return(await(Page::AddFixedAsync, pageId, key, Span(&record, sizeof(T)), timeout));
+    }
+    async_end
+    //! Replaces all records with the specified key with a new one, waiting up to @p timeout ticks for the collector to free up space if needed,
+    //! returns a pointer to the new record in NVRAM or NULL if the record could not be written
+    async(ReplaceAsync, ID key, const T& record, mono_t timeout) const
+    async_def()
+    {
+        async_return(await(Page::ReplaceFixedAsync, pageId, key, Span(&record, sizeof(T)), timeout));
+    }
+    async_end
+    //! Adds multiple records (each of @p T size) with the specified keys, sending a single change notification
+    //! @returns the number of records stored
+    size_t AddBatch(const Page::BatchRecord* records, size_t count) const { return Page::AddFixedBatch(pageId, records, count); }
+    //! Replaces all records with the specified keys with new ones (each of @p T size), sending a single change notification
+    //! @returns the number of records stored
+    size_t ReplaceBatch(const Page::BatchRecord* records, size_t count) const { return Page::ReplaceFixedBatch(pageId, records, count); }
     //! Deletes all records with the specified key
     //! @returns a boolean indicating whethere at least one record was deleted
     bool Delete(ID key) const { return Page::Delete(pageId, key); }
@@ -110,6 +154,9 @@ template<typename T> struct FixedKeyStorage
     const uint32_t pageId;
 
 private:
+    //! Size of the records on pages written by the storage, including the key
+    static constexpr uint32_t RecordSize = RequiredAligned(sizeof(T) + 4);
+
     static constexpr const T* KeyToPtr(const void* rec) { return rec ? (const T*)((const uint8_t*)rec + 4) : NULL; }
     static constexpr const T* KeyToPtr(const void* rec, ID& key) { return rec ? ({ key = *(const uint32_t*)rec; (const T*)((const uint8_t*)rec + 4); }) : NULL; }
     static constexpr const void* PtrToKey(const T* ptr) { return ptr ? (const uint8_t*)ptr - 4 : NULL; }
@@ -146,6 +193,28 @@ struct VariableKeyStorage
     //! returns a @ref Span representing the new record in NVRAM,
     //! or an invalid @ref Span if the record could not be written
     Span Replace(ID key, Span data) const { return Page::ReplaceVar(pageId, key, data); }
+    //! Adds a new record with the specified key, waiting up to @p timeout ticks for the collector to free up space if needed,
+    //! returns a pointer to the new record data in NVRAM or NULL if the record could not be written
+    async(AddAsync, ID key, Span data, mono_t timeout) const
+    async_def()
+    {
+        async_return(await(Page::AddVarAsync, pageId, key, data, timeout));
+    }
+    async_end
+    //! Replaces all records with the specified key with a new one, waiting up to @p timeout ticks for the collector to free up space if needed,
+    //! returns a pointer to the new record data in NVRAM or NULL if the record could not be written
+    async(ReplaceAsync, ID key, Span data, mono_t timeout) const
+    async_def()
+    {
+        async_return(await(Page::ReplaceVarAsync, pageId, key, data, timeout));
+    }
+    async_end
+    //! Adds multiple records with the specified keys, sending a single change notification
+    //! @returns the number of records stored
+    size_t AddBatch(const Page::BatchRecord* records, size_t count) const { return Page::AddVarBatch(pageId, records, count); }
+    //! Replaces all records with the specified keys with new ones, sending a single change notification
+    //! @returns the number of records stored
+    size_t ReplaceBatch(const Page::BatchRecord* records, size_t count) const { return Page::ReplaceVarBatch(pageId, records, count); }
     //! Deletes all records with the specified key
     //! @returns a boolean indicating whethere at least one record was deleted
     bool Delete(ID key) const { return Page::Delete(pageId, key); }
@@ -165,7 +234,7 @@ template<typename T> struct FixedUniqueKeyStorage
     constexpr FixedUniqueKeyStorage(ID pageId = T::PageID) : pageId(pageId) {}
 
     //! Returns the record with the specified key, or NULL if record not found
-    const T* Get(ID key) const { return KeyToPtr(Page::FindUnorderedFirst(pageId, key)); }
+    const T* Get(ID key) const { return KeyToPtr(Page::FindUnorderedFirstFixed<RecordSize>(pageId, key)); }
     //! Stores the record with the specified key,
     //! returns a pointer to the new record in NVRAM,
     //! or NULL if the record could not be written
@@ -174,6 +243,17 @@ template<typename T> struct FixedUniqueKeyStorage
     //! returns a pointer to the new record in NVRAM,
     //! or NULL if the record could not be written
     const T* Set(ID key, const T& record) const { return Set(key, &record); }
+    //! Stores the record with the specified key, waiting up to @p timeout ticks for the collector to free up space if needed,
+    //! returns a pointer to the new record in NVRAM or NULL if the record could not be written
+    async(SetAsync, ID key, const T& record, mono_t timeout) const
+    async_def()
+    {
+        async_return(await(Page::ReplaceFixedAsync, pageId, key, Span(&record, sizeof(T)), timeout));
+    }
+    async_end
+    //! Stores multiple records (each of @p T size) with the specified keys, sending a single change notification
+    //! @returns the number of records stored
+    size_t SetBatch(const Page::BatchRecord* records, size_t count) const { return Page::ReplaceFixedBatch(pageId, records, count); }
     //! Deletes all records with the specified key
     //! @returns a boolean indicating whethere at least one record was deleted
     bool Delete(ID key) const { return Page::Delete(pageId, key); }
@@ -181,6 +261,9 @@ template<typename T> struct FixedUniqueKeyStorage
     const uint32_t pageId;
 
 private:
+    //! Size of the records on pages written by the storage, including the key
+    static constexpr uint32_t RecordSize = RequiredAligned(sizeof(T) + 4);
+
     static constexpr const T* KeyToPtr(const void* rec) { return rec ? (const T*)((const uint8_t*)rec + 4) : NULL; }
 };
 
@@ -194,6 +277,17 @@ struct VariableUniqueKeyStorage
     //! returns a @ref Span representing the new record in NVRAM,
     //! or an invalid @ref Span if the record could not be written
     Span Set(ID key, Span data) const { return Page::ReplaceVar(pageId, key, data); }
+    //! Stores the record with the specified key, waiting up to @p timeout ticks for the collector to free up space if needed,
+    //! returns a pointer to the new record data in NVRAM or NULL if the record could not be written
+    async(SetAsync, ID key, Span data, mono_t timeout) const
+    async_def()
+    {
+        async_return(await(Page::ReplaceVarAsync, pageId, key, data, timeout));
+    }
+    async_end
+    //! Stores multiple records with the specified keys, sending a single change notification
+    //! @returns the number of records stored
+    size_t SetBatch(const Page::BatchRecord* records, size_t count) const { return Page::ReplaceVarBatch(pageId, records, count); }
     //! Deletes all records with the specified key
     //! @returns a boolean indicating whethere at least one record was deleted
     bool Delete(ID key) const { return Page::Delete(pageId, key); }
@@ -204,4 +298,100 @@ private:
     static constexpr Span DataWithoutKey(Span data) { return data ? Span(data.Pointer() + 4, data.Length() - 4) : data; }
 };
 
+#if NVRAM_KEY_INDEX
+
+//! Helper for NVRAM storage pages with fixed size records identified by unique 32-bit keys,
+//! with lookups accelerated by a RAM index holding up to @p IndexSize keys (must be a power of two, at least 2)
+template<typename T, size_t IndexSize> struct IndexedFixedUniqueKeyStorage : FixedUniqueKeyStorage<T>
+{
+    constexpr IndexedFixedUniqueKeyStorage(ID pageId = T::PageID) : FixedUniqueKeyStorage<T>(pageId) {}
+
+    //! Returns the record with the specified key, or NULL if record not found
+    const T* Get(ID key) const { return KeyToPtr(index.Get(this->pageId, key)); }
+
+private:
+    mutable KeyIndexTable<IndexSize> index;
+
+    static constexpr const T* KeyToPtr(const void* rec) { return rec ? (const T*)((const uint8_t*)rec + 4) : NULL; }
+};
+
+//! Helper for NVRAM storage pages with variable size records identified by unique 32-bit keys,
+//! with lookups accelerated by a RAM index holding up to @p IndexSize keys (must be a power of two, at least 2)
+template<size_t IndexSize> struct IndexedVariableUniqueKeyStorage : VariableUniqueKeyStorage
+{
+    constexpr IndexedVariableUniqueKeyStorage(ID pageId) : VariableUniqueKeyStorage(pageId) {}
+
+    //! Returns the record with the specified key, or an invalid @ref Span if record not found
+    Span Get(ID key) const { return DataWithoutKey(index.Get(pageId, key)); }
+
+private:
+    mutable KeyIndexTable<IndexSize> index;
+
+    static constexpr Span DataWithoutKey(Span data) { return data ? Span(data.Pointer() + 4, data.Length() - 4) : data; }
+};
+
+#else
+
+//! Without NVRAM_KEY_INDEX, the lookups search the pages the same as @ref FixedUniqueKeyStorage
+template<typename T, size_t IndexSize> struct IndexedFixedUniqueKeyStorage : FixedUniqueKeyStorage<T>
+{
+    constexpr IndexedFixedUniqueKeyStorage(ID pageId = T::PageID) : FixedUniqueKeyStorage<T>(pageId) {}
+};
+
+//! Without NVRAM_KEY_INDEX, the lookups search the pages the same as @ref VariableUniqueKeyStorage
+template<size_t IndexSize> struct IndexedVariableUniqueKeyStorage : VariableUniqueKeyStorage
+{
+    constexpr IndexedVariableUniqueKeyStorage(ID pageId) : VariableUniqueKeyStorage(pageId) {}
+};
+
+#endif
+
+//! Helper for circular logs of fixed size records, keeping the order of up to @p MaxPages pages in RAM,
+//! so the log can be read and its oldest pages discarded without scanning all the pages
+//!
+//! Records must be added through the storage for new pages to be tracked without a rescan,
+//! @ref RegisterCollector replaces @ref CollectorDiscardOldest for the page type.
+template<typename T, size_t MaxPages> struct RingStorage : FixedStorage<T>
+{
+    using Cursor = Ring::Cursor;
+
+    constexpr RingStorage(ID pageId = T::PageID) : FixedStorage<T>(pageId), ring(pageId) {}
+
+    //! Returns the oldest record
+    const T* OldestFirst() const { return (const T*)ring.First(); }
+    //! Returns the next newer record
+    const T* OldestNext(const T* after) const { return (const T*)ring.Next(after); }
+    //! Returns the newest record
+    const T* NewestFirst() const { return (const T*)ring.Newest(); }
+    //! Returns the record following the position of the @p cursor, or the oldest one if the position has been discarded
+    const T* Read(const Cursor& cursor) const { return (const T*)ring.After(cursor); }
+    //! Returns the record following the position of the @p cursor and moves the cursor to it
+    const T* ReadNext(Cursor& cursor) const { auto rec = Read(cursor); if (rec) cursor = Position(rec); return rec; }
+    //! Returns the position of the specified record, e.g. to be stored as a persistent cursor
+    static Cursor Position(const T* rec) { return Ring::Position(rec); }
+
+    //! Adds a new record, returns pointer to the new record in NVRAM or NULL if the record could not be written
+    const T* Add(const T* record) const { return Added(FixedStorage<T>::Add(record)); }
+    //! Adds a new record, returns pointer to the new record in NVRAM or NULL if the record could not be written
+    const T* Add(const T& record) const { return Add(&record); }
+    //! Adds a new record, waiting up to @p timeout ticks for the collector to free up space if needed,
+    //! returns pointer to the new record in NVRAM or NULL if the record could not be written
+    async(AddAsync, const T& record, mono_t timeout) const
+    async_def()
+    {
+        async_return(Added((const T*)await(Page::AddFixedAsync, this->pageId, Span(&record, sizeof(T)), timeout)));
+    }
+    async_end
+
+    //! Registers a collector discarding the oldest page of the log at the specified level,
+    //! the collector is removed when the storage is destroyed
+    void RegisterCollector(unsigned level) { ring.RegisterCollector(level, GetDelegate(this, &RingStorage::Discard)); }
+
+private:
+    mutable RingTable<MaxPages> ring;
+
+    const T* Added(const T* rec) const { if (rec) ring.Added(rec); return rec; }
+    const Page* Discard(ID id) { return ring.Discard(); }
+};
+
 }
@@ -0,0 +1,385 @@
+/*
+ * Copyright (c) 2026 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * nvram/Transaction.cpp
+ */
+
+#include <nvram/nvram.h>
+
+#define MYDBG(...)  DBGCL("nvram", __VA_ARGS__)
+
+namespace nvram
+{
+
+#if NVRAM_TRANSACTIONS
+
+struct Transaction::Completion
+{
+    uint32_t id;    //< the committed transaction, zero if none is pending
+
+    //! Hands the committed transaction over to the task
+    void Start(uint32_t id);
+
+    async(Run);
+};
+
+Transaction::Completion Transaction::completion;
+
+void Transaction::Completion::Start(uint32_t id)
+{
+    MYDBG("Transaction %d will be applied in the background", id);
+    this->id = id;
+    kernel::Task::Run(this, &Completion::Run);
+}
+
+/*!
+ * The changes are applied again from the start, which changes nothing for the
+ * ones already applied. Other writes of the changed records could be overwritten
+ * this way, which is why no other transaction can be committed in the meantime.
+ */
+async(Transaction::Completion::Run)
+async_def(Manager* lacking)
+{
+    while (id)
+    {
+        f.lacking = NULL;
+        if (CanApply(id, &f.lacking) && Apply(id))
+        {
+            MYDBG("Transaction %d applied in the background", id);
+            id = 0;
+            break;
+        }
+
+        if (!f.lacking)
+        {
+            // the pages of the failed writes are released by the collector as well
+            f.lacking = &Manager::For(TransactionJournal);
+        }
+        await(f.lacking->Collect);
+    }
+}
+async_end
+
+bool Transaction::Stage(ID page, ID key, OpKind kind, Span data)
+{
+    if (failed)
+    {
+        return false;
+    }
+
+    if (!id)
+    {
+        id = NewId();
+    }
+
+    Operation op = { page, key, kind };
+    Span parts[] = { Span(op), data };
+    RecordWriter writer(TransactionJournal);
+
+    if (!writer.Add(id, parts, data ? 2 : 1))
+    {
+        MYDBG("Failed to add change of %.4s:%08X to transaction %d", &op.page, op.key, id);
+        Abort();
+        failed = true;
+        return false;
+    }
+
+    return true;
+}
+
+bool Transaction::Commit()
+{
+    if (failed)
+    {
+        failed = false;
+        return false;
+    }
+
+    if (!id)
+    {
+        // nothing to do
+        return true;
+    }
+
+    if (!CompletePending())
+    {
+        MYDBG("Transaction %d cannot be committed before transaction %d is applied", id, completion.id);
+        Abort();
+        return false;
+    }
+
+    if (!CanApply(id))
+    {
+        MYDBG("Not enough free space to apply transaction %d", id);
+        Abort();
+        return false;
+    }
+
+    // a journal record without data marks the transaction as committed
+    if (!Page::AddVar(TransactionJournal, id, Span()))
+    {
+        MYDBG("Failed to commit transaction %d", id);
+        Abort();
+        return false;
+    }
+
+    // the transaction is committed, it is completed even if applying the changes fails now
+    uint32_t committed = id;
+    id = 0;
+    if (!Apply(committed))
+    {
+        completion.Start(committed);
+    }
+    return true;
+}
+
+bool Transaction::CompletePending()
+{
+    if (completion.id && CanApply(completion.id) && Apply(completion.id))
+    {
+        completion.id = 0;
+    }
+    return !completion.id;
+}
+
+void Transaction::Abort()
+{
+    if (id)
+    {
+        MYDBG("Abandoning transaction %d", id);
+        Page::Delete(TransactionJournal, id);
+        id = 0;
+    }
+}
+
+uint32_t Transaction::NewId()
+{
+    uint32_t max = 0;
+    for (Span rec = Page::FindUnorderedFirst(TransactionJournal); rec; rec = Page::FindUnorderedNext(rec))
+    {
+        if (rec.Element<uint32_t>() > max)
+        {
+            max = rec.Element<uint32_t>();
+        }
+    }
+
+    // neither zero nor all ones can be used as the first word
+    return max + 1 < ~0u ? max + 1 : 1;
+}
+
+bool Transaction::IsCommitted(uint32_t id)
+{
+    for (Span rec = Page::FindUnorderedFirst(TransactionJournal, id); rec; rec = Page::FindUnorderedNext(rec, id))
+    {
+        if (rec.Length() == 4)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*!
+ * Applying a committed transaction must not fail for the lack of space, as the changes
+ * applied before the failure would be visible until the transaction is completed
+ *
+ * The records of each page type changed by the transaction are placed one after
+ * another, starting with the free space on its newest page, to count the new pages
+ * the type needs. The commit marker is included, its page is allocated before
+ * the changes are applied.
+ */
+bool Transaction::CanApply(uint32_t id, Manager** lacking)
+{
+    struct Target
+    {
+        ID page;
+        const Page* newest;     //< newest page of the type, its format is used for the new pages as well
+        uint32_t left;          //< space left on the page the next record is placed on
+        unsigned pages;         //< new pages needed
+        bool checked;
+    } targets[8];
+    unsigned count = 0;
+
+    auto add = [&](ID page, uint32_t payloadLen)
+    {
+        Target* t = NULL;
+        for (unsigned i = 0; i < count && !t; i++)
+        {
+            if (targets[i].page == page)
+            {
+                t = &targets[i];
+            }
+        }
+        if (!t)
+        {
+            if (count == countof(targets))
+            {
+                return false;
+            }
+
+            t = &targets[count++];
+            *t = { page, Page::NewestFirst(page), 0, 0, false };
+            if (auto* free = t->newest ? t->newest->FindFree() : NULL)
+            {
+                // variable free space starts after the length of the next record
+                t->left = t->newest->PayloadEnd() - free + (t->newest->IsFixed() ? 0 : 4);
+            }
+        }
+
+        // the format of a new page type is not known yet, the space needed by a variable record with a footer is larger
+        auto* p = t->newest;
+        uint32_t need = !p ? Page::VarSkipLen(payloadLen) + WriteAlignment : p->IsFixed() ? p->recordSize : p->VarSkip(payloadLen);
+        uint32_t capacity = Manager::For(page).UsesLargePages(page) ? LargePagePayload : PagePayload;
+        if (need > capacity)
+        {
+            return false;
+        }
+
+        if (need > t->left)
+        {
+            t->pages++;
+            t->left = capacity;
+        }
+        t->left -= need;
+        return true;
+    };
+
+    add(TransactionJournal, 4);
+    for (Span rec = Page::FindUnorderedFirst(TransactionJournal, id); rec; rec = Page::FindUnorderedNext(rec, id))
+    {
+        if (rec.Length() < 4 + sizeof(Operation))
+            continue;
+
+        // deleting records needs no space, the replacements start with the key instead of the header
+        auto& op = *(const Operation*)(rec.Pointer() + 4);
+        if (op.kind != OpDelete && !add(op.page, rec.Length() - sizeof(Operation)))
+        {
+            MYDBG("Cannot place the changes of transaction %d", id);
+            return false;
+        }
+    }
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        if (targets[i].checked)
+            continue;
+
+        // the page types stored by the same manager share its free pages
+        auto& manager = Manager::For(targets[i].page);
+        unsigned pages = 0, large = 0;
+
+        for (unsigned j = i; j < count; j++)
+        {
+            auto& t = targets[j];
+            if (&Manager::For(t.page) != &manager)
+                continue;
+
+            t.checked = true;
+            if (manager.UsesLargePages(t.page))
+                large += t.pages;
+            else
+                pages += t.pages;
+        }
+
+        if ((pages || large) && !manager.Reserve(pages, large))
+        {
+            if (lacking)
+            {
+                *lacking = &manager;
+            }
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*!
+ * The changes are applied in the order they were added to the transaction,
+ * stopping at the first one that fails, so that the later ones are never visible
+ * before the earlier ones; the journal records are deleted only when all of them
+ * have been stored
+ *
+ * The commit marker is shredded first, a record left partially shredded by
+ * a power cut must not be applied again as part of a committed transaction
+ */
+bool Transaction::Apply(uint32_t id)
+{
+    bool success = true;
+
+    for (Span rec = Page::FindOldestFirst(TransactionJournal, id); rec && success; rec = Page::FindOldestNext(rec, id))
+    {
+        if (rec.Length() < 4 + sizeof(Operation))
+        {
+            // the commit marker
+            continue;
+        }
+
+        auto& op = *(const Operation*)(rec.Pointer() + 4);
+        Span data = rec.RemoveLeft(4 + sizeof(Operation));
+
+        switch (op.kind)
+        {
+        case OpSetVar:
+            success = !!Page::ReplaceVar(op.page, op.key, data);
+            break;
+        case OpSetFixed:
+            success = !!Page::ReplaceFixed(op.page, op.key, data);
+            break;
+        case OpDelete:
+            // there may be nothing to delete when applying the transaction again
+            Page::Delete(op.page, op.key);
+            break;
+        }
+    }
+
+    if (!success)
+    {
+        MYDBG("Failed to apply transaction %d, will retry after initialization", id);
+        return false;
+    }
+
+    for (Span rec = Page::FindUnorderedFirst(TransactionJournal, id); rec; rec = Page::FindUnorderedNext(rec, id))
+    {
+        if (rec.Length() == 4)
+        {
+            Page::ShredRecord(rec.Pointer());
+        }
+    }
+
+    Page::Delete(TransactionJournal, id);
+    return true;
+}
+
+void Transaction::Recover()
+{
+    // journal pages are emptied by the transactions
+    Manager::For(TransactionJournal).RegisterCollector(TransactionJournal, 0, CollectorCleanup);
+    // the journal is examined again, a transaction pending before the initialization is found there
+    completion.id = 0;
+
+    while (Span rec = Page::FindUnorderedFirst(TransactionJournal))
+    {
+        uint32_t id = rec.Element<uint32_t>();
+
+        if (!IsCommitted(id))
+        {
+            MYDBG("Discarding uncommitted transaction %d", id);
+            Page::Delete(TransactionJournal, id);
+            continue;
+        }
+
+        MYDBG("Completing committed transaction %d", id);
+        if (!Apply(id))
+        {
+            completion.Start(id);
+            break;
+        }
+    }
+}
+
+#endif
+
+}
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2026 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * nvram/Transaction.h
+ *
+ * Atomic updates of multiple records through a journal
+ */
+
+#pragma once
+
+#include <nvram/Page.h>
+
+namespace nvram
+{
+
+#if NVRAM_TRANSACTIONS
+
+//! Page type of the journal holding the records of the transactions until they are applied
+#ifdef NVRAM_TRANSACTION_JOURNAL
+constexpr ID TransactionJournal = NVRAM_TRANSACTION_JOURNAL;
+#else
+constexpr ID TransactionJournal = "NVTX";
+#endif
+
+//! Groups changes of records identified by unique keys, possibly of different page types,
+//! so that either all or none of them survive a reset
+//!
+//! The changes are first written to the @ref TransactionJournal, each tagged with the transaction ID
+//! as the first word. @ref Commit writes a record with the same ID and no data as the commit marker
+//! and then applies the changes to their pages and deletes the journal records. When NVRAM is
+//! initialized, the journal records of committed transactions are applied again (which changes
+//! nothing for the records already applied), while those of uncommitted ones are shredded.
+//!
+//! Readers never see the changes before the commit, applying them is not interrupted by other tasks.
+//! If a committed transaction cannot be applied completely right away, a background task applies it
+//! again once the collectors make space for it, and no other transaction can be committed until then.
+class Transaction
+{
+public:
+    constexpr Transaction() {}
+    ~Transaction() { Abort(); }
+
+    //! Adds replacing the variable record with the specified key to the transaction
+    //! @returns false if the change could not be written to the journal, the transaction is aborted
+    bool SetVar(ID page, ID key, Span data) { return Stage(page, key, OpSetVar, data); }
+    //! Adds replacing the fixed record with the specified key to the transaction
+    //! @returns false if the change could not be written to the journal, the transaction is aborted
+    bool SetFixed(ID page, ID key, Span data) { return Stage(page, key, OpSetFixed, data); }
+    //! Adds deleting all records with the specified key to the transaction
+    //! @returns false if the change could not be written to the journal, the transaction is aborted
+    bool Delete(ID page, ID key) { return Stage(page, key, OpDelete, Span()); }
+    //! Commits the transaction and applies the changes
+    //! @returns false if the transaction has been aborted or could not be committed (e.g. when there is
+    //! not enough free space to apply all the changes, nothing is changed then, the journal is empty
+    //! and the collector is started to free the space, so the transaction can be retried once it finishes),
+    //! a committed transaction that could not be applied completely is applied again in the background
+    bool Commit();
+    //! Abandons the changes added to the transaction
+    void Abort();
+
+    //! Returns the ID used to tag the journal records of the transaction, zero if none have been written yet
+    uint32_t Id() const { return id; }
+
+    //! Completes the committed transactions found in the journal and discards the rest,
+    //! called by @ref Manager::Initialize of the manager holding the journal
+    static void Recover();
+
+private:
+    enum OpKind : uint32_t
+    {
+        OpSetVar = 1,
+        OpSetFixed,
+        OpDelete,
+    };
+
+    //! Header of the journal records, followed by the record data
+    struct Operation
+    {
+        uint32_t page;
+        uint32_t key;
+        uint32_t kind;
+    };
+
+    uint32_t id = 0;
+    bool failed = false;
+
+    //! Task applying a committed transaction that could not be applied completely by @ref Commit
+    struct Completion;
+    static Completion completion;
+
+    //! Writes the change to the journal
+    bool Stage(ID page, ID key, OpKind kind, Span data);
+
+    //! Returns an ID not used by any records in the journal
+    static uint32_t NewId();
+    //! Determines if the journal contains the commit marker of the transaction
+    static bool IsCommitted(uint32_t id);
+    //! Determines if the changes of the transaction can be applied using the free space available,
+    //! reserving the missing pages with the respective managers if not (@p lacking is set to one of them)
+    static bool CanApply(uint32_t id, Manager** lacking = NULL);
+    //! Applies the pending committed transaction if there is one
+    //! @returns false if it is still pending
+    static bool CompletePending();
+    //! Applies the changes of a committed transaction and removes it from the journal
+    static bool Apply(uint32_t id);
+};
+
+#endif
+
+}
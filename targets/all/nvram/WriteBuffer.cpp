@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2026 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * nvram/WriteBuffer.cpp
+ */
+
+#include <nvram/nvram.h>
+#include <nvram/WriteBuffer.h>
+
+#define MYDBG(...)  DBGCL("nvram", __VA_ARGS__)
+
+namespace nvram
+{
+
+bool WriteBuffer::Add(ID key, Span data)
+{
+    uint32_t totalLength = data.Length() + 4;
+    size_t required = Page::VarSkipLen(totalLength);
+
+    if (used + required > size && !Flush())
+    {
+        return false;
+    }
+
+    if (required > size)
+    {
+        // too large to be staged
+        return !!Page::AddVar(pageId, key, data);
+    }
+
+    // stage the record with the length and padding exactly as it will be stored
+    uint8_t* rec = buffer + used;
+    memcpy(rec, &totalLength, 4);
+    memcpy(rec + 4, &key, 4);
+    memcpy(rec + 8, data.Pointer(), data.Length());
+    memset(rec + 4 + totalLength, 0xFF, required - totalLength);
+    used += required;
+    return true;
+}
+
+bool WriteBuffer::Flush()
+{
+    if (!used)
+    {
+        return true;
+    }
+
+    size_t written = Page::WriteStagedImpl(pageId, buffer, used);
+    if (written < used)
+    {
+        MYDBG("Failed to flush %d bytes of staged %.4s records", used - written, &pageId);
+        memmove(buffer, buffer + written, used - written);
+    }
+    used -= written;
+    return !used;
+}
+
+async(WriteBuffer::FlushAsync)
+async_def()
+{
+    if (!Flush())
+    {
+        // try to make some room
+        await(Manager::For(pageId).Collect);
+        async_return(Flush());
+    }
+
+    async_return(true);
+}
+async_end
+
+}
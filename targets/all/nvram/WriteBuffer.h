@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2026 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * nvram/WriteBuffer.h
+ *
+ * RAM write-behind buffer for variable size records
+ */
+
+#pragma once
+
+#include <nvram/Page.h>
+
+namespace nvram
+{
+
+//! Write-behind buffer for variable size records identified by 32-bit keys
+//!
+//! Records are staged in RAM in the same layout they will have in NVRAM
+//! and programmed in as few bursts as possible when the buffer is flushed,
+//! with the first word of each record still written last. Staged records
+//! are not visible to readers until the buffer is flushed.
+class WriteBuffer
+{
+public:
+    constexpr WriteBuffer(ID pageId, uint8_t* buffer, size_t size)
+        : pageId(pageId), buffer(buffer), size(size) {}
+
+    //! Stages a new record with the specified key, flushing the buffer first if the record doesn't fit
+    //! Records that don't fit even in an empty buffer are written directly
+    //! @returns false if the record could not be staged or written
+    bool Add(ID key, Span data);
+    //! Programs all staged records to NVRAM, sending a single change notification
+    //! @returns false if some of the records could not be written, these are kept staged
+    bool Flush();
+    //! Programs all staged records to NVRAM, running the collectors if there is not enough space
+    //! @returns false if some of the records could not be written, these are kept staged
+    async(FlushAsync);
+
+    //! Returns the number of bytes staged
+    size_t Pending() const { return used; }
+
+    const uint32_t pageId;
+
+private:
+    uint8_t* buffer;
+    size_t size;
+    size_t used = 0;
+};
+
+//! @ref WriteBuffer with statically allocated storage for @p Size bytes of records
+template<size_t Size> class WriteBufferStorage : public WriteBuffer
+{
+public:
+    constexpr WriteBufferStorage(ID pageId)
+        : WriteBuffer(pageId, storage, Size) {}
+
+private:
+    alignas(WriteAlignment) uint8_t storage[Size];
+};
+
+}
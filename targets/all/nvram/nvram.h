@@ -16,6 +16,10 @@
 #include <nvram/Block.h>
 #include <nvram/Storage.h>
 #include <nvram/Manager.h>
+#include <nvram/WriteBuffer.h>
+#include <nvram/RecordWriter.h>
+#include <nvram/CompressedStorage.h>
+#include <nvram/Transaction.h>
 
 namespace nvram
 {
@@ -36,15 +40,37 @@ inline ArrayIterator<const Block> UsedBlocks() { return _manager.UsedBlocks(); }
 inline size_t PagesAvailable() { return _manager.PagesAvailable(); }
 
 //! Registers a NVRAM collector
-inline void RegisterCollector(ID pageId, unsigned level, CollectorDelegate collector) { _manager.RegisterCollector(pageId, level, collector); }
+inline void RegisterCollector(ID pageId, unsigned level, CollectorDelegate collector) { Manager::For(pageId).RegisterCollector(pageId, level, collector); }
+
+//! Removes a NVRAM collector
+inline void UnregisterCollector(ID pageId, unsigned level) { Manager::For(pageId).UnregisterCollector(pageId, level); }
 
 //! Registers a NVRAM change notifier
-inline void RegisterNotifier(ID pageId, NotifierDelegate notifier) { _manager.RegisterNotifier(pageId, notifier); }
+inline void RegisterNotifier(ID pageId, NotifierDelegate notifier) { Manager::For(pageId).RegisterNotifier(pageId, notifier); }
+
+//! Registers a NVRAM change notifier receiving the key of the changed records
+inline void RegisterKeyNotifier(ID pageId, KeyNotifierDelegate notifier) { Manager::For(pageId).RegisterKeyNotifier(pageId, notifier); }
 
 //! Registers a NVRAM page version tracker
-inline void RegisterVersionTracker(ID pageId, unsigned* pVersion) { _manager.RegisterVersionTracker(pageId, pVersion); }
+inline void RegisterVersionTracker(ID pageId, unsigned* pVersion) { Manager::For(pageId).RegisterVersionTracker(pageId, pVersion); }
+
+#if NVRAM_UNIQUE_KEY_PAGES
+//! Marks the NVRAM pages with the specified ID as storing at most one record per key
+inline bool UseUniqueKeys(ID pageId) { return Manager::For(pageId).UseUniqueKeys(pageId); }
+#endif
+
+#if NVRAM_LARGE_PAGES
+//! Allocates new NVRAM pages with the specified ID spanning whole blocks
+inline bool UseLargePages(ID pageId) { return Manager::For(pageId).UseLargePages(pageId); }
+#endif
 
 //! Erases all NVRAM pages with the specified ID
-inline void EraseAll(ID pageId) { _manager.EraseAll(pageId); }
+inline void EraseAll(ID pageId) { Manager::For(pageId).EraseAll(pageId); }
+
+#if NVRAM_CHECKPOINT
+//! Stores the state of all NVRAM blocks of the manager storing the pages with the specified ID
+//! (the default one if not specified), so that its next initialization doesn't have to scan them
+inline bool Checkpoint(ID pageId = ID()) { return Manager::For(pageId).Checkpoint(); }
+#endif
 
 }
@@ -0,0 +1,290 @@
+/*
+ * Copyright (c) 2026 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * nvram/tests/bench/Bench.cpp
+ *
+ * Workload benchmarks reporting emulated flash operations per API call,
+ * requires the host flash emulation with operation counters
+ */
+
+#include <testrunner/TestCase.h>
+
+#include <nvram/nvram.h>
+#include <nvram/Settings.h>
+
+#include <chrono>
+
+using namespace nvram;
+
+namespace
+{
+
+//! Captures flash counters and time at construction, reports the differences divided by the number of operations
+class Measurement
+{
+public:
+    Measurement(const char* name)
+        : name(name), flash(Flash::stats), time(__testrunner_time), start(std::chrono::steady_clock::now()) {}
+
+    void Report(unsigned ops, unsigned failed = 0)
+    {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        double n = ops ? ops : 1;
+        printf("%-28s %6u ops %4u failed | %7.3f writes %8.2f bytes %7.3f shreds %7.4f erases %8.3f ms | %8.0f ns cpu\n",
+            name, ops, failed,
+            (Flash::stats.writes - flash.writes) / n,
+            (Flash::stats.programmed - flash.programmed) / n,
+            (Flash::stats.shreds - flash.shreds) / n,
+            (Flash::stats.erases - flash.erases) / n,
+            MonoToMilliseconds(__testrunner_time - time) / n,
+            ns / n);
+    }
+
+private:
+    const char* name;
+    Flash::Stats flash;
+    mono_t time;
+    std::chrono::steady_clock::time_point start;
+};
+
+//! Simple deterministic pseudo-random sequence, so that all runs perform the same operations
+static uint32_t Random(uint32_t& seed)
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+//! Lets the collector catch up periodically and whenever an operation fails
+template<typename TOp> static unsigned Run(unsigned ops, TOp op)
+{
+    unsigned failed = 0;
+
+    for (unsigned i = 0; i < ops; i++)
+    {
+        if (!op(i))
+        {
+            kernel::Scheduler::Main().Run();
+            if (!op(i))
+            {
+                failed++;
+            }
+        }
+        else if (i % 16 == 15)
+        {
+            kernel::Scheduler::Main().Run();
+        }
+    }
+
+    kernel::Scheduler::Main().Run();
+    return failed;
+}
+
+TEST_CASE("01 Append Log")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+    nvram::RegisterCollector("BLOG", 1, CollectorDiscardOldest);
+
+    VariableStorage log("BLOG");
+    uint32_t seed = 1;
+    uint8_t entry[40];
+    for (size_t i = 0; i < sizeof(entry); i++)
+    {
+        entry[i] = i;
+    }
+
+    constexpr unsigned ops = 4000;
+    Measurement m("append log");
+    unsigned failed = Run(ops, [&](unsigned i)
+    {
+        entry[0] = i + 1;
+        return !!log.Add(Span(entry, 8 + Random(seed) % 32));
+    });
+    m.Report(ops, failed);
+    AssertEqual(0u, failed);
+}
+
+//! Updates random keys of a unique key storage, with the specified number of distinct keys and collector
+static void Churn(const char* name, unsigned keys, CollectorDelegate collector)
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+    nvram::RegisterCollector("BKEY", 0, CollectorCleanup);
+    nvram::RegisterCollector("BKEY", 1, collector);
+
+    struct Item { uint32_t a, b, c; };
+    FixedUniqueKeyStorage<Item> storage("BKEY");
+    uint32_t seed = 1;
+
+    // populate all keys first, so that only updates are measured
+    Run(keys, [&](unsigned i) { return !!storage.Set(i + 1, { i, i, i }); });
+
+    constexpr unsigned ops = 4000;
+    Measurement m(name);
+    unsigned failed = Run(ops, [&](unsigned i)
+    {
+        return !!storage.Set(Random(seed) % keys + 1, { i, i, i });
+    });
+    m.Report(ops, failed);
+    AssertEqual(0u, failed);
+}
+
+TEST_CASE("02 Key-Value Churn")
+{
+    Churn("key-value churn", 64, CollectorRelocate);
+}
+
+TEST_CASE("03 Settings Reload")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+
+    Settings settings("BSET", NULL, NULL);
+    constexpr unsigned count = 32;
+    for (uint32_t i = 1; i <= count; i++)
+    {
+        AssertEqual(Span(i), settings.Set(i, Span(i)));
+    }
+
+    constexpr unsigned reloads = 100;
+    Measurement m("settings reload");
+    unsigned failed = 0;
+    for (unsigned n = 0; n < reloads; n++)
+    {
+        nvram::Initialize(Span(), nvram::InitFlags::None);
+        for (uint32_t i = 1; i <= count; i++)
+        {
+            if (settings.Get(i) != Span(i))
+            {
+                failed++;
+            }
+        }
+    }
+    kernel::Scheduler::Main().Run();
+    m.Report(reloads * count, failed);
+    AssertEqual(0u, failed);
+}
+
+TEST_CASE("04 Collector Pressure")
+{
+    // enough distinct keys to keep a quarter of the flash occupied by live records
+    unsigned keys = Flash::GetRange().Length() / Flash::PageSize * PagesPerBlock * (PagePayload / 16) / 4;
+    Churn("collector pressure", keys, CollectorRelocate);
+    Churn("collector pressure (c/b)", keys, CollectorRelocateCostBenefit);
+    Churn("collector pressure (merge)", keys, CollectorMergeUnique);
+}
+
+TEST_CASE("05 Keyed Lookup")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+
+    // lookups of rarely written keys, buried under many pages of frequently written ones
+    VariableKeyStorage storage("BLKP");
+    constexpr unsigned keys = 250, hot = 8;
+    for (uint32_t i = 0; i < keys; i++)
+    {
+        AssertEqual(Span(i), storage.Add(i + 1, Span(i)));
+    }
+    for (uint32_t i = 0; i < keys * 8; i++)
+    {
+        AssertEqual(Span(i), storage.Add(keys + i % hot + 1, Span(i)));
+    }
+
+    constexpr unsigned ops = 4000;
+    uint32_t seed = 1;
+    Measurement m("keyed lookup");
+    unsigned failed = 0;
+    for (unsigned i = 0; i < ops; i++)
+    {
+        uint32_t key = Random(seed) % keys;
+        if (storage.NewestFirst(key + 1) != Span(key))
+        {
+            failed++;
+        }
+    }
+    m.Report(ops, failed);
+    AssertEqual(0u, failed);
+}
+
+TEST_CASE("06 Newest First Iteration")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+
+    // walks a log of variable records from the newest entry, as when displaying recent events
+    VariableStorage log("BITR");
+    uint32_t seed = 1;
+    uint32_t entry[6] = {};
+    constexpr unsigned entries = 400;
+    for (unsigned i = 0; i < entries; i++)
+    {
+        entry[0] = i + 1;
+        AssertEqual(true, !!log.Add(Span(entry, 4 + Random(seed) % 20)));
+    }
+
+    constexpr unsigned ops = 200;
+    Measurement m("newest first iteration");
+    unsigned failed = 0;
+    for (unsigned i = 0; i < ops; i++)
+    {
+        unsigned n = 0;
+        for (Span rec = log.NewestFirst(); rec; rec = log.NewestNext(rec))
+        {
+            n++;
+        }
+        if (n != entries)
+        {
+            failed++;
+        }
+    }
+    m.Report(ops, failed);
+    AssertEqual(0u, failed);
+}
+
+TEST_CASE("07 Fixed Record Lookup")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+
+    // rarely written keys of a ring with 16 byte records buried under frequently written ones,
+    // looked up using the generic and the specialized search
+    struct Sample { uint32_t time, value, flags; };
+    FixedKeyStorage<Sample> ring("BFIX");
+    constexpr unsigned keys = 32, hot = 4;
+    for (uint32_t i = 0; i < keys; i++)
+    {
+        AssertNotEqual((const Sample*)NULL, ring.Add(i + 1, Sample { i, i, i }));
+    }
+    for (uint32_t i = 0; i < keys * 20; i++)
+    {
+        AssertNotEqual((const Sample*)NULL, ring.Add(keys + i % hot + 1, Sample { i, i, i }));
+    }
+
+    constexpr unsigned ops = 4000;
+    uint32_t seed = 1;
+    Measurement generic("fixed lookup (generic)");
+    unsigned failed = 0;
+    for (unsigned i = 0; i < ops; i++)
+    {
+        uint32_t key = Random(seed) % keys + 1;
+        if (Page::FindNewestFirst("BFIX", key).Element<uint32_t>() != key)
+        {
+            failed++;
+        }
+    }
+    generic.Report(ops, failed);
+    AssertEqual(0u, failed);
+
+    seed = 1;
+    Measurement specialized("fixed lookup (specialized)");
+    for (unsigned i = 0; i < ops; i++)
+    {
+        uint32_t key = Random(seed) % keys + 1;
+        auto rec = ring.NewestFirst(key);
+        if (!rec || rec->time + 1 != key)
+        {
+            failed++;
+        }
+    }
+    specialized.Report(ops, failed);
+    AssertEqual(0u, failed);
+}
+
+}
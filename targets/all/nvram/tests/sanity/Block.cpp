@@ -48,4 +48,31 @@ TEST_CASE("03 Max Alloc")
     AssertEqual(cnt, UsedBlocks().size());
 }
 
+TEST_CASE("04 Blank Check")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+
+    auto blk = Blocks().end() - 1;
+    auto p = (const uint32_t*)blk;
+    auto e = (const uint32_t*)(blk + 1);
+    AssertEqual(true, Block::IsBlank(p, e));
+
+    // clear a single word in the middle of the block
+#if NVRAM_FLASH_DOUBLE_WRITE
+    Flash::WriteDouble(p + 36, ~0u, 0);
+#else
+    Flash::WriteWord(p + 37, 0);
+#endif
+    AssertEqual(false, Block::IsBlank(p, e));
+
+    // try all alignments of the range with respect to the batches
+    for (int i = 0; i <= 37; i++)
+    {
+        AssertEqual(true, Block::IsBlank(p + i, p + 37));
+        AssertEqual(false, Block::IsBlank(p + i, p + 38));
+        AssertEqual(false, Block::IsBlank(p + 37, e - i));
+        AssertEqual(true, Block::IsBlank(p + 38, e - i));
+    }
+}
+
 }
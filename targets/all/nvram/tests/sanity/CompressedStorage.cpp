@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2026 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * nvram/tests/sanity/CompressedStorage.cpp
+ */
+
+#include <testrunner/TestCase.h>
+
+#include <nvram/nvram.h>
+
+using namespace nvram;
+
+namespace
+{
+
+static const char text[] =
+    "{\"name\":\"sensor\",\"enabled\":true,\"offset\":0,\"scale\":1,"
+    "\"channels\":[{\"name\":\"a\",\"enabled\":true},{\"name\":\"b\",\"enabled\":true},"
+    "{\"name\":\"c\",\"enabled\":false},{\"name\":\"d\",\"enabled\":false}]}";
+
+static bool Collect(uint8_t** pos, Span part)
+{
+    memcpy(*pos, part, part.Length());
+    *pos += part.Length();
+    return true;
+}
+
+TEST_CASE("01 Codec")
+{
+    uint8_t packed[sizeof(text) * 2], unpacked[sizeof(text)];
+
+    // repetitive data shrinks
+    uint8_t* pos = packed;
+    size_t length = Lz::Compress(Span(text), GetDelegate(&Collect, &pos));
+    AssertEqual(size_t(pos - packed), length);
+    AssertEqual(true, length < sizeof(text) * 3 / 4);
+    AssertEqual(Span(text), Lz::Decompress(Span(packed, length), unpacked, sizeof(unpacked)));
+
+    // runs are encoded as overlapping references
+    static const uint8_t run[100] = {};
+    static uint8_t runOut[100];
+    pos = packed;
+    length = Lz::Compress(Span(run), GetDelegate(&Collect, &pos));
+    AssertEqual(true, length < 20u);
+    AssertEqual(Span(run), Lz::Decompress(Span(packed, length), runOut, sizeof(runOut)));
+
+    // output that doesn't fit and references before the start are rejected
+    pos = packed;
+    length = Lz::Compress(Span(text), GetDelegate(&Collect, &pos));
+    AssertEqual(false, !!Lz::Decompress(Span(packed, length), unpacked, sizeof(unpacked) - 1));
+    static const uint8_t invalid[] = { 0x01, 0x04, 0x00 };
+    AssertEqual(false, !!Lz::Decompress(Span(invalid), unpacked, sizeof(unpacked)));
+}
+
+TEST_CASE("02 Compressed Storage")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+
+    unsigned version;
+    nvram::RegisterVersionTracker("TEST", &version);
+
+    CompressedUniqueKeyStorage storage("TEST");
+    uint8_t buffer[sizeof(text)];
+
+    AssertEqual(false, !!storage.Get(1, buffer, sizeof(buffer)));
+    AssertEqual(0u, storage.Length(1));
+
+    Span rec = storage.Set(1, Span(text));
+    AssertEqual(true, !!rec);
+    AssertEqual(true, rec.Length() < sizeof(text) * 3 / 4);
+    AssertEqual(sizeof(text) | CompressedUniqueKeyStorage::Compressed, rec.Element<uint32_t>());
+    AssertEqual(sizeof(text), storage.Length(1));
+    AssertEqual(Span(text), storage.Get(1, buffer, sizeof(buffer)));
+    AssertEqual(false, !!storage.Get(1, buffer, sizeof(buffer) - 1));
+    AssertEqual(2u, version);
+
+    // the same data is not written again
+    AssertEqual(rec.Pointer(), storage.Set(1, Span(text)).Pointer());
+    AssertEqual(2u, version);
+
+    // incompressible data is stored as is
+    static const uint8_t noise[] = { 1, 7, 3, 9, 4, 2, 8, 6, 5, 11, 13, 12 };
+    Span raw = storage.Set(2, Span(noise));
+    AssertEqual(4 + sizeof(noise), raw.Length());
+    AssertEqual(sizeof(noise), raw.Element<uint32_t>());
+    AssertEqual(Span(noise), storage.Get(2, buffer, sizeof(buffer)));
+
+    // replacing removes the previous record
+    Span half = storage.Set(1, Span(text, sizeof(text) / 2));
+    AssertNotEqual(rec.Pointer(), half.Pointer());
+    AssertEqual(Span(text, sizeof(text) / 2), storage.Get(1, buffer, sizeof(buffer)));
+    AssertEqual(half.Pointer() - 4, Page::FindUnorderedFirst("TEST", 1).Pointer());
+    AssertEqual(false, !!Page::FindUnorderedNext(half.Pointer() - 4, 1));
+
+    // many records still fit a few pages
+    for (uint32_t key = 10; key < 40; key++)
+    {
+        AssertEqual(true, !!storage.Set(key, Span(text)));
+    }
+    for (uint32_t key = 10; key < 40; key++)
+    {
+        AssertEqual(Span(text), storage.Get(key, buffer, sizeof(buffer)));
+    }
+
+    AssertEqual(true, storage.Delete(1));
+    AssertEqual(false, !!storage.Get(1, buffer, sizeof(buffer)));
+}
+
+}
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2026 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * nvram/tests/sanity/Image.cpp
+ */
+
+#include <testrunner/TestCase.h>
+
+#include <nvram/nvram.h>
+#include <nvram/Image.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+using namespace nvram;
+
+namespace
+{
+
+//! Reads the whole image file
+static bool ReadImage(const char* path, void* buffer, size_t length)
+{
+    FILE* f = fopen(path, "rb");
+    if (!f)
+    {
+        return false;
+    }
+    bool res = fread(buffer, 1, length, f) == length && fgetc(f) == EOF;
+    fclose(f);
+    return res;
+}
+
+//! Restores the emulated flash and removes the image file when leaving the scope
+struct ImageFile
+{
+    char path[20] = "/tmp/nvramXXXXXX";
+
+    ~ImageFile()
+    {
+        Flash::UnmapImage();
+        unlink(path);
+    }
+};
+
+}
+
+TEST_CASE("01 Offline Image")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+
+    struct Test { uint32_t key, value; };
+    const Test fixed = { 0x11223344, 0x55667788 };
+    const Test later = { 0x11223344, 0x99AABBCC };
+    AssertEqual(Span(fixed), Page::AddFixed("TEST", Span(fixed)));
+    AssertEqual(Span(fixed), Page::AddVar("TVAR", Span(fixed)));
+
+    // dump the emulated flash to an image file
+    Span flash = Flash::GetRange();
+    size_t length = flash.Length();
+    auto image = (uint8_t*)malloc(length);
+    auto contents = (uint8_t*)malloc(length);
+    memcpy(image, flash.Pointer(), length);
+
+    ImageFile file;
+    const char* path = file.path;
+    int fd = mkstemp(file.path);
+    AssertNotEqual(-1, fd);
+    AssertEqual(ssize_t(length), write(fd, image, length));
+    close(fd);
+
+    // the mounted image is reported as it was dumped
+    AssertEqual(true, Flash::MapImage(path, false));
+    AssertEqual(0u, unsigned((uintptr_t)Flash::GetRange().Pointer() % Flash::PageSize));
+    AssertEqual(length, Flash::GetRange().Length());
+    _manager.Mount(Span());
+
+    static char text[16384];
+    memset(text, 0, sizeof(text));
+    FILE* out = fmemopen(text, sizeof(text) - 1, "w");
+    Image::ListPages(out);
+    fclose(out);
+    AssertNotEqual((const char*)NULL, strstr(text, "TEST     seq     1 fixed 8       1 records"));
+    AssertNotEqual((const char*)NULL, strstr(text, "page types:\n"));
+    AssertNotEqual((const char*)NULL, strstr(text, "  TVAR        1 pages"));
+
+    memset(text, 0, sizeof(text));
+    out = fmemopen(text, sizeof(text) - 1, "w");
+    Image::DumpRecords(out, "TEST");
+    fclose(out);
+    AssertNotEqual((const char*)NULL, strstr(text, "    8: 44 33 22 11 88 77 66 55\n"));
+    AssertEqual((const char*)NULL, strstr(text, "TVAR"));
+
+    // changes of a private mapping are not stored in the image
+    nvram::Initialize(Span(), nvram::InitFlags::None);
+    AssertEqual(Span(later.value), Page::ReplaceFixed("TEST", later.key, Span(later.value)));
+    AssertEqual(true, ReadImage(path, contents, length));
+    AssertEqual(0, memcmp(image, contents, length));
+
+    // unless they are requested to be written back
+    AssertEqual(true, Flash::MapImage(path, true));
+    nvram::Initialize(Span(), nvram::InitFlags::None);
+    AssertEqual(Span(fixed), Page::FindNewestFirst("TEST", fixed.key));
+    AssertEqual(Span(later.value), Page::ReplaceFixed("TEST", later.key, Span(later.value)));
+    AssertEqual(true, ReadImage(path, contents, length));
+    AssertNotEqual((const void*)NULL, memmem(contents, length, &later, sizeof(later)));
+
+    free(image);
+    free(contents);
+}
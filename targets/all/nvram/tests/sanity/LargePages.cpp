@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2026 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * nvram/tests/sanity/LargePages.cpp
+ */
+
+#include <testrunner/TestCase.h>
+
+#include <nvram/nvram.h>
+
+#if NVRAM_LARGE_PAGES
+
+using namespace nvram;
+
+namespace
+{
+
+struct Item { uint32_t a, b, c; };
+
+TEST_CASE("01 Allocation")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+    AssertEqual(true, nvram::UseLargePages("LRGE"));
+    AssertEqual(true, _manager.UsesLargePages("LRGE"));
+    AssertEqual(false, _manager.UsesLargePages("SMLL"));
+
+    size_t pages = nvram::PagesAvailable();
+
+    // a regular page occupies only one page of a block
+    auto* small = Page::New("SMLL");
+    AssertNotEqual((const Page*)NULL, small);
+    AssertEqual(false, small->Block()->IsLarge());
+    AssertEqual(PagePayload, small->Payload());
+    AssertEqual(pages - 1, nvram::PagesAvailable());
+
+    // a large page needs a block of its own
+    auto* large = Page::New("LRGE");
+    AssertNotEqual((const Page*)NULL, large);
+    AssertNotEqual(small->Block(), large->Block());
+    AssertEqual(true, large->Block()->IsLarge());
+    AssertEqual(large->Block()->begin(), large);
+    AssertEqual(large->Block()->begin() + 1, large->Block()->end());
+    AssertEqual(LargePagePayload, large->Payload());
+    AssertEqual(LargePagePayload - 4, size_t(large->UnusedBytes()));
+    AssertEqual(pages - 1 - PagesPerBlock, nvram::PagesAvailable());
+
+    // the remaining pages of the regular block are still used for regular pages
+    auto* small2 = Page::New("SMLL");
+    AssertEqual(small->Block(), small2->Block());
+
+    // records anywhere in the large page belong to it
+    uint32_t words[PagePayload / 8] = {};
+    Span rec;
+    while (Page::FromPtr(rec = Page::AddVar("LRGE", Span(words))) == large)
+    {
+        words[0]++;
+    }
+    AssertEqual(true, words[0] > PagesPerBlock * ((PagePayload - 4) / (sizeof(words) + 4)));
+    AssertEqual(true, Page::FindUnorderedFirst("LRGE", words[0] - 1).Pointer() > (const uint8_t*)large + PageSize);
+    AssertEqual(true, Page::FromPtr(rec)->Block()->IsLarge());
+
+    // the layout is found after reinitialization
+    nvram::Initialize(Span());
+    AssertEqual(pages - 2 - 2 * PagesPerBlock, nvram::PagesAvailable());
+    for (uint32_t i = 0; i <= words[0]; i++)
+    {
+        AssertEqual(true, !!Page::FindUnorderedFirst("LRGE", i));
+    }
+    AssertEqual(true, large->Block()->IsLarge());
+    AssertEqual(false, small->Block()->IsLarge());
+}
+
+TEST_CASE("02 Erase")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+    nvram::UseLargePages("LRGE");
+
+    size_t pages = nvram::PagesAvailable();
+    auto* large = Page::New("LRGE");
+    AssertEqual(true, !!Page::AddVar("LRGE", 1, Span(WORDS(1, 2, 3))));
+    AssertEqual(pages - PagesPerBlock, nvram::PagesAvailable());
+
+    // the block returns to regular pages when erased
+    nvram::EraseAll("LRGE");
+    kernel::Scheduler::Main().Run();
+    AssertEqual(pages, nvram::PagesAvailable());
+    AssertEqual(false, large->Block()->IsLarge());
+
+    for (auto& b: Blocks())
+    {
+        AssertEqual(false, b.IsLarge());
+    }
+}
+
+TEST_CASE("03 Fixed Records")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+    nvram::UseLargePages("LFIX");
+
+    // more keys than fit on a regular page
+    FixedUniqueKeyStorage<Item> storage("LFIX");
+    constexpr uint32_t keys = PagePayload / 16 * 2;
+    static_assert(keys < LargePagePayload / 16, "keys must fit a single large page");
+
+    for (uint32_t key = 1; key <= keys; key++)
+    {
+        AssertNotEqual((const Item*)NULL, storage.Set(key, Item { key, key, key }));
+    }
+    AssertEqual(Page::First("LFIX"), Page::NewestFirst("LFIX"));
+    AssertEqual(true, Page::First("LFIX")->Block()->IsLarge());
+
+    for (uint32_t key = 1; key <= keys; key++)
+    {
+        auto* item = storage.Get(key);
+        AssertNotEqual((const Item*)NULL, item);
+        AssertEqual(key, item->a);
+        AssertEqual(Page::FindUnorderedFirst("LFIX", key).Pointer() + 4, (const uint8_t*)item);
+    }
+}
+
+TEST_CASE("04 Relocation")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+    nvram::UseLargePages("LRGE");
+    nvram::RegisterCollector("LRGE", 1, CollectorRelocate);
+    nvram::RegisterCollector("SMLL", 1, CollectorRelocate);
+
+    VariableUniqueKeyStorage storage("LRGE");
+    VariableUniqueKeyStorage config("SMLL");
+    constexpr uint32_t keys = 40;
+    uint32_t data[24] = {};
+
+    // overwrite the keys many times, so that the pages must be collected repeatedly
+    for (uint32_t i = 0; i < 2000; i++)
+    {
+        data[0] = i;
+        uint32_t key = i % keys + 1;
+        AssertEqual(true, !!storage.Set(key, Span(data)));
+        AssertEqual(true, !!config.Set(i % 4 + 1, Span(i)));
+        kernel::Scheduler::Main().Run();
+    }
+
+    for (auto* p = Page::First("LRGE"); p; p = p->Next())
+    {
+        AssertEqual(true, p->Block()->IsLarge());
+    }
+    for (auto* p = Page::First("SMLL"); p; p = p->Next())
+    {
+        AssertEqual(false, p->Block()->IsLarge());
+    }
+
+    nvram::Initialize(Span());
+    for (uint32_t key = 1; key <= keys; key++)
+    {
+        Span rec = storage.Get(key);
+        AssertEqual(sizeof(data), rec.Length());
+        AssertEqual(2000 - keys + key - 1, rec.Element<uint32_t>());
+    }
+}
+
+TEST_CASE("05 Evacuation")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+    nvram::UseLargePages("LRGE");
+
+    // leave a single valid page in every block, the only free pages are in the last one
+    unsigned blocks = 0;
+    while (nvram::PagesAvailable() > PagesPerBlock)
+    {
+        AssertNotEqual((const Page*)NULL, Page::New("SMLL"));
+        for (unsigned i = 1; i < PagesPerBlock; i++)
+        {
+            AssertNotEqual((const Page*)NULL, Page::New("TEMP"));
+        }
+        blocks++;
+    }
+    AssertNotEqual((const Page*)NULL, Page::New("SMLL"));
+    kernel::Scheduler::Main().Run();
+    AssertEqual(PagesPerBlock - 1, nvram::PagesAvailable());
+
+    // once there are pages to reclaim, the collector moves the remaining page out of a block
+    nvram::EraseAll("TEMP");
+    _manager.RunCollector();
+    kernel::Scheduler::Main().Run();
+    AssertEqual(2 * PagesPerBlock - 2, nvram::PagesAvailable());
+
+    auto* large = Page::New("LRGE");
+    AssertNotEqual((const Page*)NULL, large);
+    AssertEqual(true, large->Block()->IsLarge());
+
+    nvram::Initialize(Span());
+    unsigned count = 0;
+    for (auto* p = Page::First("SMLL"); p; p = p->Next())
+    {
+        AssertEqual(false, p->Block()->IsLarge());
+        count++;
+    }
+    AssertEqual(blocks + 1, count);
+}
+
+}
+
+#endif
@@ -113,4 +113,853 @@ TEST_CASE("04 Collect Oldest")
     AssertNotEqual(0u, endTime);
 }
 
+#if NVRAM_MAX_BLOCKS
+
+TEST_CASE("05 Blocks Kept Free")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+    nvram::RegisterCollector("TEST", 1, CollectorDiscardOldest);
+
+    // blocks are allocated from the end, same as without the bitmaps
+    auto* first = Page::New("TEST");
+    AssertEqual(Blocks().end() - 1, first->Block());
+
+    for (auto& b: Blocks())
+    {
+        for (UNUSED auto& p: b)
+        {
+            Page::New("TEST");
+        }
+    }
+    AssertEqual((const Page*)NULL, Page::New("TEST"));
+
+    kernel::Scheduler::Main().Run();
+
+    // the collector must make room for both the pages and the whole blocks
+    size_t unused = 0;
+    for (auto& b: Blocks())
+    {
+        bool used = false;
+        for (auto& p: b)
+        {
+            used |= !b.IsValid() || !p.IsEmpty();
+        }
+        unused += !used;
+    }
+    AssertEqual(true, unused >= BlocksKeptFree);
+    AssertEqual(true, nvram::PagesAvailable() >= PagesKeptFree);
+
+    // the state is reconstructed after initialization
+    nvram::Initialize(Span());
+    AssertEqual(true, nvram::PagesAvailable() >= PagesKeptFree);
+    AssertNotEqual((const Page*)NULL, Page::New("TEST"));
+}
+
+#endif
+
+#if NVRAM_WEAR_LEVELING
+
+//! Formats all blocks with the specified generations
+static void FormatBlocks(uint32_t (*generation)(size_t index))
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+
+    size_t i = 0;
+    for (auto& b: Blocks())
+    {
+        uint32_t header[] = { ID("NVRM"), generation(i++) };
+        Flash::Write(&b, Span(header));
+    }
+
+    nvram::Initialize(Span());
+}
+
+TEST_CASE("06 Wear Aware Allocation")
+{
+    // the blocks at the end are less worn
+    FormatBlocks([](size_t i) { return uint32_t(100 - i); });
+
+    auto* p = Page::New("TEST");
+    AssertEqual(Blocks().end() - 1, p->Block());
+
+    // the block is filled before moving on
+    for (size_t i = 1; i < PagesPerBlock; i++)
+    {
+        AssertEqual(p->Block(), Page::New("TEST")->Block());
+    }
+    AssertEqual(Blocks().end() - 2, Page::New("TEST")->Block());
+}
+
+#endif
+
+#if NVRAM_WEAR_LEVELING_SPREAD
+
+TEST_CASE("07 Static Wear Leveling")
+{
+    // the first block is much less worn than the rest
+    FormatBlocks([](size_t i) { return uint32_t(i ? 50 + i : 1); });
+
+    VariableKeyStorage storage("COLD");
+    for (uint32_t i = 1; i <= PagesPerBlock; i++)
+    {
+        auto* p = Page::New("COLD");
+        AssertEqual(Blocks().begin(), p->Block());
+        AssertEqual(Span(i), storage.Add(i, Span(i)));
+    }
+
+    uint16_t sequences[PagesPerBlock];
+    size_t n = 0;
+    for (auto p: Page::EnumerateOldestFirst("COLD"))
+    {
+        sequences[n++] = p->Sequence();
+    }
+
+    kernel::Scheduler::Main().Run();
+
+    // the cold pages are moved to the most worn block, in the same order
+    auto* cold = Page::OldestFirst("COLD")->Block();
+    AssertEqual(Blocks().end() - 1, cold);
+    n = 0;
+    for (auto p: Page::EnumerateOldestFirst("COLD"))
+    {
+        AssertEqual(cold, p->Block());
+        AssertEqual(sequences[n++], p->Sequence());
+    }
+    AssertEqual(PagesPerBlock, n);
+
+    uint32_t key = 0;
+    for (Span rec = Page::FindOldestFirst("COLD"); rec; rec = Page::FindOldestNext(rec))
+    {
+        key++;
+        AssertEqual(key, rec.Element<uint32_t>());
+        AssertEqual(Span(key), storage.UnorderedFirst(key));
+    }
+    AssertEqual(PagesPerBlock, key);
+
+    // the least worn block has been erased for reuse
+    AssertEqual(true, Blocks().begin()->IsEmpty() || Blocks().begin()->Generation() == 2);
+}
+
+#endif
+
+TEST_CASE("08 Collect Cost Benefit")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+
+    struct Test { uint32_t key, value; };
+    constexpr uint32_t size = sizeof(Test), perPage = PagePayload / size;
+
+    // two full pages and a few records on the third
+    for (uint32_t key = 1; key <= perPage * 2 + 2; key++)
+    {
+        Test t = { key, key };
+        AssertEqual(Span(t), Page::AddFixed("TEST", Span(t)));
+    }
+
+    auto oldest = Page::OldestFirst("TEST");
+    auto middle = oldest->OldestNext();
+    auto newest = middle->OldestNext();
+    AssertEqual(newest, Page::NewestFirst("TEST"));
+
+    // the oldest page keeps a quarter of its records, the middle one just one
+    for (uint32_t key = perPage / 4 + 1; key <= perPage; key++)
+    {
+        Page::Delete("TEST", key);
+    }
+    for (uint32_t key = perPage + 2; key <= perPage * 2; key++)
+    {
+        Page::Delete("TEST", key);
+    }
+    AssertEqual(perPage / 4 * size, oldest->UsedBytes());
+    AssertEqual(size, middle->UsedBytes());
+    AssertEqual(2 * size, newest->UsedBytes());
+
+    // the middle page is the cheapest to collect, even though the oldest one would fit as well
+    AssertEqual(middle, CollectorRelocateCostBenefit(NULL, "TEST"));
+    AssertEqual(0u, middle->UsedBytes());
+    AssertEqual(3 * size, newest->UsedBytes());
+    AssertEqual(perPage / 4 * size, oldest->UsedBytes());
+    AssertEqual(perPage + 1, Page::FindNewestFirst("TEST").Element<uint32_t>());
+}
+
+#if NVRAM_CHECKPOINT
+
+TEST_CASE("09 Checkpoint")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+
+    VariableKeyStorage storage("TEST");
+    for (uint32_t i = 1; i <= 10; i++)
+    {
+        AssertEqual(Span(i), storage.Add(i, Span(i)));
+    }
+    kernel::Scheduler::Main().Run();
+
+    AssertEqual(true, nvram::Checkpoint());
+    auto pages = nvram::PagesAvailable();
+    auto first = UsedBlocks().begin();
+
+    // writing records doesn't invalidate the checkpoint
+    uint32_t last = 11;
+    AssertEqual(Span(last), storage.Add(last, Span(last)));
+    AssertEqual(pages, nvram::PagesAvailable());
+
+    // damage an empty block, the full scan would not consider it free
+    const Block* damaged = NULL;
+    for (auto& b: Blocks())
+    {
+        if (b.IsEmpty())
+        {
+            damaged = &b;
+            break;
+        }
+    }
+    AssertNotEqual((const Block*)NULL, damaged);
+#if NVRAM_FLASH_DOUBLE_WRITE
+    Flash::WriteDouble((const uint32_t*)(damaged + 1) - 2, 0, 0);
+#else
+    Flash::WriteWord((const uint32_t*)(damaged + 1) - 1, 0);
+#endif
+
+    // the state is restored from the checkpoint without scanning the blocks
+    nvram::Initialize(Span(), nvram::InitFlags::None);
+    AssertEqual(pages, nvram::PagesAvailable());
+    AssertEqual(first, UsedBlocks().begin());
+    AssertEqual(Span(last), storage.NewestFirst(last));
+    AssertEqual(true, nvram::Checkpoint());
+    kernel::Scheduler::Main().Run();
+
+    // allocating a page invalidates the checkpoint
+    AssertNotEqual((const Page*)NULL, Page::New("TEST"));
+    nvram::Initialize(Span(), nvram::InitFlags::None);
+    AssertEqual(pages - 1 - PagesPerBlock, nvram::PagesAvailable());
+
+    // the damaged block is erased
+    kernel::Scheduler::Main().Run();
+    AssertEqual(pages - 1, nvram::PagesAvailable());
+    AssertEqual(true, damaged->IsEmpty());
+
+    for (uint32_t i = 1; i <= last; i++)
+    {
+        AssertEqual(Span(i), storage.NewestFirst(i));
+    }
+}
+
+#endif
+
+#if NVRAM_FLASH_ASYNC_WRITE
+
+TEST_CASE("10 Asynchronous Relocation")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+    nvram::RegisterCollector("TEST", 0, CollectorRelocate);
+
+    VariableKeyStorage storage("TEST");
+    uint32_t value[4] = {};
+
+    // fill a page and start the next one
+    uint32_t count = 0;
+    while (Page::OldestFirst("TEST") == Page::NewestFirst("TEST"))
+    {
+        count++;
+        value[0] = count;
+        AssertEqual(Span(value), storage.Add(count, Span(value)));
+    }
+
+    // keep just every eighth record on the oldest page
+    auto oldest = Page::OldestFirst("TEST");
+    auto newest = Page::NewestFirst("TEST");
+    unsigned kept = 0;
+    for (uint32_t key = 1; key < count; key++)
+    {
+        if (key % 8)
+        {
+            AssertEqual(true, storage.Delete(key));
+        }
+        else
+        {
+            kept++;
+        }
+    }
+    AssertNotEqual(0u, kept);
+
+    // the records are moved by the collector task, with the oldest page erased afterwards
+    auto asyncWrites = Flash::stats.asyncWrites;
+    _manager.RunCollector();
+    kernel::Scheduler::Main().Run();
+
+    AssertEqual(newest, Page::OldestFirst("TEST"));
+    AssertEqual(newest, Page::NewestFirst("TEST"));
+    for (uint32_t key = 1; key <= count; key++)
+    {
+        value[0] = key;
+        AssertEqual(key % 8 && key != count ? Span() : Span(value), storage.NewestFirst(key));
+    }
+#if NVRAM_FLASH_DOUBLE_WRITE
+    AssertEqual(asyncWrites, Flash::stats.asyncWrites);
+#else
+    AssertEqual(asyncWrites + kept, Flash::stats.asyncWrites);
+#endif
+}
+
+#endif
+
+#if NVRAM_FLASH_ERASE_BANKS > 1
+
+TEST_CASE("11 Overlapped Erase")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+    auto pages = nvram::PagesAvailable();
+
+    for (auto& b: Blocks())
+    {
+        for (UNUSED auto& p: b)
+        {
+            Page::New("TEST");
+        }
+    }
+
+    // the erase takes as long as needed for the bank with the most blocks
+    unsigned perBank[NVRAM_FLASH_ERASE_BANKS] = {}, longest = 0, total = 0;
+    for (auto& b: Blocks())
+    {
+        total++;
+        unsigned n = ++perBank[Flash::EraseBank(&b)];
+        longest = n > longest ? n : longest;
+    }
+    AssertEqual(true, longest < total);
+
+    auto startTime = kernel::Scheduler::Main().Run();
+    nvram::EraseAll("TEST");
+    auto endTime = kernel::Scheduler::Main().Run();
+    AssertEqual(longest * EMULATED_FLASH_ERASE_TICKS, endTime - startTime);
+
+    AssertEqual(pages, nvram::PagesAvailable());
+    AssertEqual((const Page*)NULL, Page::First("TEST"));
+}
+
+struct EraseWriter
+{
+    Span written;
+
+    async(Write);
+} eraseWriter;
+
+async(EraseWriter::Write)
+async_def()
+{
+    // let the collector start the erases first
+    async_delay_ms(1);
+    written = VariableKeyStorage("DATA").Add(2, Span(2u));
+}
+async_end
+
+TEST_CASE("12 Write During Erase")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+    auto pages = nvram::PagesAvailable();
+
+    VariableKeyStorage storage("DATA");
+    AssertEqual(Span(1u), storage.Add(1, Span(1u)));
+    auto data = Page::NewestFirst("DATA");
+
+    for (auto& b: Blocks())
+    {
+        for (UNUSED auto& p: b)
+        {
+            Page::New("TEST");
+        }
+    }
+
+    // the other blocks in the bank of the data page are erased while the record is written,
+    // the emulated bank cannot be programmed unless the write suspends the erase
+    auto suspends = Flash::stats.eraseSuspends;
+    nvram::EraseAll("TEST");
+    kernel::Task::Run(&eraseWriter, &EraseWriter::Write);
+    kernel::Scheduler::Main().Run();
+
+    AssertEqual(Span(2u), eraseWriter.written);
+    AssertEqual(data, Page::NewestFirst("DATA"));
+    AssertEqual(suspends + 1, Flash::stats.eraseSuspends);
+    AssertEqual(pages - 1, nvram::PagesAvailable());
+    AssertEqual((const Page*)NULL, Page::First("TEST"));
+}
+
+#endif
+
+#if NVRAM_MULTIPLE_MANAGERS
+
+TEST_CASE("13 Multiple Managers")
+{
+    // the default manager keeps the lower half of the flash, the log is stored in the upper half
+    Span flash = Flash::GetRange();
+    Span lower = flash.Left(flash.Length() / 2);
+    Span upper = flash.RemoveLeft(flash.Length() / 2);
+    nvram::Initialize(lower, nvram::InitFlags::Reset);
+
+    {
+        Manager logs;
+        logs.Route("LOGS");
+        AssertEqual(true, logs.Initialize(upper, nvram::InitFlags::Reset));
+        nvram::RegisterCollector("LOGS", 1, CollectorDiscardOldest);
+        AssertEqual(&logs, &Manager::For("LOGS"));
+        AssertEqual(&_manager, &Manager::For("CONF"));
+
+        // new blocks are allocated by the manager of the page type
+        auto blk = Block::New("LOGS");
+        AssertNotEqual((const Block*)NULL, blk);
+        AssertEqual(&logs, &Manager::Containing(blk));
+        AssertEqual(&_manager, &Manager::Containing(Block::New()));
+
+        VariableStorage log("LOGS");
+        VariableKeyStorage conf("CONF");
+        for (uint32_t i = 1; i <= 10; i++)
+        {
+            AssertEqual(Span(i), conf.Add(i, Span(i)));
+            AssertEqual(Span(i), log.Add(Span(i)));
+        }
+
+        // records are stored in the area of the manager of their page type
+        AssertEqual(true, log.NewestFirst().Pointer() >= upper.begin());
+        AssertEqual(true, conf.NewestFirst(10).Pointer() < lower.end());
+        AssertEqual(&logs, &Manager::Containing(log.NewestFirst().Pointer()));
+        AssertEqual(&_manager, &Manager::Containing(conf.NewestFirst(10).Pointer()));
+
+        // filling up the log area collects only the log pages
+        auto pages = nvram::PagesAvailable();
+        uint8_t entry[40] = {};
+        for (uint32_t i = 0; i < upper.Length() / sizeof(entry) * 2; i++)
+        {
+            entry[0] = i;
+            if (!log.Add(Span(entry)))
+            {
+                kernel::Scheduler::Main().Run();
+                AssertEqual(Span(entry), log.Add(Span(entry)));
+            }
+        }
+        kernel::Scheduler::Main().Run();
+
+        const uint32_t first = 1, last = 10;
+        AssertNotEqual(Span(first), log.OldestFirst());
+        AssertEqual(pages, nvram::PagesAvailable());
+        for (uint32_t i = 1; i <= 10; i++)
+        {
+            AssertEqual(Span(i), conf.NewestFirst(i));
+        }
+
+        nvram::EraseAll("LOGS");
+        kernel::Scheduler::Main().Run();
+        AssertEqual(false, !!log.NewestFirst());
+        AssertEqual(Span(last), conf.NewestFirst(10));
+    }
+
+    // page types are stored by the default manager once the manager they were routed to is gone
+    AssertEqual(&_manager, &Manager::For("LOGS"));
+}
+
+#endif
+
+#if NVRAM_STATS
+
+TEST_CASE("14 Statistics")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+    kernel::Scheduler::Main().Run();
+    _manager.ResetStats();
+    auto& stats = _manager.Stats();
+    AssertEqual(0u, stats.lookups);
+    AssertEqual(0u, stats.recordsWritten);
+    AssertEqual(0u, stats.erases);
+
+    VariableStorage storage("TEST");
+    for (uint32_t i = 1; i <= 10; i++)
+    {
+        AssertEqual(Span(i), storage.Add(Span(i)));
+    }
+    AssertEqual(10u, stats.recordsWritten);
+    AssertEqual(true, stats.recordBytes >= 10 * 8u);
+    AssertEqual(0u, stats.writeFailures);
+
+    // the oldest record is found right at the start of the only page
+    auto lookups = stats.lookups, pages = stats.pagesScanned, walked = stats.recordsWalked;
+    const uint32_t values[] = { 1, 2 };
+    AssertEqual(Span(values[0]), storage.OldestFirst());
+    AssertEqual(lookups + 1, stats.lookups);
+    AssertEqual(pages + 1, stats.pagesScanned);
+    AssertEqual(walked + 1, stats.recordsWalked);
+
+    auto shreds = stats.recordShreds;
+    AssertEqual(true, Page::Delete("TEST", 5));
+    AssertEqual(shreds + 1, stats.recordShreds);
+
+    // the record on the older page is moved to the newest one
+    VariableStorage moved("MOVE");
+    AssertEqual(Span(values[0]), moved.Add(Span(values[0])));
+    AssertNotEqual((const Page*)NULL, Page::New("MOVE"));
+    AssertEqual(Span(values[1]), moved.Add(Span(values[1])));
+    AssertNotEqual((const Page*)NULL, CollectorRelocate(NULL, "MOVE"));
+    AssertEqual(1u, stats.relocatedRecords);
+    AssertEqual(4u, stats.relocatedBytes);
+
+    // running out of pages and collecting them
+    nvram::RegisterCollector("FILL", 1, CollectorDiscardOldest);
+    while (Page::New("FILL"));
+    AssertEqual(1u, stats.allocationFailures);
+    kernel::Scheduler::Main().Run();
+    AssertNotEqual(0u, stats.collectorRuns);
+    AssertNotEqual(0u, stats.collected[1]);
+    AssertNotEqual(0u, stats.erases);
+    AssertEqual(0u, stats.eraseFailures);
+
+    _manager.ResetStats();
+    AssertEqual(0u, stats.erases);
+    AssertEqual(0u, stats.recordsWritten);
+}
+
+#endif
+
+//! Notifications received by a test notifier
+struct NotificationLog
+{
+    unsigned count;
+    ID id;
+    uint32_t key;
+};
+
+static void LogNotification(NotificationLog* log, ID id, uint32_t key)
+{
+    log->count++;
+    log->id = id;
+    log->key = key;
+}
+
+TEST_CASE("15 Keyed Notifications")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+
+    NotificationLog log = {}, other = {};
+    unsigned version;
+    nvram::RegisterKeyNotifier("AAAA", GetDelegate(&LogNotification, &other));
+    nvram::RegisterKeyNotifier("TEST", GetDelegate(&LogNotification, &log));
+    nvram::RegisterKeyNotifier("ZZZZ", GetDelegate(&LogNotification, &other));
+    nvram::RegisterVersionTracker("TEST", &version);
+
+    VariableKeyStorage storage("TEST");
+    const uint32_t data[] = { 1, 2 };
+    AssertEqual(Span(data[0]), storage.Add(5, Span(data[0])));
+    // versions are always updated immediately
+    AssertEqual(2u, version);
+    kernel::Scheduler::Main().Run();
+    AssertEqual(1u, log.count);
+    AssertEqual(ID("TEST"), log.id);
+    AssertEqual(5u, log.key);
+
+    AssertEqual(true, storage.Delete(5));
+    kernel::Scheduler::Main().Run();
+    AssertEqual(2u, log.count);
+    AssertEqual(5u, log.key);
+
+    uint32_t values[] = { 6, 7 };
+    Page::BatchRecord records[] = { { 6, Span(values[0]) }, { 7, Span(values[1]) } };
+    AssertEqual(2u, storage.AddBatch(records, countof(records)));
+    kernel::Scheduler::Main().Run();
+    AssertEqual(3u, log.count);
+    AssertEqual(0u, log.key);
+    AssertEqual(0u, other.count);
+
+#if NVRAM_NOTIFY_DEFERRED
+    // changes are coalesced until the notification task runs
+    AssertEqual(Span(data[0]), storage.Add(8, Span(data[0])));
+    AssertEqual(Span(data[1]), storage.Add(8, Span(data[1])));
+    AssertEqual(3u, log.count);
+    kernel::Scheduler::Main().Run();
+    AssertEqual(4u, log.count);
+    AssertEqual(8u, log.key);
+
+    AssertEqual(Span(data[0]), storage.Add(8, Span(data[0])));
+    AssertEqual(Span(data[0]), storage.Add(9, Span(data[0])));
+    AssertEqual(8u, version);
+    kernel::Scheduler::Main().Run();
+    AssertEqual(5u, log.count);
+    AssertEqual(0u, log.key);
+
+    // too many changed page types to keep track of, all notifiers are invoked
+    NotificationLog many = {};
+    for (uint32_t id = 1; id <= NVRAM_NOTIFY_DEFERRED + 1; id++)
+    {
+        nvram::RegisterKeyNotifier(id, GetDelegate(&LogNotification, &many));
+    }
+    for (uint32_t id = 1; id <= NVRAM_NOTIFY_DEFERRED + 1; id++)
+    {
+        AssertEqual(Span(id), Page::AddVar(id, Span(id)));
+    }
+    kernel::Scheduler::Main().Run();
+    AssertEqual(NVRAM_NOTIFY_DEFERRED + 1u, many.count);
+    AssertEqual(0u, many.key);
+    AssertEqual(6u, log.count);
+    AssertEqual(2u, other.count);
+#endif
+}
+
+TEST_CASE("16 Merge Collector")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+
+    struct Test { uint32_t key, value; };
+    constexpr uint32_t size = sizeof(Test), perPage = PagePayload / size;
+
+    // three full pages and a few records on the fourth
+    for (uint32_t key = 1; key <= perPage * 3 + 2; key++)
+    {
+        Test t = { key, key };
+        AssertEqual(Span(t), Page::AddFixed("TEST", Span(t)));
+    }
+
+    auto first = Page::OldestFirst("TEST");
+    auto second = first->OldestNext();
+    auto third = second->OldestNext();
+    auto fourth = third->OldestNext();
+    AssertEqual(fourth, Page::NewestFirst("TEST"));
+
+    // the first two pages keep only four records each, the third one remains full
+    for (uint32_t key = 5; key <= perPage; key++)
+    {
+        Page::Delete("TEST", key);
+    }
+    for (uint32_t key = perPage + 5; key <= perPage * 2; key++)
+    {
+        Page::Delete("TEST", key);
+    }
+
+    // a newer record for one of the keys, without shredding the old one
+    Test updated = { 2, 100 };
+    AssertEqual(Span(updated), Page::AddFixed("TEST", Span(updated)));
+
+#if NVRAM_KEY_INDEX
+    // the superseded record is recognized using the index instead of searching the pages
+    IndexedFixedUniqueKeyStorage<uint32_t, 256> indexed("TEST");
+    AssertEqual(100u, *indexed.Get(2));
+#endif
+
+    // the sparse pages are merged, the oldest one is returned and the other one released
+    AssertEqual(first, CollectorMergeUnique(NULL, "TEST"));
+    AssertEqual(0u, first->UsedBytes());
+    AssertEqual(true, second->IsErasable());
+    AssertEqual(perPage * size, third->UsedBytes());
+    AssertEqual(3 * size, fourth->UsedBytes());
+
+    // the records keep their order, the superseded one is gone
+    auto merged = Page::NewestFirst("TEST");
+    AssertNotEqual(fourth, merged);
+    const uint32_t order[] = { 1, 3, 4, perPage + 1, perPage + 2, perPage + 3, perPage + 4 };
+    Span rec = merged->FirstRecord();
+    for (auto key: order)
+    {
+        AssertEqual(key, rec.Element<uint32_t>());
+        rec = Page::NextRecord(rec);
+    }
+    AssertEqual(false, !!rec);
+    AssertEqual(Span(updated), Page::FindNewestFirst("TEST", 2));
+#if NVRAM_KEY_INDEX
+    AssertEqual(100u, *indexed.Get(2));
+    AssertEqual(Page::FindNewestFirst("TEST", 3).Pointer() + 4, (const uint8_t*)indexed.Get(3));
+#endif
+}
+
+#if NVRAM_FLASH_DOUBLE_WRITE && NVRAM_UNIQUE_KEY_PAGES && !NVRAM_VAR_FOOTERS
+
+TEST_CASE("17 Interrupted Move")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+    nvram::UseUniqueKeys("UNIQ");
+
+    // the first record looks like an original with the last doubleword shredded,
+    // the newer one like its complete copy written last on another page
+    const uint32_t original[] = { 1, 0x11111111, 0x22222222, 0, 0 };
+    const uint32_t copy[] = { 1, 0x11111111, 0x22222222, 0x33333333, 0x44444444 };
+    const ID ids[] = { "UNIQ", "MULT" };
+    for (ID id: ids)
+    {
+        AssertNotEqual(false, !!Page::AddVar(id, Span(original)));
+        auto first = Page::NewestFirst(id);
+        for (uint32_t key = 2; Page::NewestFirst(id) == first; key++)
+        {
+            uint32_t filler[] = { key, key, key, key, key };
+            AssertNotEqual(false, !!Page::AddVar(id, Span(filler)));
+        }
+        AssertNotEqual(false, !!Page::AddVar(id, Span(copy)));
+    }
+
+    nvram::Initialize(Span());
+
+    // only the page type with unique keys loses the original
+    AssertEqual(Span(copy), Page::FindUnorderedFirst("UNIQ", 1));
+    AssertEqual(false, !!Page::FindUnorderedNext(Page::FindUnorderedFirst("UNIQ", 1), 1));
+    unsigned count = 0;
+    for (Span rec = Page::FindUnorderedFirst("MULT", 1); rec; rec = Page::FindUnorderedNext(rec, 1))
+    {
+        count++;
+    }
+    AssertEqual(2u, count);
+}
+
+#endif
+
+#if NVRAM_WEAR_LEVELING_SPREAD || NVRAM_LARGE_PAGES
+
+//! Writes a page with the same header as @p page and the specified records, as if left behind by an interrupted copy
+static const Page* CopyHeader(const Page* page, Span records)
+{
+    auto* copy = page->Block()->begin();
+    while (!copy->IsEmpty())
+        copy++;
+
+    uint32_t header[] = { page->GetID(), page->Sequence() | (page->GetRecordSize() << 16) };
+    Flash::Write(copy, Span(header));
+    Flash::Write((const uint8_t*)copy + PageHeader, records);
+    return copy;
+}
+
+TEST_CASE("18 Interrupted Copy")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+
+    const uint32_t records[][2] = { { 1, 10 }, { 2, 20 }, { 3, 30 }, { 4, 40 }, { 5, 50 } };
+    for (auto& rec: records)
+    {
+        AssertNotEqual(false, !!Page::AddFixed("COPY", Span(rec)));
+    }
+    AssertNotEqual(false, !!Page::AddFixed("OTHR", Span(records[0])));
+
+    // a copy holding the first records, the last one cut short, and a page with different records
+    const uint32_t prefix[][2] = { { 1, 10 }, { 2, 20 }, { 3, ~0u } };
+    const uint32_t other[][2] = { { 9, 90 } };
+    CopyHeader(Page::NewestFirst("COPY"), Span(prefix));
+    CopyHeader(Page::NewestFirst("OTHR"), Span(other));
+
+    nvram::Initialize(Span());
+
+    // only the copy is erased, the original keeps all records
+    AssertEqual(true, Page::NewestFirst("COPY") == Page::OldestFirst("COPY"));
+    size_t n = 0;
+    for (Span rec = Page::FindOldestFirst("COPY"); rec; rec = Page::FindOldestNext(rec))
+    {
+        AssertEqual(Span(records[n++]), rec);
+    }
+    AssertEqual(countof(records), n);
+
+    AssertEqual(Span(records[0]), Page::FindUnorderedFirst("OTHR", 1));
+    AssertEqual(Span(other[0]), Page::FindUnorderedFirst("OTHR", 9));
+}
+
+#endif
+
+#if NVRAM_CHECKPOINT && NVRAM_STATS
+
+TEST_CASE("19 Checkpoint Without Scan")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+
+    VariableKeyStorage storage("TEST");
+    const uint32_t count = 10;
+    for (uint32_t i = 1; i <= count; i++)
+    {
+        AssertNotEqual((const Page*)NULL, Page::New("TEST"));
+        AssertEqual(Span(i), storage.Add(i, Span(i)));
+    }
+    kernel::Scheduler::Main().Run();
+    AssertEqual(true, nvram::Checkpoint());
+
+    // only the checkpoint page is read when the state is restored
+    nvram::Initialize(Span());
+    AssertEqual(true, _manager.Stats().pagesScanned < count);
+
+    // the records are found in order through the restored state
+    uint32_t key = 0;
+    for (Span rec = Page::FindOldestFirst("TEST"); rec; rec = Page::FindOldestNext(rec))
+    {
+        key++;
+        AssertEqual(key, rec.Element<uint32_t>());
+        AssertEqual(Span(key), storage.UnorderedFirst(key));
+    }
+    AssertEqual(count, key);
+
+    // without the checkpoint, all pages are scanned
+    AssertNotEqual((const Page*)NULL, Page::New("TEST"));
+    nvram::Initialize(Span());
+    AssertEqual(true, _manager.Stats().pagesScanned > count);
+}
+
+#endif
+
+#if NVRAM_WEAR_LEVELING_SPREAD && NVRAM_FLASH_ERASE_BANKS > 1
+
+TEST_CASE("20 Wear Leveling During Erase")
+{
+    // the first block is much less worn than the rest
+    FormatBlocks([](size_t i) { return uint32_t(i ? 50 + i : 1); });
+
+    VariableKeyStorage storage("COLD");
+    for (uint32_t i = 1; i <= PagesPerBlock; i++)
+    {
+        AssertEqual(Blocks().begin(), Page::New("COLD")->Block());
+        AssertEqual(Span(i), storage.Add(i, Span(i)));
+    }
+
+    // another unused block in the bank of the most worn one is being erased while the pages are copied there,
+    // the emulated bank cannot be programmed unless the copy suspends the erase
+    auto* erased = Blocks().end() - 2;
+    AssertEqual(Flash::EraseBank(Blocks().end() - 1), Flash::EraseBank(erased));
+    AssertEqual(true, Flash::EraseStart(erased));
+    auto suspends = Flash::stats.eraseSuspends;
+    kernel::Scheduler::Main().Run();
+    AssertEqual(true, Flash::EraseDone(erased));
+
+    auto* cold = Page::OldestFirst("COLD")->Block();
+    AssertEqual(Blocks().end() - 1, cold);
+    AssertEqual(true, Flash::stats.eraseSuspends > suspends);
+    for (uint32_t i = 1; i <= PagesPerBlock; i++)
+    {
+        Span rec = storage.UnorderedFirst(i);
+        AssertEqual(Span(i), rec);
+        AssertEqual(cold, Page::FromPtr(rec.Pointer())->Block());
+    }
+}
+
+#endif
+
+TEST_CASE("21 Merge Keeps History")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+
+    struct Test { uint32_t key, value; };
+    constexpr uint32_t size = sizeof(Test), perPage = PagePayload / size;
+
+    // two full pages starting with records of the same key and a record on the third one
+    for (uint32_t i = 1; i <= perPage * 2 + 1; i++)
+    {
+        Test t = { i % perPage == 1 ? 1 : i, i };
+        AssertEqual(Span(t), Page::AddFixed("TEST", Span(t)));
+    }
+
+    auto first = Page::OldestFirst("TEST");
+    for (uint32_t key = 2; key <= perPage * 2; key++)
+    {
+        Page::Delete("TEST", key);
+    }
+    AssertEqual(size, first->UsedBytes());
+    AssertEqual(size, first->OldestNext()->UsedBytes());
+
+    // both records of the key are kept by merging the pages, the older one first
+    AssertEqual(first, CollectorMerge(NULL, "TEST"));
+    const Test history[] = { { 1, 1 }, { 1, perPage + 1 } };
+    Span rec = Page::NewestFirst("TEST")->FirstRecord();
+    for (auto& t: history)
+    {
+        AssertEqual(Span(t), rec);
+        rec = Page::NextRecord(rec);
+    }
+    AssertEqual(false, !!rec);
+}
+
 }
@@ -68,7 +68,8 @@ TEST_CASE("03 Scan Random")
     for (auto p = Page::First("TEST"); p; p = p->Next())
     {
         DBGL("Found page TEST-%d @ %p", p->Sequence(), p);
-        found.reserve(p->Sequence() - 1);
+        if (found.size() < p->Sequence())
+            found.resize(p->Sequence());
         found[p->Sequence() - 1] = true;
     }
 
@@ -99,4 +100,73 @@ TEST_CASE("05 Scan New To Old")
     }
 }
 
+TEST_CASE("06 Scan After Erase")
+{
+    int last = ScatterFill();
+
+    // free the interleaved pages and reuse them
+    nvram::EraseAll("FILL");
+    kernel::Scheduler::Main().Run();
+
+    while (auto p = Page::New("TEST", 0))
+    {
+        last = p->Sequence();
+    }
+
+    int i = 1;
+    for (auto p = Page::OldestFirst("TEST"); p; p = p->OldestNext())
+    {
+        AssertEqual(i++, p->Sequence());
+    }
+    AssertEqual(last + 1, i);
+
+    for (auto p = Page::NewestFirst("TEST"); p; p = p->NewestNext())
+    {
+        AssertEqual(--i, p->Sequence());
+    }
+    AssertEqual(1, i);
+    AssertEqual((const Page*)NULL, Page::First("FILL"));
+}
+
+
+TEST_CASE("07 Sequence Wraparound")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+
+    // pages with sequences around the wraparound, out of order in the block
+    auto& b = *Blocks().begin();
+    uint32_t header[] = { ID("NVRM"), 1 };
+    Flash::Write(&b, Span(header));
+    const uint16_t sequences[] = { 1, 0xFFFE, 0, 0xFFFF };
+    const Page* pages[countof(sequences)];
+    auto* page = b.begin();
+    for (size_t i = 0; i < countof(sequences); i++, page++)
+    {
+        uint32_t pageHeader[] = { ID("TEST"), sequences[i] | (8u << 16) };
+        Flash::Write(page, Span(pageHeader));
+        pages[i] = page;
+    }
+
+    nvram::Initialize(Span());
+
+    const size_t order[] = { 1, 3, 2, 0 };
+    size_t n = 0;
+    for (auto p = Page::OldestFirst("TEST"); p; p = p->OldestNext())
+    {
+        AssertEqual(pages[order[n++]], p);
+    }
+    AssertEqual(countof(order), n);
+
+    for (auto p = Page::NewestFirst("TEST"); p; p = p->NewestNext())
+    {
+        AssertEqual(pages[order[--n]], p);
+    }
+    AssertEqual(0u, n);
+
+    auto* next = Page::New("TEST", 8);
+    AssertEqual(2, next->Sequence());
+    AssertEqual(next, Page::NewestFirst("TEST"));
+    AssertEqual(pages[0], next->NewestNext());
+}
+
 }
@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2026 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * nvram/tests/sanity/RecordWriter.cpp
+ */
+
+#include <testrunner/TestCase.h>
+
+#include <nvram/nvram.h>
+
+using namespace nvram;
+
+namespace
+{
+
+static const uint8_t payload[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24 };
+
+TEST_CASE("01 Streamed Record")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+
+    unsigned version;
+    nvram::RegisterVersionTracker("TEST", &version);
+
+    VariableKeyStorage storage("TEST");
+    RecordWriter writer("TEST");
+
+    // parts crossing write unit boundaries in various ways
+    AssertEqual(true, writer.Begin(1, sizeof(payload)));
+    AssertEqual(true, writer.Append(Span(payload, 3)));
+    AssertEqual(true, writer.Append(Span(payload + 3, 5)));
+    AssertEqual(true, writer.Append(Span(payload + 8, 1)));
+    AssertEqual(true, writer.Append(Span(payload + 9, 13)));
+    AssertEqual(2u, writer.Remaining());
+
+    // nothing is visible before committing
+    AssertEqual(false, !!storage.UnorderedFirst(1));
+    AssertEqual(false, !!Page::FindNewestFirst("TEST"));
+    AssertEqual(1u, version);
+
+    AssertEqual(true, writer.Append(Span(payload + 22, 2)));
+    Span rec = writer.Commit();
+    AssertEqual(false, writer.Active());
+    AssertEqual(4u + sizeof(payload), rec.Length());
+    AssertEqual(1u, rec.Element<uint32_t>());
+    AssertEqual(Span(payload), storage.NewestFirst(1));
+    AssertEqual(2u, version);
+
+    // the page remains writable the usual way after the streamed record
+    auto next = storage.Add(2, Span(payload, 5));
+    AssertEqual(Span(payload, 5), next);
+    AssertEqual(Span(payload), storage.NewestFirst(1));
+    AssertEqual(next.Pointer(), storage.NewestFirst(2).Pointer());
+}
+
+TEST_CASE("02 Gather Add")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+
+    VariableKeyStorage storage("TEST");
+    RecordWriter writer("TEST");
+
+    // enough records to require multiple pages
+    constexpr uint32_t count = 100;
+    for (uint32_t i = 1; i <= count; i++)
+    {
+        Span parts[] = { Span(i), Span(payload, i % 17), Span(payload + 17, 7) };
+        Span rec = writer.Add(i, parts, countof(parts));
+        AssertEqual(4u + 4u + i % 17 + 7u, rec.Length());
+        AssertEqual(rec.Pointer(), storage.NewestFirst(i).Pointer() - 4);
+    }
+    AssertNotEqual(Page::OldestFirst("TEST"), Page::NewestFirst("TEST"));
+
+    for (uint32_t i = 1; i <= count; i++)
+    {
+        Span data = storage.NewestFirst(i);
+        AssertEqual(Span(i), Span(data.Pointer(), 4));
+        AssertEqual(Span(payload, i % 17), Span(data.Pointer() + 4, i % 17));
+        AssertEqual(Span(payload + 17, 7), Span(data.Pointer() + 4 + i % 17, 7));
+    }
+}
+
+TEST_CASE("03 Abort")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+
+    VariableStorage storage("TEST");
+    RecordWriter writer("TEST");
+
+    // explicitly abandoned record
+    AssertEqual(true, writer.Begin(sizeof(payload)));
+    AssertEqual(true, writer.Append(Span(payload, 10)));
+    writer.Abort();
+    AssertEqual(false, writer.Active());
+    AssertEqual(false, !!storage.NewestFirst());
+
+    // incomplete record cannot be committed
+    AssertEqual(true, writer.Begin(sizeof(payload)));
+    AssertEqual(true, writer.Append(Span(payload, 10)));
+    AssertEqual(false, !!writer.Commit());
+    AssertEqual(false, !!storage.NewestFirst());
+
+    // appending more than reserved aborts the record
+    AssertEqual(true, writer.Begin(8));
+    AssertEqual(false, writer.Append(Span(payload, 10)));
+    AssertEqual(false, writer.Active());
+    AssertEqual(false, !!writer.Commit());
+    AssertEqual(false, !!storage.NewestFirst());
+
+    // a record abandoned by destroying the writer
+    {
+        RecordWriter temp("TEST");
+        AssertEqual(true, temp.Begin(sizeof(payload)));
+        AssertEqual(true, temp.Append(Span(payload, 20)));
+    }
+    AssertEqual(false, !!storage.NewestFirst());
+
+    // records can still be written after the abandoned ones
+    AssertEqual(true, writer.Begin(sizeof(payload)));
+    AssertEqual(true, writer.Append(Span(payload, 1)));
+    AssertEqual(true, writer.Append(Span(payload + 1, sizeof(payload) - 1)));
+    Span rec = writer.Commit();
+    AssertEqual(Span(payload), rec);
+    AssertEqual(Span(payload), storage.NewestFirst());
+    AssertEqual(false, !!storage.NewestNext(rec));
+
+    // records that cannot fit any page fail immediately
+    static const uint8_t large[PagePayload] = {};
+    AssertEqual(false, writer.Begin(sizeof(large)));
+}
+
+}
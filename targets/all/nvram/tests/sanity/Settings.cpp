@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2026 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * nvram/tests/sanity/Settings.cpp
+ */
+
+#include <testrunner/TestCase.h>
+
+#include <nvram/nvram.h>
+#include <nvram/Settings.h>
+
+using namespace nvram;
+
+namespace
+{
+
+extern Settings group;
+
+// defaults are referenced by the specs, just like with SETTING
+const uint32_t defaults[] = { 10, 20, 30, 40 };
+
+// the first and third settings share a bucket
+const TypedSettingSpec<uint32_t> specOne(group, 1, "one", defaults[0]);
+const TypedSettingSpec<uint32_t> specTwo(group, 2, "two", defaults[1]);
+const TypedSettingSpec<uint32_t> specThree(group, 1 + SettingsBuckets, "three", defaults[2]);
+const TypedSettingSpec<uint32_t> specLoose(group, 4, "loose", defaults[3]);
+
+TypedSetting<uint32_t> one(specOne);
+TypedSetting<uint32_t> two(specTwo);
+TypedSetting<uint32_t> three(specThree);
+TypedSetting<uint32_t> oneAgain(specOne);
+TypedSetting<uint32_t> loose(specLoose);
+
+const SettingPtr table[] = { &one, &two, &three, &oneAgain };
+
+Settings group("TSET", table, endof(table));
+
+void MarkAllNotified()
+{
+    while (auto setting = group.GetNotifySetting())
+    {
+        setting->MarkNotified();
+    }
+}
+
+TEST_CASE("01 Setting Lookup")
+{
+    AssertEqual((Setting*)&one, group.GetSetting(1));
+    AssertEqual((Setting*)&two, group.GetSetting(2));
+    AssertEqual((Setting*)&three, group.GetSetting(1 + SettingsBuckets));
+    AssertEqual((Setting*)NULL, group.GetSetting(3));
+    // settings outside of the table are not found
+    AssertEqual((Setting*)NULL, group.GetSetting(4));
+}
+
+TEST_CASE("02 Reload")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+
+    // nothing stored yet, all settings have the defaults
+    AssertEqual(10u, one.Get());
+    AssertEqual(20u, two.Get());
+    AssertEqual(30u, three.Get());
+    AssertEqual(10u, oneAgain.Get());
+    AssertEqual(40u, loose.Get());
+    MarkAllNotified();
+
+    // a single change refreshes all settings of the group
+    const uint32_t values[] = { 1, 2, 3 };
+    const uint16_t shortValue = 4;
+    AssertEqual(Span(values[1]), group.Set(2, Span(values[1])));
+    AssertEqual(Span(values[2]), group.Set(1 + SettingsBuckets, Span(values[2])));
+    AssertEqual(Span(shortValue), group.Set(4, Span(shortValue)));
+    AssertEqual(10u, one.Get());
+    AssertEqual((Setting*)&two, group.GetNotifySetting());
+    two.MarkNotified();
+    AssertEqual((Setting*)&three, group.GetNotifySetting());
+    three.MarkNotified();
+    AssertEqual((Setting*)NULL, group.GetNotifySetting());
+    AssertEqual(2u, two.Get());
+    AssertEqual(3u, three.Get());
+    // values that are too short are replaced with the default
+    AssertEqual(40u, loose.Get());
+
+    // explicit reload after deleting a stored value
+    AssertEqual(true, group.Delete(2));
+    AssertEqual(Span(values[0]), group.Set(1, Span(values[0])));
+    group.Reload();
+    AssertEqual(1u, one.Get());
+    AssertEqual(1u, oneAgain.Get());
+    AssertEqual(20u, two.Get());
+    AssertEqual(3u, three.Get());
+    MarkAllNotified();
+}
+
+}
@@ -10,6 +10,8 @@
 
 #include <nvram/nvram.h>
 
+#include <vector>
+
 using namespace nvram;
 
 namespace
@@ -364,5 +366,556 @@ TEST_CASE("08 Corrupted Variable Storage")
     AssertNotEqual(next, t3);
 };
 
+TEST_CASE("09 Interleaved Appends")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+
+    struct Test { uint32_t a, b; };
+    FixedStorage<Test> storage[] = { ID("TST1"), ID("TST2"), ID("TST3") };
+
+    // spill over several pages for each type, alternating between them
+    const uint32_t count = PagePayload / sizeof(Test) * 2 + 5;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        for (uint32_t n = 0; n < countof(storage); n++)
+        {
+            auto t = storage[n].Add({ n + 1, i });
+            AssertNotEqual((const Test*)NULL, t);
+        }
+
+        if (i == count / 2)
+        {
+            // records must continue on a newly allocated page
+            Page::New("TST2", sizeof(Test));
+        }
+    }
+
+    for (uint32_t n = 0; n < countof(storage); n++)
+    {
+        uint32_t i = 0;
+        for (auto t = storage[n].OldestFirst(); t; t = storage[n].OldestNext(t))
+        {
+            AssertEqual(n + 1, t->a);
+            AssertEqual(i++, t->b);
+        }
+        AssertEqual(count, i);
+    }
+}
+
+TEST_CASE("10 Indexed Unique Key Storage")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+    nvram::RegisterCollector("TEST", 0, CollectorRelocate);
+    nvram::RegisterCollector("TVAR", 0, CollectorRelocate);
+
+    struct Test { uint32_t a, b; };
+    IndexedFixedUniqueKeyStorage<Test, 64> fixed("TEST");
+    IndexedVariableUniqueKeyStorage<64> var("TVAR");
+
+    AssertEqual((const Test*)NULL, fixed.Get(1));
+    AssertEqual((const void*)NULL, var.Get(1));
+
+    // overwrite the keys enough times to spill over multiple pages
+    for (uint32_t n = 0; n < 100; n++)
+    {
+        for (uint32_t key = 1; key <= 20; key++)
+        {
+            auto t = fixed.Set(key, { key, n });
+            AssertNotEqual((const Test*)NULL, t);
+            AssertEqual(t, fixed.Get(key));
+            auto span = var.Set(key, Span(Test { key, n }));
+            AssertNotEqual((const void*)NULL, span);
+            AssertEqual(span.Pointer(), var.Get(key).Pointer());
+        }
+        // let the collector relocate records
+        kernel::Scheduler::Main().Run();
+    }
+
+    AssertEqual(true, fixed.Delete(7));
+    AssertEqual(true, var.Delete(7));
+
+    for (uint32_t key = 1; key <= 20; key++)
+    {
+        // the index must agree with the linear search
+        AssertEqual(FixedUniqueKeyStorage<Test>("TEST").Get(key), fixed.Get(key));
+        AssertEqual(VariableUniqueKeyStorage("TVAR").Get(key).Pointer(), var.Get(key).Pointer());
+        if (key != 7)
+        {
+            AssertEqual(99u, fixed.Get(key)->b);
+            AssertEqual(Span(Test { key, 99 }), var.Get(key));
+        }
+    }
+    AssertEqual((const Test*)NULL, fixed.Get(7));
+    AssertEqual((const void*)NULL, var.Get(7));
+
+    // the index must be refilled after the NVRAM is initialized again
+    nvram::Initialize(Span());
+    AssertEqual(99u, fixed.Get(20)->b);
+    AssertEqual(Span(Test { 20, 99 }), var.Get(20));
+
+    // an index destroyed before the next initialization must not be updated by the writes
+    {
+        IndexedVariableUniqueKeyStorage<16> scoped("TVAR");
+        AssertEqual(Span(Test { 20, 99 }), scoped.Get(20));
+    }
+    AssertNotEqual((const void*)NULL, var.Set(20, Span(Test { 20, 100 })));
+    AssertEqual(Span(Test { 20, 100 }), var.Get(20));
+
+#if NVRAM_KEY_INDEX
+    // keys sharing a prefix (e.g. "SET0", "SET1"...) differ only in their top bits,
+    // they must still be spread over the table instead of forming one long probe sequence
+    struct PrefixIndex : KeyIndexTable<64>
+    {
+        using KeyIndex::LongestProbe;
+    } prefixed;
+
+    for (uint32_t n = 0; n < 40; n++)
+    {
+        uint32_t key = 'S' | 'E' << 8 | 'T' << 16 | ('0' + n) << 24;
+        AssertNotEqual((const void*)NULL, VariableUniqueKeyStorage("TPFX").Set(key, Span(n)));
+    }
+    for (uint32_t n = 0; n < 40; n++)
+    {
+        uint32_t key = 'S' | 'E' << 8 | 'T' << 16 | ('0' + n) << 24;
+        AssertEqual(Span(Page::FindUnorderedFirst("TPFX", key)), prefixed.Get("TPFX", key));
+    }
+    AssertEqual(true, prefixed.LongestProbe() < 8);
+#endif
+}
+
+TEST_CASE("11 Batched Writes")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+    nvram::RegisterCollector("TVAR", 0, CollectorRelocate);
+
+    unsigned version;
+    nvram::RegisterVersionTracker("TVAR", &version);
+    AssertEqual(1u, version);
+
+    VariableUniqueKeyStorage var("TVAR");
+
+    // enough records to spill over multiple pages
+    const size_t count = 80;
+    uint32_t values[count];
+    Page::BatchRecord records[count];
+    for (uint32_t i = 0; i < count; i++)
+    {
+        values[i] = i * 3;
+        records[i] = { i + 1, Span(values[i]) };
+    }
+
+    AssertEqual(count, var.SetBatch(records, count));
+    AssertEqual(2u, version);   // single notification for the whole batch
+    for (uint32_t i = 0; i < count; i++)
+    {
+        AssertEqual(Span(values[i]), var.Get(i + 1));
+    }
+
+    // identical records are not written again and nothing is notified
+    AssertEqual(count, var.SetBatch(records, count));
+    AssertEqual(2u, version);
+
+    // replace every other record
+    for (uint32_t i = 0; i < count; i += 2)
+    {
+        values[i] = ~i;
+    }
+    AssertEqual(count, var.SetBatch(records, count));
+    AssertEqual(3u, version);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        AssertEqual(Span(values[i]), var.Get(i + 1));
+        // the replaced records must be the only ones with their key
+        AssertEqual((const void*)NULL, VariableKeyStorage("TVAR").UnorderedNext(var.Get(i + 1)));
+    }
+
+    // fixed records are allocated on pages large enough for the largest record
+    struct Small { uint32_t a; };
+    struct Large { uint32_t a, b, c; };
+    Small s = { 1 };
+    Large l = { 2, 3, 4 };
+    Page::BatchRecord mixed[] = { { 1, Span(s) }, { 2, Span(l) } };
+    AssertEqual(2u, Page::AddFixedBatch("TFIX", mixed, 2));
+    AssertEqual(RequiredAligned(sizeof(Large) + 4),
+        size_t(Page::FindUnorderedFirst("TFIX", 2).Pointer() - Page::FindUnorderedFirst("TFIX", 1).Pointer()));
+    AssertEqual((const Page*)NULL, Page::NewestFirst("TFIX")->NewestNext());
+}
+
+TEST_CASE("12 Async Add Waits for Collector")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+    nvram::RegisterCollector("TEST", 0, CollectorDiscardOldest);
+
+    struct Test { uint32_t a, b; };
+    FixedStorage<Test> storage("TEST");
+
+    // fill the NVRAM without letting the collector run
+    uint32_t n = 0;
+    while (storage.Add({ 1, n }))
+    {
+        n++;
+    }
+    AssertEqual(0u, nvram::PagesAvailable());
+
+    auto t = (const Test*)storage.AddAsync({ 2, n }, MonoFromSeconds(1));
+    AssertNotEqual((const Test*)NULL, t);
+    AssertEqual(2u, t->a);
+    AssertEqual(t, storage.NewestFirst());
+
+    auto v = (const uint8_t*)VariableKeyStorage("TVAR").ReplaceAsync(5, Span(n), MonoFromSeconds(1));
+    AssertNotEqual((const uint8_t*)NULL, v);
+    AssertEqual(Span(n), VariableKeyStorage("TVAR").NewestFirst(5));
+    AssertEqual(v, VariableKeyStorage("TVAR").NewestFirst(5).Pointer());
+}
+
+TEST_CASE("13 Async Add Timeout")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+
+    struct Test { uint32_t a, b; };
+    FixedStorage<Test> storage("TEST");
+
+    // without any collector, no space can be made
+    uint32_t n = 0;
+    while (storage.Add({ 1, n }))
+    {
+        n++;
+    }
+
+    AssertEqual((const Test*)NULL, (const Test*)storage.AddAsync({ 2, n }, MonoFromSeconds(1)));
+    AssertEqual(1u, storage.NewestFirst()->a);
+
+    // records that cannot fit any page fail immediately
+    static const uint8_t large[PagePayload] = {};
+    AssertEqual((const void*)NULL, (const void*)Page::AddVarAsync("TVAR", Span(large), MonoFromSeconds(1)));
+}
+
+TEST_CASE("14 Keyed Search Across Pages")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+
+    struct Value { uint32_t v; };
+    VariableKeyStorage var("TVAR");
+    FixedKeyStorage<Value> fixed("TFIX");
+
+    // each key is written three times, spread across multiple pages
+    constexpr uint32_t keys = 200, count = keys * 3;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        AssertEqual(Span(i), var.Add(i % keys + 1, Span(i)));
+        AssertNotEqual((const Value*)NULL, fixed.Add(i % keys + 1, Value { i }));
+    }
+    AssertNotEqual(Page::OldestFirst("TVAR"), Page::NewestFirst("TVAR"));
+    AssertNotEqual(Page::OldestFirst("TFIX"), Page::NewestFirst("TFIX"));
+
+    for (uint32_t key = 1; key <= keys; key++)
+    {
+        AssertEqual(Span(count - keys + key - 1), var.NewestFirst(key));
+        AssertEqual(Span(key - 1), var.OldestFirst(key));
+        AssertEqual(count - keys + key - 1, fixed.NewestFirst(key)->v);
+        AssertEqual(key - 1, fixed.OldestFirst(key)->v);
+
+        int n = 0;
+        for (Span rec = var.NewestFirst(key); rec; rec = var.NewestNext(rec))
+        {
+            n++;
+        }
+        AssertEqual(3, n);
+    }
+
+    AssertEqual(false, !!var.NewestFirst(keys + 1));
+    AssertEqual((const Value*)NULL, fixed.NewestFirst(keys + 1));
+
+    // records written after a search are found
+    uint32_t value = 12345;
+    AssertEqual(Span(value), var.Add(keys + 1, Span(value)));
+    AssertEqual(Span(value), var.NewestFirst(keys + 1));
+    AssertNotEqual((const Value*)NULL, fixed.Add(keys + 1, Value { value }));
+    AssertEqual(value, fixed.NewestFirst(keys + 1)->v);
+
+    // deleted records are not
+    AssertEqual(true, var.Delete(7));
+    AssertEqual(false, !!var.UnorderedFirst(7));
+    AssertEqual(true, fixed.Delete(7));
+    AssertEqual((const Value*)NULL, fixed.UnorderedFirst(7));
+}
+
+TEST_CASE("15 Variable Records With Footers")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+
+    VariableStorage storage("TFTR");
+    uint32_t buf[8];
+    auto add = [&](uint32_t i)
+    {
+        for (auto& w: buf)
+        {
+            w = i + 1;
+        }
+        return storage.Add(Span(buf, 4 + i % 13));
+    };
+
+    std::vector<uint32_t> expect;
+    auto verify = [&]()
+    {
+        size_t n = 0;
+        for (Span rec = storage.NewestFirst(); rec; rec = storage.NewestNext(rec), n++)
+        {
+            AssertNotEqual(expect.size(), n);
+            AssertEqual(expect[n], rec.Element<uint32_t>());
+        }
+        AssertEqual(expect.size(), n);
+    };
+
+    // pages of both formats can follow each other
+    auto classic = Page::New("TFTR", 0);
+    for (uint32_t i = 0; i < 20; i++)
+    {
+        AssertEqual(classic, Page::FromPtr(add(i).Pointer()));
+    }
+    auto footers = Page::New("TFTR", Page::VarWithFooter);
+    for (uint32_t i = 20; i < 40; i++)
+    {
+        AssertEqual(footers, Page::FromPtr(add(i).Pointer()));
+    }
+
+    AssertEqual(21u, footers->FirstRecord().Element<uint32_t>());
+    AssertEqual(40u, footers->LastRecord().Element<uint32_t>());
+
+    // shredded records are walked over
+    AssertEqual(true, Page::Delete("TFTR", 26));
+    AssertEqual(true, Page::Delete("TFTR", 40));
+    AssertEqual(39u, footers->LastRecord().Element<uint32_t>());
+
+    for (uint32_t i = 39; i > 0; i--)
+    {
+        if (i != 26)
+        {
+            expect.push_back(i);
+        }
+    }
+    verify();
+
+    // records written around garbage in the free space are still found
+    auto last = storage.NewestFirst();
+    Flash::Write(last.Pointer() + last.Length() + 24, BYTES(42));
+    for (uint32_t i = 40; i < 43; i++)
+    {
+        AssertEqual(footers, Page::FromPtr(add(i).Pointer()));
+        expect.insert(expect.begin(), i + 1);
+    }
+    verify();
+
+    // records can be moved between the formats
+    auto moved = Page::New("TFTR", Page::VarWithFooter);
+    AssertEqual(true, classic->MoveRecords(moved, 0));
+    AssertEqual(20u, storage.NewestFirst().Element<uint32_t>());
+    auto back = Page::New("TFTR", 0);
+    AssertEqual(true, moved->MoveRecords(back, 0));
+    AssertEqual(true, footers->MoveRecords(back, 0));
+    AssertEqual(back, Page::FromPtr(storage.NewestFirst().Pointer()));
+    verify();
+}
+
+TEST_CASE("16 Specialized Fixed Search")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+
+    struct Item { uint32_t a, b, c; };
+    FixedKeyStorage<Item> storage("TEST");
+
+    // the first page is allocated for larger records, the following ones for the storage records
+    uint8_t large[28] = {};
+    AssertEqual(true, !!Page::AddFixed("TEST", 1000, Span(large)));
+    constexpr uint32_t keys = 20, count = 300;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        AssertNotEqual((const Item*)NULL, storage.Add(i % keys + 1, Item { i, i, i }));
+    }
+    AssertEqual(true, storage.Delete(3));
+    AssertEqual(true, storage.Delete(11));
+    AssertNotEqual(Page::OldestFirst("TEST")->OldestNext(), Page::NewestFirst("TEST"));
+
+    // the results match the generic search, both on pages with matching and different layout
+    for (uint32_t key = 1; key <= keys + 1; key++)
+    {
+        const Item* rec = storage.NewestFirst(key);
+        for (Span generic = Page::FindNewestFirst("TEST", key); generic; generic = Page::FindNewestNext(generic, key))
+        {
+            AssertEqual(generic.Pointer() + 4, (const uint8_t*)rec);
+            rec = storage.NewestNext(rec);
+        }
+        AssertEqual((const Item*)NULL, rec);
+
+        rec = storage.OldestFirst(key);
+        for (Span generic = Page::FindOldestFirst("TEST", key); generic; generic = Page::FindOldestNext(generic, key))
+        {
+            AssertEqual(generic.Pointer() + 4, (const uint8_t*)rec);
+            rec = storage.OldestNext(rec);
+        }
+        AssertEqual((const Item*)NULL, rec);
+
+        rec = storage.UnorderedFirst(key);
+        for (Span generic = Page::FindUnorderedFirst("TEST", key); generic; generic = Page::FindUnorderedNext(generic, key))
+        {
+            AssertEqual(generic.Pointer() + 4, (const uint8_t*)rec);
+            rec = storage.UnorderedNext(rec);
+        }
+        AssertEqual((const Item*)NULL, rec);
+    }
+
+    ID key;
+    const Item* rec = storage.EnumerateUnorderedFirst(key);
+    for (Span generic = Page::FindUnorderedFirst("TEST"); generic; generic = Page::FindUnorderedNext(generic))
+    {
+        AssertEqual(generic.Pointer() + 4, (const uint8_t*)rec);
+        AssertEqual(generic.Element<uint32_t>(), uint32_t(key));
+        rec = storage.EnumerateUnorderedNext(rec, key);
+    }
+    AssertEqual((const Item*)NULL, rec);
+}
+
+TEST_CASE("17 Ring Storage")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+
+    struct Entry { uint32_t valid, n; };
+    constexpr uint32_t perPage = PagePayload / sizeof(Entry);
+    RingStorage<Entry, 64> log("RING");
+    log.RegisterCollector(1);
+
+    // a few pages worth of records, read in the same order as the generic search returns them
+    uint32_t n = 0;
+    for (; n < perPage * 3 + 5; n++)
+    {
+        AssertNotEqual((const Entry*)NULL, log.Add({ 1, n }));
+    }
+    const Entry* rec = log.OldestFirst();
+    for (Span generic = Page::FindOldestFirst("RING"); generic; generic = Page::FindOldestNext(generic))
+    {
+        AssertEqual(generic.Pointer(), (const uint8_t*)rec);
+        rec = log.OldestNext(rec);
+    }
+    AssertEqual((const Entry*)NULL, rec);
+    AssertEqual(n - 1, log.NewestFirst()->n);
+
+    // the reader resumes where it stopped
+    RingStorage<Entry, 64>::Cursor cursor = {};
+    for (uint32_t i = 0; i < perPage + 2; i++)
+    {
+        rec = log.ReadNext(cursor);
+        AssertNotEqual((const Entry*)NULL, rec);
+        AssertEqual(i, rec->n);
+    }
+    AssertEqual(perPage + 2, log.Read(cursor)->n);
+
+    // the cursor remains valid after reinitialization
+    nvram::Initialize(Span(), nvram::InitFlags::None);
+    log.RegisterCollector(1);
+    AssertEqual(perPage + 2, log.Read(cursor)->n);
+
+    // wrap around the flash several times, discarding the oldest pages
+    uint32_t total = Flash::GetRange().Length() / Flash::PageSize * PagesPerBlock * perPage * 2;
+    for (; n < total; n++)
+    {
+        if (!log.Add({ 1, n }))
+        {
+            kernel::Scheduler::Main().Run();
+            AssertNotEqual((const Entry*)NULL, log.Add({ 1, n }));
+        }
+    }
+    kernel::Scheduler::Main().Run();
+
+    // the page with the cursor is gone, reading continues with the oldest record
+    AssertEqual(Page::FindOldestFirst("RING").Pointer(), (const uint8_t*)log.Read(cursor));
+    rec = log.OldestFirst();
+    AssertEqual(true, rec->n > perPage + 2);
+    for (; rec->n != n - 1; rec = log.OldestNext(rec))
+    {
+        AssertEqual(rec->n + 1, log.OldestNext(rec)->n);
+    }
+    AssertEqual((const Entry*)NULL, log.OldestNext(rec));
+    AssertEqual(rec, log.NewestFirst());
+
+    // a ring too small for all the pages falls back to scanning them
+    RingStorage<Entry, 2> small("RSML");
+    for (uint32_t i = 0; i < perPage * 3; i++)
+    {
+        AssertNotEqual((const Entry*)NULL, small.Add({ 1, i }));
+    }
+    RingStorage<Entry, 2>::Cursor at = {};
+    for (uint32_t i = 0; i < perPage * 3; i++)
+    {
+        AssertEqual(i, small.ReadNext(at)->n);
+    }
+    AssertEqual((const Entry*)NULL, small.Read(at));
+    AssertEqual(perPage * 3 - 1, small.NewestFirst()->n);
+
+    // the collector of a storage is removed when the storage is destroyed
+    {
+        RingStorage<Entry, 2> scoped("RSML");
+        scoped.RegisterCollector(0);
+    }
+    Manager::For("RSML").RunCollector();
+    kernel::Scheduler::Main().Run();
+    AssertEqual(0u, small.OldestFirst()->n);
+    AssertEqual(perPage * 3 - 1, small.NewestFirst()->n);
+}
+
+#if NVRAM_INPLACE_UPDATES
+
+TEST_CASE("18 In-Place Updates")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+
+    unsigned version;
+    nvram::RegisterVersionTracker("TEST", &version);
+
+    struct State { uint32_t flags, counter, other; };
+    FixedUniqueKeyStorage<State> storage("TEST");
+
+    const State initial = { ~0u, ~0u, 1 };
+    auto rec = storage.Set(1, initial);
+    AssertNotEqual((const State*)NULL, rec);
+    AssertEqual(2u, version);
+
+    // clearing bits reprograms the same record
+    const State cleared = { ~1u, ~0u, 1 };
+    AssertEqual(rec, storage.Set(1, cleared));
+    AssertEqual(Span(cleared), Span(*rec));
+    AssertEqual(3u, version);
+
+    const State counted = { ~1u, ~0u << 8, 0 };
+    AssertEqual(rec, storage.Set(1, counted));
+    AssertEqual(Span(counted), Span(*rec));
+    AssertEqual(rec, storage.Get(1));
+    AssertEqual(4u, version);
+
+    // setting any bit requires a new record
+    const State reset = { ~0u, ~0u << 8, 0 };
+    auto next = storage.Set(1, reset);
+    AssertNotEqual(rec, next);
+    AssertEqual(Span(reset), Span(*next));
+    AssertEqual(next, storage.Get(1));
+    AssertEqual(5u, version);
+
+    // batches are updated in place as well
+    const State batched = { 0, ~0u << 8, 0 };
+    Page::BatchRecord records[] = { { 1, Span(batched) } };
+    AssertEqual(1u, storage.SetBatch(records, countof(records)));
+    AssertEqual(next, storage.Get(1));
+    AssertEqual(Span(batched), Span(*next));
+    AssertEqual(6u, version);
+
+    // records on variable pages are never updated in place, even when replaced as fixed ones
+    auto var = Page::AddVar("TVAR", 1, Span(initial));
+    AssertNotEqual((const void*)NULL, var);
+    auto replaced = Page::ReplaceFixed("TVAR", 1, Span(cleared));
+    AssertNotEqual((const void*)NULL, replaced);
+    AssertNotEqual(var.Pointer(), replaced.Pointer());
+    AssertEqual(Span(cleared), replaced);
 }
 
+#endif
+
+}
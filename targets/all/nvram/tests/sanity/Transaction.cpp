@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) 2026 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * nvram/tests/sanity/Transaction.cpp
+ */
+
+#include <testrunner/TestCase.h>
+
+#include <nvram/nvram.h>
+
+#include <new>
+
+#if NVRAM_TRANSACTIONS
+
+using namespace nvram;
+
+namespace
+{
+
+static const uint32_t values[] = { 1, 2, 3, 4 };
+
+//! Returns a transaction that is never destroyed, as if interrupted by a reset
+static Transaction& Interrupted()
+{
+    alignas(Transaction) static uint8_t mem[sizeof(Transaction)];
+    return *new(mem) Transaction();
+}
+
+TEST_CASE("01 Commit")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+
+    unsigned version;
+    nvram::RegisterVersionTracker("TEST", &version);
+
+    VariableUniqueKeyStorage storage("TEST");
+    FixedUniqueKeyStorage<uint32_t> fixed("TFIX");
+    AssertEqual(Span(values[0]), storage.Set(1, Span(values[0])));
+    AssertEqual(Span(values[0]), storage.Set(2, Span(values[0])));
+    AssertEqual(3u, version);
+
+    Transaction t;
+    AssertEqual(true, t.SetVar("TEST", 1, Span(values[1])));
+    AssertEqual(true, t.Delete("TEST", 2));
+    AssertEqual(true, t.SetVar("TEST", 3, Span(values[2])));
+    AssertEqual(true, t.SetFixed("TFIX", 4, Span(values[3])));
+
+    // nothing changes before the commit
+    AssertEqual(Span(values[0]), storage.Get(1));
+    AssertEqual(Span(values[0]), storage.Get(2));
+    AssertEqual(false, !!storage.Get(3));
+    AssertEqual((const uint32_t*)NULL, fixed.Get(4));
+    AssertEqual(3u, version);
+
+    AssertEqual(true, t.Commit());
+    AssertEqual(Span(values[1]), storage.Get(1));
+    AssertEqual(false, !!storage.Get(2));
+    AssertEqual(Span(values[2]), storage.Get(3));
+    AssertEqual(values[3], *fixed.Get(4));
+    AssertEqual(false, !!Page::FindUnorderedFirst(TransactionJournal));
+
+    // an empty transaction commits trivially
+    Transaction empty;
+    AssertEqual(true, empty.Commit());
+}
+
+TEST_CASE("02 Abort")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+
+    VariableUniqueKeyStorage storage("TEST");
+    AssertEqual(Span(values[0]), storage.Set(1, Span(values[0])));
+
+    {
+        Transaction t;
+        AssertEqual(true, t.SetVar("TEST", 1, Span(values[1])));
+        AssertNotEqual(0u, t.Id());
+        AssertEqual(true, !!Page::FindUnorderedFirst(TransactionJournal));
+    }
+    AssertEqual(false, !!Page::FindUnorderedFirst(TransactionJournal));
+    AssertEqual(Span(values[0]), storage.Get(1));
+
+    // changes that don't fit the journal abort the whole transaction
+    static const uint8_t large[PagePayload] = {};
+    Transaction t;
+    AssertEqual(true, t.SetVar("TEST", 1, Span(values[2])));
+    AssertEqual(false, t.SetVar("TEST", 2, Span(large)));
+    AssertEqual(false, t.SetVar("TEST", 3, Span(values[2])));
+    AssertEqual(false, t.Commit());
+    AssertEqual(Span(values[0]), storage.Get(1));
+    AssertEqual(false, !!Page::FindUnorderedFirst(TransactionJournal));
+}
+
+TEST_CASE("03 Recovery")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+
+    VariableUniqueKeyStorage storage("TEST");
+    AssertEqual(Span(values[0]), storage.Set(1, Span(values[0])));
+
+    // uncommitted transactions are discarded
+    Transaction& lost = Interrupted();
+    AssertEqual(true, lost.SetVar("TEST", 1, Span(values[1])));
+    AssertEqual(true, lost.SetVar("TEST", 2, Span(values[1])));
+
+    nvram::Initialize(Span(), nvram::InitFlags::None);
+    AssertEqual(false, !!Page::FindUnorderedFirst(TransactionJournal));
+    AssertEqual(Span(values[0]), storage.Get(1));
+    AssertEqual(false, !!storage.Get(2));
+
+    // committed ones are completed, even if already partially applied
+    Transaction& committed = Interrupted();
+    AssertEqual(true, committed.SetVar("TEST", 1, Span(values[2])));
+    AssertEqual(true, committed.Delete("TEST", 1));
+    AssertEqual(true, committed.SetVar("TEST", 2, Span(values[2])));
+    AssertEqual(true, committed.SetVar("TEST", 3, Span(values[3])));
+    AssertEqual(true, !!Page::AddVar(TransactionJournal, committed.Id(), Span()));
+    AssertEqual(Span(values[2]), storage.Set(2, Span(values[2])));
+
+    nvram::Initialize(Span(), nvram::InitFlags::None);
+    AssertEqual(false, !!Page::FindUnorderedFirst(TransactionJournal));
+    AssertEqual(false, !!storage.Get(1));
+    AssertEqual(Span(values[2]), storage.Get(2));
+    AssertEqual(Span(values[3]), storage.Get(3));
+    AssertEqual(false, !!Page::FindUnorderedNext(Page::FindUnorderedFirst("TEST", 2), 2));
+}
+
+TEST_CASE("04 Not Enough Space")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+    nvram::RegisterCollector("FILL", 1, CollectorDiscardOldest);
+
+    VariableUniqueKeyStorage storage("TEST");
+    VariableUniqueKeyStorage other("TNEW");
+    AssertEqual(Span(values[0]), storage.Set(1, Span(values[0])));
+
+    Transaction t;
+    AssertEqual(true, t.SetVar("TEST", 1, Span(values[1])));
+    AssertEqual(true, t.SetVar("TNEW", 1, Span(values[1])));
+
+    // the new page type cannot get a page, the transaction is aborted without any change
+    while (Page::New("FILL"));
+    AssertEqual(false, t.Commit());
+    AssertEqual(Span(values[0]), storage.Get(1));
+    AssertEqual(false, !!other.Get(1));
+    AssertEqual(false, !!Page::FindUnorderedFirst(TransactionJournal));
+
+    // the collector frees the missing page, so the transaction can be retried
+    kernel::Scheduler::Main().Run();
+    AssertEqual(true, t.SetVar("TEST", 1, Span(values[1])));
+    AssertEqual(true, t.SetVar("TNEW", 1, Span(values[1])));
+    AssertEqual(true, t.Commit());
+    AssertEqual(Span(values[1]), storage.Get(1));
+    AssertEqual(Span(values[1]), other.Get(1));
+}
+
+TEST_CASE("05 Background Completion")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+
+    VariableUniqueKeyStorage storage("TEST");
+    VariableUniqueKeyStorage other("TNEW");
+    AssertEqual(Span(values[0]), storage.Set(1, Span(values[0])));
+
+    // a committed transaction changing a page type that cannot get a page after the reset
+    Transaction& committed = Interrupted();
+    AssertEqual(true, committed.SetVar("TEST", 1, Span(values[1])));
+    AssertEqual(true, committed.SetVar("TNEW", 1, Span(values[1])));
+    AssertEqual(true, !!Page::AddVar(TransactionJournal, committed.Id(), Span()));
+    while (Page::New("FILL"));
+
+    nvram::Initialize(Span(), nvram::InitFlags::None);
+    nvram::RegisterCollector("FILL", 1, CollectorDiscardOldest);
+    AssertEqual(Span(values[1]), storage.Get(1));
+    AssertEqual(false, !!other.Get(1));
+
+    // no other transaction can be committed until it is applied
+    Transaction t;
+    AssertEqual(true, t.SetVar("TEST", 2, Span(values[2])));
+    AssertEqual(false, t.Commit());
+    AssertEqual(false, !!storage.Get(2));
+
+    // the collector frees the missing page and the transaction is applied in the background
+    kernel::Scheduler::Main().Run();
+    AssertEqual(false, !!Page::FindUnorderedFirst(TransactionJournal));
+    AssertEqual(Span(values[1]), storage.Get(1));
+    AssertEqual(Span(values[1]), other.Get(1));
+}
+
+TEST_CASE("06 Multiple Pages Needed")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+
+    // the changes of a single page type do not fit on one page
+    static const uint8_t data[256] = {};
+    const uint32_t count = PagePayload / sizeof(data) + 1;
+    VariableUniqueKeyStorage storage("TEST");
+    Transaction t;
+    for (uint32_t key = 1; key <= count; key++)
+    {
+        AssertEqual(true, t.SetVar("TEST", key, Span(data)));
+    }
+
+    // the commit marker fits on the journal, only one page is left for the changes
+    AssertNotEqual((const Page*)NULL, Page::New(TransactionJournal));
+    while (nvram::PagesAvailable() > 1 && Page::New("FILL"));
+    AssertEqual(1u, nvram::PagesAvailable());
+    AssertEqual(false, t.Commit());
+    AssertEqual(false, !!storage.Get(1));
+    AssertEqual(false, !!Page::FindUnorderedFirst(TransactionJournal));
+}
+
+}
+
+#endif
@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2026 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * nvram/tests/sanity/WriteBuffer.cpp
+ */
+
+#include <testrunner/TestCase.h>
+
+#include <nvram/nvram.h>
+
+using namespace nvram;
+
+namespace
+{
+
+static const uint8_t payload[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16 };
+
+TEST_CASE("01 Staging and Flush")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+
+    unsigned version;
+    nvram::RegisterVersionTracker("TEST", &version);
+
+    WriteBufferStorage<256> buffer("TEST");
+    VariableKeyStorage storage("TEST");
+
+    for (uint32_t i = 1; i <= 10; i++)
+    {
+        AssertEqual(true, buffer.Add(i, Span(payload, i)));
+    }
+
+    // nothing is visible before flushing
+    AssertNotEqual(0u, buffer.Pending());
+    AssertEqual((const void*)NULL, storage.UnorderedFirst(1));
+    AssertEqual(1u, version);
+
+    AssertEqual(true, buffer.Flush());
+    AssertEqual(0u, buffer.Pending());
+    AssertEqual(2u, version);
+
+    // records are stored in order
+    uint32_t key = 0;
+    for (Span rec = Page::FindOldestFirst("TEST"); rec; rec = Page::FindOldestNext(rec))
+    {
+        key++;
+        AssertEqual(key, rec.Element<uint32_t>());
+        AssertEqual(Span(payload, key), Span(rec.Pointer() + 4, rec.Length() - 4));
+    }
+    AssertEqual(10u, key);
+
+    // the page remains writable the usual way after the staged records
+    auto rec = storage.Add(11, Span(payload, 11));
+    AssertEqual(Span(payload, 11), rec);
+    AssertEqual(rec.Pointer(), storage.NewestFirst(11).Pointer());
+    AssertEqual((const void*)NULL, storage.NewestNext(rec));
+}
+
+TEST_CASE("02 Automatic Flush")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+
+    WriteBufferStorage<64> buffer("TEST");
+    VariableKeyStorage storage("TEST");
+
+    // each of the records takes 24 bytes, the third one won't fit
+    AssertEqual(true, buffer.Add(1, Span(payload, 16)));
+    AssertEqual(true, buffer.Add(2, Span(payload, 16)));
+    AssertEqual((const void*)NULL, storage.UnorderedFirst(1));
+    AssertEqual(true, buffer.Add(3, Span(payload, 16)));
+    AssertEqual(Span(payload, 16), storage.UnorderedFirst(1));
+    AssertEqual(Span(payload, 16), storage.UnorderedFirst(2));
+    AssertEqual((const void*)NULL, storage.UnorderedFirst(3));
+
+    // records larger than the buffer are written directly after the staged ones
+    uint8_t large[100] = { 0 };
+    AssertEqual(true, buffer.Add(4, large));
+    AssertEqual(0u, buffer.Pending());
+    AssertEqual(Span(payload, 16), storage.UnorderedFirst(3));
+    AssertEqual(Span(large), storage.UnorderedFirst(4));
+    AssertEqual(true, storage.UnorderedFirst(3).Pointer() < storage.UnorderedFirst(4).Pointer());
+}
+
+TEST_CASE("03 Flush Across Pages")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+
+    WriteBufferStorage<4096> buffer("TEST");
+    VariableKeyStorage storage("TEST");
+
+    // a few records written the usual way first
+    for (uint32_t i = 1; i <= 5; i++)
+    {
+        AssertEqual(Span(payload, 5), storage.Add(i, Span(payload, 5)));
+    }
+
+    // much more than fits in a single page
+    for (uint32_t i = 6; i <= 200; i++)
+    {
+        AssertEqual(true, buffer.Add(i, Span(payload, i % 16 + 1)));
+    }
+    AssertEqual(true, buffer.Flush());
+
+    uint32_t key = 0;
+    for (Span rec = Page::FindOldestFirst("TEST"); rec; rec = Page::FindOldestNext(rec))
+    {
+        key++;
+        AssertEqual(key, rec.Element<uint32_t>());
+        AssertEqual(Span(payload, key <= 5 ? 5 : key % 16 + 1), Span(rec.Pointer() + 4, rec.Length() - 4));
+    }
+    AssertEqual(200u, key);
+    AssertNotEqual((const Page*)NULL, Page::OldestFirst("TEST")->OldestNext());
+}
+
+TEST_CASE("04 Garbage in Target Area")
+{
+    nvram::Initialize(Span(), nvram::InitFlags::Reset);
+
+    WriteBufferStorage<256> buffer("TEST");
+    VariableKeyStorage storage("TEST");
+
+    auto rec = storage.Add(1, Span(payload, 4));
+    // simulate an unfinished write after the last record
+    Flash::Write(rec.Pointer() + 32, Span(payload, 8));
+
+    for (uint32_t i = 2; i <= 10; i++)
+    {
+        AssertEqual(true, buffer.Add(i, Span(payload, 8)));
+    }
+    AssertEqual(true, buffer.FlushAsync());
+
+    uint32_t key = 0;
+    for (Span rec = Page::FindOldestFirst("TEST"); rec; rec = Page::FindOldestNext(rec))
+    {
+        if (rec.Element<uint32_t>() == ~0u)
+            continue;   // the garbage may look like a record without a key
+        key++;
+        AssertEqual(key, rec.Element<uint32_t>());
+    }
+    AssertEqual(10u, key);
+}
+
+}
@@ -0,0 +1,13 @@
+#
+# Copyright (c) 2026 triaxis s.r.o.
+# Licensed under the MIT license. See LICENSE.txt file in the repository root
+# for full license information.
+#
+# nvram/tests/sanity_async/Include.mk
+#
+# This is a variant of the basic sanity suite with asynchronous flash writes
+#
+
+DEFINES += NVRAM_FLASH_ASYNC_WRITE=1
+
+override TEST := $(call parentdir, $(TEST))sanity/
@@ -0,0 +1,13 @@
+#
+# Copyright (c) 2026 triaxis s.r.o.
+# Licensed under the MIT license. See LICENSE.txt file in the repository root
+# for full license information.
+#
+# nvram/tests/sanity_banks/Include.mk
+#
+# This is a variant of the basic sanity suite with concurrent erases in two flash banks
+#
+
+DEFINES += NVRAM_FLASH_ERASE_BANKS=2
+
+override TEST := $(call parentdir, $(TEST))sanity/
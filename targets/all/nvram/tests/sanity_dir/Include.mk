@@ -0,0 +1,13 @@
+#
+# Copyright (c) 2026 triaxis s.r.o.
+# Licensed under the MIT license. See LICENSE.txt file in the repository root
+# for full license information.
+#
+# nvram/tests/sanity_dir/Include.mk
+#
+# This is a variant of the basic sanity suite with the RAM page directory enabled
+#
+
+DEFINES += NVRAM_PAGE_DIRECTORY=64
+
+override TEST := $(call parentdir, $(TEST))sanity/
@@ -0,0 +1,13 @@
+#
+# Copyright (c) 2026 triaxis s.r.o.
+# Licensed under the MIT license. See LICENSE.txt file in the repository root
+# for full license information.
+#
+# nvram/tests/sanity_footer/Include.mk
+#
+# This is a variant of the basic sanity suite with length footers on variable records
+#
+
+DEFINES += NVRAM_VAR_FOOTERS=1
+
+override TEST := $(call parentdir, $(TEST))sanity/
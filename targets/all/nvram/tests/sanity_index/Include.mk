@@ -0,0 +1,13 @@
+#
+# Copyright (c) 2026 triaxis s.r.o.
+# Licensed under the MIT license. See LICENSE.txt file in the repository root
+# for full license information.
+#
+# nvram/tests/sanity_index/Include.mk
+#
+# This is a variant of the basic sanity suite with the RAM key indices enabled
+#
+
+DEFINES += NVRAM_KEY_INDEX=1
+
+override TEST := $(call parentdir, $(TEST))sanity/
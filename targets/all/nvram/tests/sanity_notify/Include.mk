@@ -0,0 +1,13 @@
+#
+# Copyright (c) 2026 triaxis s.r.o.
+# Licensed under the MIT license. See LICENSE.txt file in the repository root
+# for full license information.
+#
+# nvram/tests/sanity_notify/Include.mk
+#
+# This is a variant of the basic sanity suite with deferred change notifications
+#
+
+DEFINES += NVRAM_NOTIFY_DEFERRED=4
+
+override TEST := $(call parentdir, $(TEST))sanity/
@@ -0,0 +1,13 @@
+#
+# Copyright (c) 2026 triaxis s.r.o.
+# Licensed under the MIT license. See LICENSE.txt file in the repository root
+# for full license information.
+#
+# nvram/tests/sanity_pool/Include.mk
+#
+# This is a variant of the basic sanity suite with block bitmaps enabled
+#
+
+DEFINES += NVRAM_MAX_BLOCKS=32 NVRAM_BLOCKS_KEPT_FREE=1
+
+override TEST := $(call parentdir, $(TEST))sanity/
@@ -0,0 +1,14 @@
+#
+# Copyright (c) 2026 triaxis s.r.o.
+# Licensed under the MIT license. See LICENSE.txt file in the repository root
+# for full license information.
+#
+# nvram/tests/sanity_restore/Include.mk
+#
+# This is a variant of the basic sanity suite with initialization from checkpoints
+# holding the page directory, with statistics showing the work skipped by restoring them
+#
+
+DEFINES += NVRAM_CHECKPOINT NVRAM_PAGE_DIRECTORY=64 NVRAM_STATS=1
+
+override TEST := $(call parentdir, $(TEST))sanity/
@@ -0,0 +1,13 @@
+#
+# Copyright (c) 2026 triaxis s.r.o.
+# Licensed under the MIT license. See LICENSE.txt file in the repository root
+# for full license information.
+#
+# nvram/tests/sanity_unique/Include.mk
+#
+# This is a variant of the basic sanity suite with double-word writes and unique key page types
+#
+
+DEFINES += NVRAM_FLASH_DOUBLE_WRITE NVRAM_UNIQUE_KEY_PAGES=2
+
+override TEST := $(call parentdir, $(TEST))sanity/
@@ -0,0 +1,721 @@
+/*
+ * Copyright (c) 2026 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * nvram/tests/stress/Stress.cpp
+ *
+ * Randomized workloads against the storage helpers, with simulated power loss
+ * and latency histograms of each API call, requires the host flash emulation
+ */
+
+#include <testrunner/TestCase.h>
+
+#include <nvram/nvram.h>
+
+#include <chrono>
+#include <setjmp.h>
+
+//! Number of operations performed by the uninterrupted workload
+#ifndef NVRAM_STRESS_OPS
+#define NVRAM_STRESS_OPS    1000000
+#endif
+
+//! Number of simulated power cuts, each after a random number of programmed words
+#ifndef NVRAM_STRESS_CUTS
+#define NVRAM_STRESS_CUTS   20000
+#endif
+
+//! Upper bound of the number of words programmed between two power cuts
+#ifndef NVRAM_STRESS_CUT_WORDS
+#define NVRAM_STRESS_CUT_WORDS  4000
+#endif
+
+using namespace nvram;
+
+namespace
+{
+
+//! Latency histogram of a single API call, with buckets of powers of two nanoseconds
+class Histogram
+{
+public:
+    template<typename TOp> auto Measure(TOp op)
+    {
+        auto start = std::chrono::steady_clock::now();
+        auto res = op();
+        Add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+        return res;
+    }
+
+    void Add(uint64_t ns)
+    {
+        unsigned b = 0;
+        while (b < Buckets - 1 && (2ull << b) <= ns)
+        {
+            b++;
+        }
+        buckets[b]++;
+        count++;
+        total += ns;
+        if (ns > max)
+        {
+            max = ns;
+        }
+    }
+
+    void Report(const char* name, const char* kind = "") const
+    {
+        if (!count)
+        {
+            return;
+        }
+
+        printf("%-8s %-14s %8u calls | avg %7.0f p50 < %7llu p99 < %7llu max %8llu ns |",
+            name, kind, count, double(total) / count, Percentile(0.5), Percentile(0.99), max);
+
+        unsigned first = 0, last = Buckets - 1;
+        while (!buckets[first]) first++;
+        while (!buckets[last]) last--;
+        for (unsigned b = first; b <= last; b++)
+        {
+            printf(" 2^%u:%u", b, buckets[b]);
+        }
+        printf("\n");
+    }
+
+private:
+    static constexpr unsigned Buckets = 40;
+
+    uint32_t count = 0;
+    uint32_t buckets[Buckets] = {};
+    unsigned long long total = 0, max = 0;
+
+    //! Returns the upper bound of the bucket containing the specified fraction of the calls
+    unsigned long long Percentile(double fraction) const
+    {
+        uint32_t n = 0;
+        for (unsigned b = 0; b < Buckets; b++)
+        {
+            n += buckets[b];
+            if (n >= count * fraction)
+            {
+                return 2ull << b;
+            }
+        }
+        return max;
+    }
+};
+
+//! Simple deterministic pseudo-random sequence, so that all runs perform the same operations
+static uint32_t Random(uint32_t& seed)
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+//! Unique key storages exercised by the workload
+enum Kind
+{
+    KindVar,
+    KindIndexedVar,
+    KindFixed,
+    KindIndexedFixed,
+    KindCompressed,
+    Kinds,
+};
+
+static const char* const kindNames[Kinds] = { "var", "indexed var", "fixed", "indexed fixed", "compressed" };
+
+static bool IsFixed(Kind kind) { return kind == KindFixed || kind == KindIndexedFixed; }
+
+//! Shredding of variable records can be interrupted halfway when using double writes
+#if NVRAM_FLASH_DOUBLE_WRITE
+static constexpr bool PartialShreds = true;
+#else
+static constexpr bool PartialShreds = false;
+#endif
+
+//! Fixed record, self-checking so that mixed up contents are detected
+struct Item
+{
+    uint32_t value, inverse, hash;
+};
+
+//! Ring entry, numbered in the order of addition
+struct Entry
+{
+    uint32_t n, inverse;
+};
+
+static constexpr unsigned Keys = 24;
+static constexpr unsigned MaxVarWords = 12;
+static constexpr unsigned MaxCompressed = 216;
+
+//! Values read back for records that don't exist or whose contents don't match any stored value
+static constexpr uint32_t Missing = 0, Corrupt = ~0u;
+
+//! Values that may be read back for a key
+//!
+//! When a replacement is interrupted after the new record is written, both records remain
+//! until the key is written again (see @ref Page::FindReplaced) and either may be read.
+struct Expected
+{
+    uint32_t values[6];
+    unsigned count;
+
+    static Expected Only(uint32_t value) { return { { value }, 1 }; }
+
+    bool Matches(uint32_t value) const
+    {
+        for (unsigned i = 0; i < count; i++)
+        {
+            if (values[i] == value)
+                return true;
+        }
+        return false;
+    }
+
+    void Add(uint32_t value)
+    {
+        if (!Matches(value) && count < countof(values))
+        {
+            values[count++] = value;
+        }
+    }
+};
+
+/*!
+ * Performs random operations on all storage types and keeps a model of their expected contents
+ *
+ * Each value identifies the contents of the record as well, so any mixed up or partially
+ * written record is detected when read back. The changes being performed are remembered
+ * until their outcome is known, when the power is cut during a change, either the previous
+ * or the new contents must be found, for all the keys changed by a transaction together.
+ */
+class Workload
+{
+public:
+    Workload()
+        : var("SVAR"), indexedVar("SIDX"), fixed("SFIX"), indexedFixed("SIFX"), compressed("SCMP"), ring("SRNG") {}
+
+    //! Initializes NVRAM as after a reset and registers the collectors
+    void Mount(InitFlags flags)
+    {
+        if (!!(flags & InitFlags::Reset))
+        {
+            for (auto& e: model)
+            {
+                for (auto& k: e)
+                {
+                    k = Expected::Only(Missing);
+                }
+            }
+            pendingCount = 0;
+            ringAttempted = ringConfirmed = 0;
+            cursor = {};
+        }
+
+#if NVRAM_UNIQUE_KEY_PAGES
+        nvram::UseUniqueKeys(var.pageId);
+        nvram::UseUniqueKeys(indexedVar.pageId);
+        nvram::UseUniqueKeys(compressed.pageId);
+#endif
+#if NVRAM_LARGE_PAGES
+        // mixed geometries, the variable records share the blocks with the fixed ones otherwise
+        nvram::UseLargePages(var.pageId);
+        nvram::UseLargePages(fixed.pageId);
+#endif
+        AssertEqual(true, init.Measure([&] { return nvram::Initialize(Span(), flags); }));
+        const ID ids[] = { var.pageId, indexedVar.pageId, fixed.pageId, indexedFixed.pageId, compressed.pageId };
+        for (ID id: ids)
+        {
+            nvram::RegisterCollector(id, 0, CollectorCleanup);
+            nvram::RegisterCollector(id, 1, CollectorRelocate);
+        }
+        ring.RegisterCollector(1);
+    }
+
+    //! Performs a single random operation
+    void Step()
+    {
+        uint32_t r = Random(seed);
+        Kind kind = Kind(r % Kinds);
+        uint32_t key = (r >> 4) % Keys + 1;
+
+        switch ((r >> 12) % 16)
+        {
+        case 0: case 1: case 2: case 3: case 4: case 5:
+        {
+            uint32_t value = get[kind].Measure([&] { return Read(kind, key); });
+            AssertEqual(true, model[kind][key - 1].Matches(value));
+            break;
+        }
+
+        case 6: case 7: case 8: case 9: case 10:
+            Change(kind, key, ++serial);
+            break;
+
+        case 11:
+            Change(kind, key, Missing);
+            break;
+
+        case 12: case 13:
+            Append();
+            break;
+
+        case 14:
+        {
+            const Entry* e = ringRead.Measure([&] { return ring.ReadNext(cursor); });
+            AssertEqual(true, !e || e->inverse == ~e->n);
+            break;
+        }
+
+        case 15:
+#if NVRAM_TRANSACTIONS
+            ChangeTogether(key, key % Keys + 1, Random(seed) % Keys + 1);
+#else
+            Change(kind, key, ++serial);
+#endif
+            break;
+        }
+
+        if (++steps % 16 == 0)
+        {
+            Collect();
+        }
+    }
+
+    //! Checks that all records match the model, resolving the outcome of the changes in progress,
+    //! which have been @p interrupted by a power cut or have failed
+    void Verify(bool interrupted = false)
+    {
+        // interrupted shredding leaves a variable record partially shredded from the end, but still valid
+        // (see Page::ShredRecord), so it is found damaged or with a cleared key until the key is written again
+        bool partialShred = PartialShreds && interrupted;
+        for (unsigned i = 0; partialShred && i < pendingCount; i++)
+        {
+            if (!IsFixed(pending[i].kind))
+            {
+                pending[i].from.Add(Corrupt);
+                pending[i].from.Add(Missing);
+            }
+        }
+
+        uint32_t found[Kinds][Keys];
+        for (unsigned kind = 0; kind < Kinds; kind++)
+        {
+            for (uint32_t key = 1; key <= Keys; key++)
+            {
+                found[kind][key - 1] = Read(Kind(kind), key);
+            }
+        }
+
+        bool before = true, after = true;
+        for (unsigned i = 0; i < pendingCount; i++)
+        {
+            auto& c = pending[i];
+            before &= c.from.Matches(found[c.kind][c.key - 1]);
+            after &= found[c.kind][c.key - 1] == c.to;
+        }
+        AssertEqual(true, before || after);
+
+        for (unsigned i = 0; i < pendingCount; i++)
+        {
+            auto& c = pending[i];
+            model[c.kind][c.key - 1] = c.from;
+            model[c.kind][c.key - 1].Add(c.to);
+        }
+        pendingCount = 0;
+
+        for (unsigned kind = 0; kind < Kinds; kind++)
+        {
+            for (uint32_t key = 1; key <= Keys; key++)
+            {
+                auto& m = model[kind][key - 1];
+                uint32_t value = found[kind][key - 1];
+                if (partialShred && !m.Matches(value) && !IsFixed(Kind(kind)) && (value == Corrupt || value == Missing))
+                {
+                    // the only record that could have been shredded, e.g. when relocated by the collector
+                    partialShred = false;
+                    m.Add(Corrupt);
+                    m.Add(Missing);
+                }
+                AssertEqual(true, m.Matches(value));
+            }
+        }
+
+        // the ring contains entries in the order they were added, the collector discards the oldest ones,
+        // so the last confirmed entry is only lost with the whole ring (e.g. to keep a block free)
+        uint32_t last = 0;
+        for (const Entry* e = ring.OldestFirst(); e; e = ring.OldestNext(e))
+        {
+            AssertEqual(~e->n, e->inverse);
+            AssertEqual(true, e->n > last && e->n <= ringAttempted);
+            last = e->n;
+        }
+        AssertEqual(true, !last || last >= ringConfirmed);
+        ringConfirmed = last;
+
+        // all records are contained in their pages, all used blocks are formatted
+        for (auto& b: nvram::Blocks())
+        {
+            if (!b.IsValid())
+                continue;
+
+            AssertEqual(true, b.IsFormatted());
+            for (auto& p: b)
+            {
+                if (!p.IsValid())
+                    continue;
+
+                for (Span rec: p)
+                {
+                    AssertEqual(true, rec.begin() > (const uint8_t*)&p && rec.end() <= p.PayloadEnd());
+                }
+            }
+        }
+    }
+
+    //! Lets the collector catch up, the countdown keeps running so that the power can be cut in the middle
+    //! of a collection, relocation or erase, but leaving the scheduler using longjmp would leave it and
+    //! the interrupted task in an undefined state - the flash just stops changing instead, and the simulated
+    //! reset follows once the tasks have finished
+    void Collect()
+    {
+        auto handler = Flash::powerLoss.handler;
+        Flash::powerLoss.handler = NULL;
+        collect.Measure([] { kernel::Scheduler::Main().Run(); return 0; });
+        Flash::powerLoss.handler = handler;
+        if (Flash::powerLoss.lost && handler)
+        {
+            handler();
+        }
+    }
+
+    void Report() const
+    {
+        for (unsigned kind = 0; kind < Kinds; kind++)
+        {
+            get[kind].Report("get", kindNames[kind]);
+            set[kind].Report("set", kindNames[kind]);
+            del[kind].Report("delete", kindNames[kind]);
+        }
+        ringAdd.Report("add", "ring");
+        ringRead.Report("read", "ring");
+        commit.Report("commit", "transaction");
+        collect.Report("collect");
+        init.Report("init");
+        printf("%u operations failed\n", failed);
+    }
+
+    unsigned failed = 0;
+
+private:
+    VariableUniqueKeyStorage var;
+    IndexedVariableUniqueKeyStorage<16> indexedVar;
+    FixedUniqueKeyStorage<Item> fixed;
+    IndexedFixedUniqueKeyStorage<Item, 16> indexedFixed;
+    CompressedUniqueKeyStorage compressed;
+    RingStorage<Entry, 16> ring;
+    RingStorage<Entry, 16>::Cursor cursor = {};
+
+    Expected model[Kinds][Keys];
+    struct PendingChange
+    {
+        Kind kind;
+        uint32_t key;
+        Expected from;
+        uint32_t to;
+    } pending[3];
+    unsigned pendingCount = 0;
+    uint32_t ringAttempted = 0, ringConfirmed = 0;
+    uint32_t seed = 1, serial = 0, steps = 0;
+
+    Histogram get[Kinds], set[Kinds], del[Kinds];
+    Histogram ringAdd, ringRead, commit, collect, init;
+
+    static Span VarData(uint32_t value, uint32_t* buffer)
+    {
+        unsigned words = 1 + value % MaxVarWords;
+        buffer[0] = value;
+        for (unsigned i = 1; i < words; i++)
+        {
+            buffer[i] = value * 2654435761u + i;
+        }
+        return Span(buffer, words * 4);
+    }
+
+    static Item FixedData(uint32_t value)
+    {
+        return { value, ~value, value * 2654435761u };
+    }
+
+    //! Returns data compressing well, the first word holding the value
+    static Span CompressedData(uint32_t value, uint8_t* buffer)
+    {
+        unsigned len = 16 + value % (MaxCompressed - 16);
+        memcpy(buffer, &value, 4);
+        for (unsigned i = 4; i < len; i++)
+        {
+            buffer[i] = uint8_t(value + i / 16);
+        }
+        return Span(buffer, len);
+    }
+
+    //! Returns the value identifying the contents of the record
+    uint32_t Read(Kind kind, uint32_t key) const
+    {
+        switch (kind)
+        {
+        case KindVar:
+        case KindIndexedVar:
+        {
+            Span data = kind == KindVar ? var.Get(key) : indexedVar.Get(key);
+            if (!data)
+                return Missing;
+            if (data.Length() < 4)
+                return Corrupt;
+            uint32_t buffer[MaxVarWords];
+            uint32_t value = data.Element<uint32_t>();
+            return data == VarData(value, buffer) ? value : Corrupt;
+        }
+
+        case KindFixed:
+        case KindIndexedFixed:
+        {
+            const Item* item = kind == KindFixed ? fixed.Get(key) : indexedFixed.Get(key);
+            if (!item)
+                return Missing;
+            Item expected = FixedData(item->value);
+            return !memcmp(item, &expected, sizeof(Item)) ? item->value : Corrupt;
+        }
+
+        case KindCompressed:
+        {
+            uint8_t buffer[MaxCompressed], expected[MaxCompressed];
+            Span data = compressed.Get(key, buffer, sizeof(buffer));
+            if (!data)
+                return Page::FindUnorderedFirst(compressed.pageId, key) ? Corrupt : Missing;
+            if (data.Length() < 4)
+                return Corrupt;
+            uint32_t value = data.Element<uint32_t>();
+            return data == CompressedData(value, expected) ? value : Corrupt;
+        }
+
+        default:
+            return Corrupt;
+        }
+    }
+
+    //! Stores the contents identified by the value, or deletes the record if @ref Missing
+    bool Write(Kind kind, uint32_t key, uint32_t value)
+    {
+        if (value == Missing)
+        {
+            // nothing needs to be deleted if the record does not exist
+            return del[kind].Measure([&]
+            {
+                switch (kind)
+                {
+                case KindVar: var.Delete(key); break;
+                case KindIndexedVar: indexedVar.Delete(key); break;
+                case KindFixed: fixed.Delete(key); break;
+                case KindIndexedFixed: indexedFixed.Delete(key); break;
+                case KindCompressed: compressed.Delete(key); break;
+                default: break;
+                }
+                return true;
+            });
+        }
+
+        uint32_t words[MaxVarWords];
+        uint8_t bytes[MaxCompressed];
+        Item item = FixedData(value);
+
+        return set[kind].Measure([&]
+        {
+            switch (kind)
+            {
+            case KindVar: return !!var.Set(key, VarData(value, words));
+            case KindIndexedVar: return !!indexedVar.Set(key, VarData(value, words));
+            case KindFixed: return !!fixed.Set(key, item);
+            case KindIndexedFixed: return !!indexedFixed.Set(key, item);
+            case KindCompressed: return !!compressed.Set(key, CompressedData(value, bytes));
+            default: return false;
+            }
+        });
+    }
+
+    //! Changes a single record, retrying once after the collector runs if it fails
+    void Change(Kind kind, uint32_t key, uint32_t value)
+    {
+        pending[0] = { kind, key, model[kind][key - 1], value };
+        pendingCount = 1;
+
+        bool success = Write(kind, key, value);
+        if (!success)
+        {
+            Collect();
+            success = Write(kind, key, value);
+        }
+
+        // a successful change removes all previous records, a failed one must leave them intact
+        if (success)
+        {
+            AssertEqual(value, Read(kind, key));
+            model[kind][key - 1] = Expected::Only(value);
+            pendingCount = 0;
+        }
+        else
+        {
+            failed++;
+            Verify();
+        }
+    }
+
+    //! Adds the next entry to the ring
+    void Append()
+    {
+        uint32_t n = ++ringAttempted;
+        Entry e = { n, ~n };
+
+        if (!ringAdd.Measure([&] { return !!ring.Add(e); }))
+        {
+            Collect();
+            if (!ring.Add(e))
+            {
+                failed++;
+                return;
+            }
+        }
+        ringConfirmed = n;
+    }
+
+#if NVRAM_TRANSACTIONS
+    //! Changes two variable records and one fixed record in a single transaction
+    void ChangeTogether(uint32_t key1, uint32_t key2, uint32_t key3)
+    {
+        uint32_t v1 = ++serial, v2 = ++serial, v3 = Random(seed) % 4 ? ++serial : Missing;
+        pending[0] = { KindVar, key1, model[KindVar][key1 - 1], v1 };
+        pending[1] = { KindVar, key2, model[KindVar][key2 - 1], v2 };
+        pending[2] = { KindFixed, key3, model[KindFixed][key3 - 1], v3 };
+        pendingCount = 3;
+
+        uint32_t words1[MaxVarWords], words2[MaxVarWords];
+        Item item = FixedData(v3);
+
+        auto change = [&]
+        {
+            Transaction t;
+            t.SetVar(var.pageId, key1, VarData(v1, words1));
+            t.SetVar(var.pageId, key2, VarData(v2, words2));
+            if (v3 == Missing)
+                t.Delete(fixed.pageId, key3);
+            else
+                t.SetFixed(fixed.pageId, key3, Span(item));
+            return t.Commit();
+        };
+
+        bool success = commit.Measure(change);
+        if (!success)
+        {
+            // aborted without changing anything, e.g. for the lack of space or before
+            // a previously committed transaction is completed
+            Collect();
+            success = commit.Measure(change);
+        }
+
+        if (success && Page::FindUnorderedFirst(TransactionJournal))
+        {
+            // committed, but applied in the background once the collector makes enough space
+            Collect();
+        }
+
+        if (success)
+        {
+            AssertEqual(v1, Read(KindVar, key1));
+            AssertEqual(v2, Read(KindVar, key2));
+            AssertEqual(v3, Read(KindFixed, key3));
+            model[KindVar][key1 - 1] = Expected::Only(v1);
+            model[KindVar][key2 - 1] = Expected::Only(v2);
+            model[KindFixed][key3 - 1] = Expected::Only(v3);
+            pendingCount = 0;
+        }
+        else
+        {
+            // nothing was committed, the records must keep their previous values
+            failed++;
+            Verify();
+        }
+    }
+#endif
+};
+
+static jmp_buf powerRestored;
+
+static void PowerCut()
+{
+    // nothing runs after the power is cut, just like after a real reset,
+    // a cut inside the scheduler jumps here only after it finishes (see Workload::Collect)
+    longjmp(powerRestored, 1);
+}
+
+TEST_CASE("01 Mixed Workload")
+{
+    Workload w;
+    w.Mount(InitFlags::Reset);
+
+    for (unsigned i = 0; i < NVRAM_STRESS_OPS; i++)
+    {
+        w.Step();
+    }
+
+    w.Collect();
+    w.Verify();
+    w.Mount(InitFlags::None);
+    w.Verify();
+    w.Collect();
+
+    printf("stress: %u operations\n", NVRAM_STRESS_OPS);
+    w.Report();
+    AssertEqual(0u, w.failed);
+}
+
+TEST_CASE("02 Power Loss")
+{
+    Workload w;
+    w.Mount(InitFlags::Reset);
+    uint32_t seed = 1;
+
+    for (unsigned cut = 0; cut < NVRAM_STRESS_CUTS; cut++)
+    {
+        Flash::powerLoss = { 1 + Random(seed) % NVRAM_STRESS_CUT_WORDS, PowerCut };
+        if (!setjmp(powerRestored))
+        {
+            for (;;)
+            {
+                w.Step();
+            }
+        }
+
+        Flash::PowerRestore();
+        w.Mount(InitFlags::None);
+        w.Verify(true);
+    }
+
+    // the interrupted operations have not leaked any space
+    unsigned failedBefore = w.failed;
+    for (unsigned i = 0; i < 10000; i++)
+    {
+        w.Step();
+    }
+    w.Collect();
+    w.Verify();
+
+    printf("stress: %u power cuts\n", NVRAM_STRESS_CUTS);
+    w.Report();
+    AssertEqual(failedBefore, w.failed);
+}
+
+}
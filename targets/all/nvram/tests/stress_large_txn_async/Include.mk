@@ -0,0 +1,14 @@
+#
+# Copyright (c) 2026 triaxis s.r.o.
+# Licensed under the MIT license. See LICENSE.txt file in the repository root
+# for full license information.
+#
+# nvram/tests/stress_large_txn_async/Include.mk
+#
+# This is a variant of the stress test with large pages and the transaction journal
+# enabled, with asynchronous flash writes
+#
+
+DEFINES += NVRAM_LARGE_PAGES=2 NVRAM_TRANSACTIONS=1 NVRAM_FLASH_ASYNC_WRITE=1
+
+override TEST := $(call parentdir, $(TEST))stress/
@@ -0,0 +1,14 @@
+#
+# Copyright (c) 2026 triaxis s.r.o.
+# Licensed under the MIT license. See LICENSE.txt file in the repository root
+# for full license information.
+#
+# nvram/tests/stress_large_txn_banks/Include.mk
+#
+# This is a variant of the stress test with large pages and the transaction journal
+# enabled, with the flash erased in banks
+#
+
+DEFINES += NVRAM_LARGE_PAGES=2 NVRAM_TRANSACTIONS=1 NVRAM_FLASH_ERASE_BANKS=2
+
+override TEST := $(call parentdir, $(TEST))stress/
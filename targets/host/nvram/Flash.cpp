@@ -11,39 +11,166 @@
 #include "Flash.h"
 
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace nvram
 {
 
+//! Maps the emulated flash at an address aligned to its pages, which can be larger than the pages
+//! of the host, as the manager aligns the blocks to them
+static void* MapAligned(size_t size, int flags, int fd)
+{
+    uintptr_t hostPage = sysconf(_SC_PAGESIZE);
+    uintptr_t align = EMULATED_FLASH_PAGE_SIZE > hostPage ? EMULATED_FLASH_PAGE_SIZE : hostPage;
+    uintptr_t reserved = size + align;
+    void* area = mmap(NULL, reserved, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (area == MAP_FAILED)
+    {
+        return area;
+    }
+
+    uintptr_t start = ((uintptr_t)area + align - 1) & ~(align - 1);
+    uintptr_t end = (start + size + hostPage - 1) & ~(hostPage - 1);
+    void* p = mmap((void*)start, size, PROT_READ | PROT_WRITE, flags | MAP_FIXED, fd, 0);
+    if (p == MAP_FAILED)
+    {
+        munmap((void*)start, end - start);
+    }
+
+    // release the rest of the reservation
+    if (start > (uintptr_t)area)
+    {
+        munmap(area, start - (uintptr_t)area);
+    }
+    if ((uintptr_t)area + reserved > end)
+    {
+        munmap((void*)end, (uintptr_t)area + reserved - end);
+    }
+    return p;
+}
+
 static struct FlashImpl
 {
     FlashImpl()
     {
-        p = mmap(NULL, Size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
-        memset(p, 0xFF, Size);
+        p = MapAligned(size, MAP_SHARED | MAP_ANONYMOUS, -1);
+        memset(p, 0xFF, size);
         Protect();
     }
 
-    void Protect() { mprotect(p, Size, PROT_READ); }
-    void Unprotect() { mprotect(p, Size, PROT_READ | PROT_WRITE); }
+    void Protect() { mprotect(p, size, PROT_READ); }
+    void Unprotect() { mprotect(p, size, PROT_READ | PROT_WRITE); }
 
-    static constexpr size_t Size = EMULATED_FLASH_SIZE;
     static constexpr size_t PageSize = EMULATED_FLASH_PAGE_SIZE;
 
     void* p;
+    size_t size = EMULATED_FLASH_SIZE;
+    //! Original emulated flash kept aside while an image is mapped
+    void* original = NULL;
 } flash;
 
+Flash::Stats Flash::stats;
+Flash::PowerLoss Flash::powerLoss;
+
+//! Counts down the programmed units, returns true when the power is to be cut before the next one,
+//! or when it has already been cut and not restored yet
+//! Programming of a single word (or double-word) is atomic, only the erase of a page can be interrupted halfway
+static bool PowerCut()
+{
+    return Flash::powerLoss.lost || (Flash::powerLoss.countdown && !--Flash::powerLoss.countdown);
+}
+
+static void PowerLost();
+
+#if NVRAM_FLASH_DOUBLE_WRITE
+static constexpr size_t ProgramUnit = 8;
+#else
+static constexpr size_t ProgramUnit = 4;
+#endif
+
+#if NVRAM_FLASH_ERASE_BANKS > 1
+static bool EraseRunning(const void* ptr);
+#else
+static constexpr bool EraseRunning(const void*) { return false; }
+#endif
+
 Span Flash::GetRange()
 {
-    return Span(flash.p, flash.Size);
+    return Span(flash.p, flash.size);
+}
+
+bool Flash::MapImage(const char* path, bool writeBack)
+{
+    int fd = open(path, writeBack ? O_RDWR : O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    void* p = MAP_FAILED;
+    if (!fstat(fd, &st) && st.st_size && !(st.st_size % PageSize))
+    {
+        // private mappings can still be written, the changes are just never stored in the file
+        p = MapAligned(st.st_size, writeBack ? MAP_SHARED : MAP_PRIVATE, fd);
+    }
+    close(fd);
+
+    if (p == MAP_FAILED)
+    {
+        return false;
+    }
+
+    if (flash.original)
+    {
+        munmap(flash.p, flash.size);
+    }
+    else
+    {
+        flash.original = flash.p;
+    }
+    flash.p = p;
+    flash.size = st.st_size;
+    flash.Protect();
+    return true;
+}
+
+void Flash::UnmapImage()
+{
+    if (flash.original)
+    {
+        munmap(flash.p, flash.size);
+        flash.p = flash.original;
+        flash.size = EMULATED_FLASH_SIZE;
+        flash.original = NULL;
+    }
 }
 
 bool Flash::Write(const void* ptr, Span data)
 {
+    if (EraseRunning(ptr))
+    {
+        // the bank cannot be programmed until the erase is suspended
+        return false;
+    }
+
+    stats.writes++;
+    stats.programmed += data.Length();
     flash.Unprotect();
     char* p = (char*)ptr;
-    for (char ch: data)
-        *p++ &= ch;
+    const char* src = (const char*)data.Pointer();
+    for (size_t i = 0; i < data.Length(); i++)
+    {
+        if (!(i % ProgramUnit) && PowerCut())
+        {
+            flash.Protect();
+            PowerLost();
+            return false;
+        }
+        p[i] &= src[i];
+    }
     flash.Protect();
     return data == Span(ptr, data.Length());
 }
@@ -53,8 +180,15 @@ bool Flash::Write(const void* ptr, Span data)
 void Flash::ShredDouble(const void* ptr)
 {
     ASSERT(!(uintptr_t(ptr) & 7));
+    ASSERT(!EraseRunning(ptr));
     auto p = (uint32_t*)ptr;
+    stats.shreds++;
     flash.Unprotect();
+    if (PowerCut())
+    {
+        flash.Protect();
+        return PowerLost();
+    }
     p[0] = p[1] = 0;
     flash.Protect();
 }
@@ -62,8 +196,21 @@ void Flash::ShredDouble(const void* ptr)
 bool Flash::WriteDouble(const void* ptr, uint32_t lo, uint32_t hi)
 {
     ASSERT(!(uintptr_t(ptr) & 7));
+    if (EraseRunning(ptr))
+    {
+        return false;
+    }
+
     auto p = (uint32_t*)ptr;
+    stats.writes++;
+    stats.programmed += 8;
     flash.Unprotect();
+    if (PowerCut())
+    {
+        flash.Protect();
+        PowerLost();
+        return false;
+    }
     p[0] &= lo;
     p[1] &= hi;
     flash.Protect();
@@ -75,7 +222,14 @@ bool Flash::WriteDouble(const void* ptr, uint32_t lo, uint32_t hi)
 void Flash::ShredWord(const void* ptr)
 {
     ASSERT(!(uintptr_t(ptr) & 3));
+    ASSERT(!EraseRunning(ptr));
+    stats.shreds++;
     flash.Unprotect();
+    if (PowerCut())
+    {
+        flash.Protect();
+        return PowerLost();
+    }
     *(uint32_t*)ptr = 0;
     flash.Protect();
 }
@@ -83,7 +237,20 @@ void Flash::ShredWord(const void* ptr)
 bool Flash::WriteWord(const void* ptr, uint32_t word)
 {
     ASSERT(!(uintptr_t(ptr) & 3));
+    if (EraseRunning(ptr))
+    {
+        return false;
+    }
+
+    stats.writes++;
+    stats.programmed += 4;
     flash.Unprotect();
+    if (PowerCut())
+    {
+        flash.Protect();
+        PowerLost();
+        return false;
+    }
     *(uint32_t*)ptr &= word;
     flash.Protect();
     return *(uint32_t*)ptr == word;
@@ -93,52 +260,233 @@ bool Flash::WriteWord(const void* ptr, uint32_t word)
 
 bool Flash::Erase(Span range)
 {
+    stats.erases += (range.Length() + PageSize - 1) / PageSize;
     flash.Unprotect();
-    memset((void*)range.Pointer(), 0xFF, range.Length());
+    for (size_t off = 0; off < range.Length(); off += PageSize)
+    {
+        size_t len = range.Length() - off < PageSize ? range.Length() - off : PageSize;
+        if (PowerCut())
+        {
+            if (!powerLoss.lost)
+            {
+                // the interrupted page is left partially erased
+                memset((void*)(range.Pointer() + off), 0xFF, len / 2);
+            }
+            flash.Protect();
+            PowerLost();
+            return false;
+        }
+        memset((void*)(range.Pointer() + off), 0xFF, len);
+    }
     flash.Protect();
     return true;
 }
 
-async(Flash::ErasePageAsync, const void* ptr)
-async_def()
+#if NVRAM_FLASH_BLANK_CHECK
+
+bool Flash::IsBlank(Span range)
+{
+    // there is no blank check unit to emulate
+    return range.IsAllOnes();
+}
+
+#endif
+
+#if NVRAM_FLASH_ASYNC_WRITE
+
+async(Flash::WriteAsync, const void* ptr, const Span* parts, size_t count)
+async_def(
+    const uint8_t* p;
+    size_t i;
+    bool success;
+)
 {
-    static struct EraseOperation
+    stats.asyncWrites++;
+    f.p = (const uint8_t*)ptr;
+    f.success = true;
+
+    // emulates a transfer in the background, other tasks run while each part is being programmed
+    for (f.i = 0; f.i < count; f.i++)
+    {
+        async_yield();
+        f.success = Write(f.p, parts[f.i]) && f.success;
+        f.p += parts[f.i].Length();
+    }
+
+    async_return(f.success);
+}
+async_end
+
+#endif
+
+#if NVRAM_FLASH_ERASE_BANKS > 1
+
+static struct EraseBanks
+{
+    struct
     {
         const void* address;
-        bool active, done;
+        bool active, done, suspended;
+    } bank[NVRAM_FLASH_ERASE_BANKS];
+    bool signal;
+
+    bool PreSleep(mono_t t, mono_t sleepTicks)
+    {
+        if (sleepTicks < EMULATED_FLASH_ERASE_TICKS)
+        {
+            return false;
+        }
 
-        bool PreSleep(mono_t t, mono_t sleepTicks)
+        // all started erases progress at the same time, unless suspended
+        for (auto& b: bank)
         {
-            if (sleepTicks < EMULATED_FLASH_ERASE_TICKS)
+            if (b.active && !b.done && !b.suspended)
             {
-                return false;
+                Flash::Erase(Span(b.address, Flash::PageSize));
+                b.done = true;
             }
+        }
+        __testrunner_time += EMULATED_FLASH_ERASE_TICKS;
+        return signal = true;
+    }
+} erase = {};
 
-            Flash::Erase(Span(address, PageSize));
-            __testrunner_time += EMULATED_FLASH_ERASE_TICKS;
-            return done = true;
+unsigned Flash::EraseBank(const void* ptr)
+{
+    return ((uintptr_t)ptr - (uintptr_t)flash.p) * NVRAM_FLASH_ERASE_BANKS / flash.size;
+}
+
+bool Flash::EraseStart(const void* ptr)
+{
+    auto& b = erase.bank[EraseBank(ptr)];
+    if (b.active)
+    {
+        return false;
+    }
+
+    b.address = (const void*)((intptr_t)ptr & ~(PageSize - 1));
+    b.active = true;
+    b.done = b.suspended = false;
+    return true;
+}
+
+static bool EraseRunning(const void* ptr)
+{
+    auto& b = erase.bank[Flash::EraseBank(ptr)];
+    return b.active && !b.done && !b.suspended;
+}
+
+bool Flash::EraseSuspend(const void* ptr)
+{
+    if (!EraseRunning(ptr))
+    {
+        return false;
+    }
+
+    stats.eraseSuspends++;
+    return erase.bank[EraseBank(ptr)].suspended = true;
+}
+
+void Flash::EraseResume(const void* ptr)
+{
+    auto& b = erase.bank[EraseBank(ptr)];
+    ASSERT(b.suspended);
+    b.suspended = false;
+}
+
+async(Flash::EraseWaitAsync)
+async_def()
+{
+    erase.signal = false;
+    kernel::Scheduler::Current().AddPreSleepCallback(erase, &EraseBanks::PreSleep);
+
+    if (!await_signal_sec(erase.signal, 1))
+    {
+        kernel::Scheduler::Current().RemovePreSleepCallback(erase, &EraseBanks::PreSleep);
+    }
+
+    async_return(erase.signal);
+}
+async_end
+
+bool Flash::EraseDone(const void* ptr)
+{
+    auto& b = erase.bank[EraseBank(ptr)];
+    if (!b.active || !b.done || b.address != (const void*)((intptr_t)ptr & ~(PageSize - 1)))
+    {
+        return false;
+    }
+
+    b.active = false;
+    return true;
+}
+
+#endif
+
+static struct EraseOperation
+{
+    const void* address;
+    bool active, done;
+
+    bool PreSleep(mono_t t, mono_t sleepTicks)
+    {
+        if (sleepTicks < EMULATED_FLASH_ERASE_TICKS)
+        {
+            return false;
         }
-    } op = { 0 };
 
+        Flash::Erase(Span(address, Flash::PageSize));
+        __testrunner_time += EMULATED_FLASH_ERASE_TICKS;
+        return done = true;
+    }
+} eraseOp = { 0 };
+
+async(Flash::ErasePageAsync, const void* ptr)
+async_def()
+{
     ptr = (const void*)((intptr_t)ptr & ~(PageSize - 1));
 
-    if (!await_acquire_sec(op.active, 1, 1))
+    if (!await_acquire_sec(eraseOp.active, 1, 1))
     {
         async_return(false);
     }
 
-    op.done = false;
-    op.address = ptr;
-    kernel::Scheduler::Current().AddPreSleepCallback(op, &EraseOperation::PreSleep);
+    eraseOp.done = false;
+    eraseOp.address = ptr;
+    kernel::Scheduler::Current().AddPreSleepCallback(eraseOp, &EraseOperation::PreSleep);
 
-    if (!await_signal_sec(op.done, 1))
+    if (!await_signal_sec(eraseOp.done, 1))
     {
-        kernel::Scheduler::Current().RemovePreSleepCallback(op, &EraseOperation::PreSleep);
+        kernel::Scheduler::Current().RemovePreSleepCallback(eraseOp, &EraseOperation::PreSleep);
     }
 
-    op.active = false;
-    async_return(op.done);
+    eraseOp.active = false;
+    async_return(eraseOp.done);
 }
 async_end
 
+static void PowerLost()
+{
+    if (Flash::powerLoss.lost)
+    {
+        return;
+    }
+
+    Flash::powerLoss.lost = true;
+    if (Flash::powerLoss.handler)
+    {
+        Flash::powerLoss.handler();
+    }
+}
+
+void Flash::PowerRestore()
+{
+    powerLoss = {};
+    // operations in progress were abandoned with the rest of the system
+    eraseOp.active = false;
+#if NVRAM_FLASH_ERASE_BANKS > 1
+    erase = {};
+#endif
+}
+
 }
@@ -32,7 +32,38 @@ class Flash
 public:
     static constexpr uintptr_t PageSize = EMULATED_FLASH_PAGE_SIZE;
 
+    //! Counters of emulated flash operations, used for benchmarking
+    struct Stats
+    {
+        uint32_t writes;        //< number of write operations
+        uint32_t programmed;    //< number of bytes programmed by write operations
+        uint32_t shreds;        //< number of shredded words (or double-words)
+        uint32_t erases;        //< number of erased flash pages
+        uint32_t asyncWrites;   //< number of asynchronous write operations
+        uint32_t eraseSuspends; //< number of erases suspended to program their bank
+    };
+
+    static Stats stats;
+
+    //! Simulated loss of power, used by stress tests
+    struct PowerLoss
+    {
+        uint32_t countdown;     //< the power is cut instead of programming the countdown-th program unit (or erasing the page), zero when disabled
+        void (*handler)();      //< called when the power is cut, should not return (e.g. jump to a simulated reset), otherwise the operation fails
+        bool lost;              //< set when the power is cut, all further programming and erases fail without changing the flash
+    };
+
+    static PowerLoss powerLoss;
+    //! Restores the power after a simulated cut, disarming @ref powerLoss and abandoning the erases that were in progress
+    static void PowerRestore();
+
     static Span GetRange();
+    //! Replaces the emulated flash with the contents of an image file, which must be a multiple of @ref PageSize,
+    //! changes are stored in the file only if @p writeBack is set
+    //! @returns false if the file cannot be mapped, the emulated flash remains unchanged
+    static bool MapImage(const char* path, bool writeBack);
+    //! Restores the emulated flash replaced by @ref MapImage, with the contents it had before
+    static void UnmapImage();
 
     static bool Write(const void* ptr, Span data);
 #if NVRAM_FLASH_DOUBLE_WRITE
@@ -43,8 +74,31 @@ public:
     static void ShredWord(const void* ptr);
 #endif
     static bool Erase(Span range);
+#if NVRAM_FLASH_BLANK_CHECK
+    static bool IsBlank(Span range);
+#endif
 
     static async(ErasePageAsync, const void* ptr);
+#if NVRAM_FLASH_ERASE_BANKS > 1
+    //! Returns the bank containing the specified location, erases in different banks run concurrently
+    static unsigned EraseBank(const void* ptr);
+    //! Starts erasing the page containing the specified location in the background, returns false if the bank is busy
+    //! The bank cannot be programmed while the erase is running, writes suspend it using @ref EraseSuspend
+    static bool EraseStart(const void* ptr);
+    //! Suspends the erase running in the bank containing the specified location so that the bank can be programmed,
+    //! returns false if there is no running erase to suspend
+    static bool EraseSuspend(const void* ptr);
+    //! Resumes the erase suspended by @ref EraseSuspend
+    static void EraseResume(const void* ptr);
+    //! Waits until at least one of the started erases completes
+    static async(EraseWaitAsync);
+    //! Determines if the erase of the page containing the specified location has completed, releasing its bank
+    static bool EraseDone(const void* ptr);
+#endif
+#if NVRAM_FLASH_ASYNC_WRITE
+    //! Programs the parts one after another starting at the specified location, returns false if verification fails
+    static async(WriteAsync, const void* ptr, const Span* parts, size_t count);
+#endif
 };
 
 }
@@ -0,0 +1,261 @@
+/*
+ * Copyright (c) 2026 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * host/nvram/Image.cpp
+ *
+ * Offline inspection of NVRAM images dumped from devices
+ */
+
+#include "Image.h"
+
+#include <ctype.h>
+
+namespace nvram
+{
+
+static unsigned CountRecords(const Page* p)
+{
+    unsigned n = 0;
+    for (Span rec = p->FirstRecord(); rec; rec = Page::NextRecord(rec))
+    {
+        n++;
+    }
+    return n;
+}
+
+void Image::PrintID(FILE* out, ID id)
+{
+    uint32_t value = id;
+    char text[5] = {};
+    for (unsigned i = 0; i < 4; i++)
+    {
+        text[i] = value >> (i * 8);
+        if (!isprint((uint8_t)text[i]))
+        {
+            fprintf(out, "%08X", value);
+            return;
+        }
+    }
+    fprintf(out, "%-8s", text);
+}
+
+void Image::PrintPage(FILE* out, const Page* p, bool records)
+{
+    uint32_t size = p->GetRecordSize();
+    uint32_t used = p->UsedBytes();
+    uint32_t payload = p->Payload();
+    uint32_t written = payload - p->UnusedBytes();
+
+    PrintID(out, p->GetID());
+    fprintf(out, " seq %5u ", p->Sequence());
+    if (size > Page::VarWithFooter)
+    {
+        fprintf(out, "fixed %-4u", size);
+    }
+    else
+    {
+        fprintf(out, "%-10s", size ? "var+footer" : "var");
+    }
+    fprintf(out, " %4u records, %5u/%u bytes live (%3u%%), %5u written (%3u%%)\n",
+        CountRecords(p), used, payload, used * 100 / payload, written, written * 100 / payload);
+
+    if (!records)
+    {
+        return;
+    }
+
+    for (Span rec = p->FirstRecord(); rec; rec = Page::NextRecord(rec))
+    {
+        fprintf(out, "    +%04X %4u:", unsigned(rec.Pointer() - (const uint8_t*)p), unsigned(rec.Length()));
+        for (uint8_t b: rec)
+        {
+            fprintf(out, " %02X", b);
+        }
+        fprintf(out, "\n");
+    }
+}
+
+void Image::ListPages(FILE* out, Manager& manager)
+{
+    auto blocks = manager.Blocks();
+
+    for (auto& b: blocks)
+    {
+        fprintf(out, "block %4u @ %08X: ", unsigned(&b - blocks.begin()), unsigned((const uint8_t*)&b - (const uint8_t*)blocks.begin()));
+        if (b.IsEmpty())
+        {
+            fprintf(out, "%s\n", Block::IsBlank((const uint32_t*)&b, (const uint32_t*)(&b + 1)) ? "free" : "free, not blank");
+            continue;
+        }
+        if (b.IsErasable())
+        {
+            fprintf(out, "erasable, generation %u\n", b.Generation());
+            continue;
+        }
+        if (!b.IsFormatted())
+        {
+            fprintf(out, "corrupted or not formatted completely, generation %08X\n", b.Generation());
+            continue;
+        }
+
+        fprintf(out, "generation %u%s\n", b.Generation(), b.IsLarge() ? ", large page" : "");
+        for (auto& p: b)
+        {
+            fprintf(out, "  page %2u: ", unsigned(&p - b.begin()));
+            if (p.IsEmpty())
+            {
+                fprintf(out, "free\n");
+            }
+            else if (p.IsErasable())
+            {
+                fprintf(out, "erasable\n");
+            }
+            else
+            {
+                PrintPage(out, &p, false);
+            }
+        }
+    }
+
+    // summary of each page type, reported at its first occurrence
+    fprintf(out, "page types:\n");
+    for (auto& b: blocks)
+    {
+        if (!b.IsFormatted())
+            continue;
+
+        for (auto& p: b)
+        {
+            if (!p.IsValid())
+                continue;
+
+            bool first = true;
+            unsigned pages = 0, records = 0;
+            uint32_t used = 0, capacity = 0;
+            const Page* oldest = &p;
+            const Page* newest = &p;
+
+            for (auto& b2: blocks)
+            {
+                if (!b2.IsFormatted())
+                    continue;
+
+                for (auto& p2: b2)
+                {
+                    if (p2.GetID() != p.GetID())
+                        continue;
+
+                    if (&p2 < &p)
+                    {
+                        first = false;
+                        break;
+                    }
+
+                    pages++;
+                    records += CountRecords(&p2);
+                    used += p2.UsedBytes();
+                    capacity += p2.Payload();
+                    if (OVF_LT(p2.Sequence(), oldest->Sequence()))
+                        oldest = &p2;
+                    if (OVF_GT(p2.Sequence(), newest->Sequence()))
+                        newest = &p2;
+                }
+
+                if (!first)
+                    break;
+            }
+
+            if (first)
+            {
+                fprintf(out, "  ");
+                PrintID(out, p.GetID());
+                fprintf(out, " %4u pages, seq %5u..%-5u %6u records, %7u/%u bytes live (%3u%%)\n",
+                    pages, oldest->Sequence(), newest->Sequence(), records,
+                    used, capacity, unsigned(used * 100 / capacity));
+            }
+        }
+    }
+}
+
+void Image::DumpRecords(FILE* out, ID id, Manager& manager)
+{
+    auto blocks = manager.Blocks();
+
+    for (auto& b: blocks)
+    {
+        if (!b.IsFormatted())
+            continue;
+
+        for (auto& p: b)
+        {
+            if (!p.IsValid() || (id && p.GetID() != id))
+                continue;
+
+            // each page type is dumped at its first occurrence
+            bool first = true;
+            const Page* newest = &p;
+            for (auto& b2: blocks)
+            {
+                if (!b2.IsFormatted())
+                    continue;
+
+                for (auto& p2: b2)
+                {
+                    if (p2.GetID() == p.GetID())
+                    {
+                        first &= &p2 >= &p;
+                        if (OVF_GT(p2.Sequence(), newest->Sequence()))
+                            newest = &p2;
+                    }
+                }
+            }
+
+            if (!first)
+                continue;
+
+            // pages in the order of their age relative to the newest one, oldest first,
+            // copies with the same sequence follow each other in the order of their location
+            const Page* last = NULL;
+            unsigned lastAge = 0;
+            for (;;)
+            {
+                const Page* next = NULL;
+                unsigned nextAge = 0;
+
+                for (auto& b2: blocks)
+                {
+                    if (!b2.IsFormatted())
+                        continue;
+
+                    for (auto& p2: b2)
+                    {
+                        if (p2.GetID() != p.GetID())
+                            continue;
+
+                        unsigned age = uint16_t(newest->Sequence() - p2.Sequence());
+                        bool after = !last || age < lastAge || (age == lastAge && &p2 > last);
+                        bool better = !next || age > nextAge || (age == nextAge && &p2 < next);
+                        if (after && better)
+                        {
+                            next = &p2;
+                            nextAge = age;
+                        }
+                    }
+                }
+
+                if (!next)
+                    break;
+
+                fprintf(out, "block %4u page %2u: ", unsigned(next->Block() - blocks.begin()),
+                    unsigned(next - next->Block()->begin()));
+                PrintPage(out, next, true);
+                last = next;
+                lastAge = nextAge;
+            }
+        }
+    }
+}
+
+}
@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2026 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * host/nvram/Image.h
+ *
+ * Offline inspection of NVRAM images dumped from devices
+ */
+
+#pragma once
+
+#include <nvram/nvram.h>
+
+#include <stdio.h>
+
+namespace nvram
+{
+
+//! Reports the contents of NVRAM images (usually mapped using @ref Flash::MapImage)
+//!
+//! The manager must be attached to the image using @ref Manager::Mount instead of initializing it,
+//! no tasks are run either, so the image is reported exactly as it was dumped, including the damage
+//! that would be repaired by @ref Manager::Initialize. The image must have been created with
+//! the same layout options (block and page size, double writes) as the tool is built with.
+class Image
+{
+public:
+    //! Prints the state of every block and page in the area, followed by a summary of each page type
+    static void ListPages(FILE* out, Manager& manager = _manager);
+    //! Prints the records of all pages with the specified ID (or of all page types if zero), oldest page first
+    static void DumpRecords(FILE* out, ID id = ID(), Manager& manager = _manager);
+
+private:
+    //! Prints the page type as text if it is printable, otherwise as a number
+    static void PrintID(FILE* out, ID id);
+    //! Prints a single page, optionally with its records
+    static void PrintPage(FILE* out, const Page* p, bool records);
+};
+
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2026 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * host/nvram/tools/nvdump.cpp
+ *
+ * Command line tool listing the contents of NVRAM images dumped from devices
+ *
+ * usage: nvdump [-a | -r ID] image...
+ *   -a     dump the records of all pages
+ *   -r ID  dump the records of pages with the specified ID (four characters or a hex number)
+ */
+
+#include <nvram/Image.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+using namespace nvram;
+
+static bool ParseID(const char* arg, uint32_t& id)
+{
+    if (strlen(arg) == 4)
+    {
+        memcpy(&id, arg, 4);
+        return true;
+    }
+
+    char* end;
+    id = strtoul(arg, &end, 16);
+    return *arg && !*end && id && ~id;
+}
+
+int main(int argc, char** argv)
+{
+    bool records = false;
+    uint32_t id = 0;
+    int i = 1;
+
+    for (; i < argc && argv[i][0] == '-'; i++)
+    {
+        if (!strcmp(argv[i], "-a"))
+        {
+            records = true;
+        }
+        else if (!strcmp(argv[i], "-r") && i + 1 < argc && ParseID(argv[i + 1], id))
+        {
+            records = true;
+            i++;
+        }
+        else
+        {
+            i = argc;
+        }
+    }
+
+    if (i >= argc)
+    {
+        fprintf(stderr, "usage: %s [-a | -r ID] image...\n", argv[0]);
+        return 2;
+    }
+
+    int res = 0;
+    for (; i < argc; i++)
+    {
+        if (!Flash::MapImage(argv[i], false))
+        {
+            fprintf(stderr, "%s: cannot map image\n", argv[i]);
+            res = 1;
+            continue;
+        }
+
+        // attach without initializing, which would repair the image
+        _manager.Mount(Span());
+        printf("%s:\n", argv[i]);
+        Image::ListPages(stdout);
+        if (records)
+        {
+            Image::DumpRecords(stdout, ID(id));
+        }
+    }
+
+    return res;
+}